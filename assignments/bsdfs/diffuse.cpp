@@ -39,7 +39,7 @@ public:
 
         /* The BRDF is simply the albedo / pi */
         if (m_texture)
-            return m_texture->eval(bRec.uv)*INV_PI;
+            return m_texture->eval(bRec.uv, bRec.duvdx, bRec.duvdy)*INV_PI;
 
         return m_albedo * INV_PI;
     }
@@ -106,7 +106,7 @@ public:
         /* eval() / pdf() * cos(theta) = albedo. There
            is no need to call these functions. */
         if (m_texture)
-            return m_texture->eval(bRec.uv);
+            return m_texture->eval(bRec.uv, bRec.duvdx, bRec.duvdy);
 
         return m_albedo;
     }
@@ -78,15 +78,9 @@ public:
             const Point2f &apertureSample) const override {
         (void)apertureSample; // unused
 
-        /* Compute the corresponding position on the
-           near plane (in local camera space) */
-        Point3f nearP = m_sampleToCamera * Point3f(
-            samplePosition.x() * m_invOutputSize.x(),
-            samplePosition.y() * m_invOutputSize.y(), 0.0f);
-
         /* Turn into a normalized ray direction, and
            adjust the ray interval accordingly */
-        Vector3f d = nearP.normalized();
+        Vector3f d = cameraDirection(samplePosition);
         float invZ = 1.0f / d.z();
 
         ray.o = m_cameraToWorld * Point3f(0, 0, 0);
@@ -95,6 +89,12 @@ public:
         ray.maxt = m_farClip * invZ;
         ray.update();
 
+        /* Differentials: rays through the neighboring pixels */
+        ray.hasDifferentials = true;
+        ray.rxOrigin = ray.ryOrigin = ray.o;
+        ray.rxDirection = m_cameraToWorld * cameraDirection(samplePosition + Point2f(1.0f, 0.0f));
+        ray.ryDirection = m_cameraToWorld * cameraDirection(samplePosition + Point2f(0.0f, 1.0f));
+
         return Color3f(1.0f);
     }
 
@@ -138,6 +138,16 @@ public:
         return {pos, dir, up, m_nearClip, m_farClip, m_fov};
     }
 private:
+    /// Normalized camera-space direction through the given position on the image plane
+    Vector3f cameraDirection(const Point2f &samplePosition) const {
+        /* Compute the corresponding position on the
+           near plane (in local camera space) */
+        Point3f nearP = m_sampleToCamera * Point3f(
+            samplePosition.x() * m_invOutputSize.x(),
+            samplePosition.y() * m_invOutputSize.y(), 0.0f);
+        return nearP.normalized();
+    }
+
     Vector2f m_invOutputSize;
     Transform m_sampleToCamera;
     Transform m_cameraToWorld;
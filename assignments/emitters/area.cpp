@@ -50,8 +50,15 @@ public:
     }
 
     Color3f samplePhoton(Ray3f &ray, Sampler* sampler) const override {
-        // TODO: Exercise 7.1 a): sample a photon ray
-        throw NoriException("AreaLight::samplePhoton() is not yet implemented!");
+        // Sample a position uniformly and a cosine-weighted direction
+        Point3f position;
+        Normal3f normal;
+        m_parent->samplePosition(sampler->next2D(), position, normal);
+        const Vector3f direction = Warp::squareToCosineHemisphere(sampler->next2D());
+        ray = Ray3f(position, Frame(normal).toWorld(direction));
+
+        // radiance divided by the density 1 / (area * pi) of the cosine-weighted sample
+        return M_PI * m_parent->totalSurfaceArea() * m_radiance;
     }
 
     std::string toString() const override {
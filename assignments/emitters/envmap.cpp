@@ -8,9 +8,27 @@
 #include <nori/dpdf.h>
 
 #include <filesystem/resolver.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Environment map in latitude-longitude parameterization
+ *
+ * The texel in column \c x and row \c y covers the directions with
+ * azimuth in [2pi x/w, 2pi (x+1)/w) and polar angle (measured from the
+ * local y axis) in [pi y/h, pi (y+1)/h). The radiance is constant over a
+ * texel.
+ *
+ * Directions are importance sampled proportionally to the luminance of the
+ * texels weighted by the solid angle they cover (i.e. by sin(theta)): a row
+ * is chosen from the marginal distribution and a column from the
+ * conditional distribution of that row, both using alias tables.
+ *
+ * Photons are emitted along an importance-sampled direction from a disk
+ * perpendicular to it that covers the bounding sphere of the scene.
+ */
 class Envmap : public Emitter {
 public:
     Envmap(const PropertyList &propList) {
@@ -22,7 +40,10 @@ public:
         const filesystem::path filename = getFileResolver()->resolve(propList.getString("filename"));
         m_bitmap = std::make_unique<Bitmap>(filename.str());
 
-        // TODO: Exercise 9.2: prepare your importance sampling distribution
+        // scale factor of the radiance
+        m_scale = propList.getFloat("scale", 1.0f);
+
+        buildDistribution();
     }
 
     void setParent(NoriObject* obj) override {
@@ -30,105 +51,217 @@ public:
         {
             Scene* scene = static_cast<Scene*>(obj);
             scene->setEnvMap(this);
+            m_scene = scene;
         }
     }
 
     Color3f sampleDirect(EmitterQueryRecord &eRec, Point2f sample) const override {
-        if (!m_bitmap)
+        Vector3f localDir;
+        size_t index;
+        float pdf;
+        if (!sampleDirection(sample, localDir, index, pdf))
             return Color3f(0.0f);
 
-        if constexpr (!m_useImportanceSampling)
-        {
-            /* When using uniform sphere sampling, coordinate frame transformations become redundant,
-             * Otherwise, we would need to account for rotations of the environment map in the \c m_toWorld transformation
-             */
-            eRec.wi = eRec.ws_wi = Warp::squareToUniformSphere(sample);
-
-            // TODO: Exercise 9.1: no importance sampling
-            throw NoriException("Envmap::sampleDirect() is not yet implemented!");
-
-            // set these values to something reasonable and remove the exception
-            eRec.ep = Point3f(-1.0f);
-            eRec.distance = -1.0f;
-            eRec.measure = EUnknownMeasure;
-            return eval(eRec.ws_wi)/pdfDirect(eRec);
-        }
-        else
-        {
-            // TODO: Exercise 9.2: importance sampling
-
-            /* When you use importance sampling, you will need to transform your sampled direction.
-             * Note that the provided test scenes for this exercise do not apply any transformation.
-             */
-
-            // choose an outgoing direction using importance sampling
-            Vector3f localDir;
-
+        /* Transform the local direction vector back to the world coordinate system
+         * and flip the outward-pointing direction to an incident direction
+         */
+        eRec.ws_wi = (m_toWorld*Vector3f(-localDir)).normalized();
+        eRec.wi = eRec.ws_wi;
 
-            /* Transform the local direction vector back to the world coordinate system
-             * and flip the outward-pointing direction to an incident direction
-             */
-            eRec.ws_wi = m_toWorld*Vector3f(-localDir);
+        // the emitter is infinitely far away, only the direction is meaningful
+        eRec.ep = eRec.p;
+        eRec.distance = std::numeric_limits<float>::infinity();
+        eRec.measure = ESolidAngle;
 
-            // also return eval()/pdf() -- you may not need to call those functions
-            throw NoriException("Envmap::sampleDirect() is not yet implemented!");
-        }
+        return radiance(index) / pdf;
     }
 
     float pdfDirect(const EmitterQueryRecord &eRec) const override {
-        // you will have to adjust this when implementing importance sampling
-        if constexpr (!m_useImportanceSampling)
-        {
-            return Warp::squareToUniformSpherePdf(eRec.ws_wi);
-        }
-        else
-        {
-            // TODO: Exercise 9.2: return the importance sampling PDF in solid angle
-            throw NoriException("Envmap::pdfDirect() is not yet implemented!");
-        }
+        if (!m_bitmap || eRec.measure == EDiscrete)
+            return 0.0f;
+
+        float sinTheta;
+        const size_t index = texelIndex(eRec.ws_wi, sinTheta);
+        if (sinTheta <= 0.0f)
+            return 0.0f;
+        return m_texelPdf[index] / sinTheta;
     }
 
     Color3f eval(Vector3f wi) const override {
         if (!m_bitmap)
             return Color3f(0.0f);
 
+        float sinTheta;
+        return radiance(texelIndex(wi, sinTheta));
+    }
+
+    Color3f samplePhoton(Ray3f &ray, Sampler* sampler) const override {
+        if (!m_scene || !m_scene->getBoundingBox().isValid())
+            return Color3f(0.0f);
+
+        Vector3f localDir;
+        size_t index;
+        float pdf;
+        if (!sampleDirection(sampler->next2D(), localDir, index, pdf))
+            return Color3f(0.0f);
+
+        /* Start on a disk perpendicular to the incident direction which
+         * covers the bounding sphere of the scene
+         */
+        const BoundingBox3f &bbox = m_scene->getBoundingBox();
+        const Point3f center = bbox.getCenter();
+        const float radius = 0.5f * bbox.getExtents().norm();
+
+        const Vector3f direction = (m_toWorld*Vector3f(-localDir)).normalized();
+        const Point2f disk = Warp::squareToUniformDisk(sampler->next2D());
+        const Frame frame(direction);
+        ray = Ray3f(center + radius * (frame.s * disk.x() + frame.t * disk.y() - direction), direction);
+
+        // radiance divided by the density of the direction and of the position 1 / (pi r^2) on the disk
+        return radiance(index) * (M_PI * radius * radius / pdf);
+    }
+
+    std::string toString() const override {
+        size_t distributionSize = m_marginal.getMemoryUsage() + m_texelPdf.size() * sizeof(float);
+        for (const AliasTable &row : m_conditional)
+            distributionSize += row.getMemoryUsage();
+
+        return tfm::format(
+            "Envmap[\n"
+            "  size = %ix%i,\n"
+            "  scale = %f,\n"
+            "  toWorld = %s,\n"
+            "  distribution = %s\n"
+            "]",
+            m_bitmap->cols(), m_bitmap->rows(), m_scale,
+            indent(m_toWorld.toString(), 12),
+            memString(distributionSize));
+    }
+
+private:
+    /**
+     * \brief Build the sampling distribution
+     *
+     * Rows are processed in parallel. Every row gets its own alias table
+     * over the columns, the marginal table chooses between the rows. The
+     * joint texel probabilities are stored converted to solid angle (up to
+     * the factor 1/sin(theta) of the exact direction) so that \ref pdfDirect()
+     * is a single lookup.
+     */
+    void buildDistribution() {
         const int width  = m_bitmap->cols();
         const int height = m_bitmap->rows();
 
-        /* Flip the incident direction into an outward-pointing direction
-         * and transform it into the local coordinate system of the envmap.
-         * (y = up, x = right, z = front)
-         */
-        const Vector3f localDir = m_toLocal*Vector3f(-wi);
+        m_conditional.resize(height);
+        std::vector<float> rowWeights(height);
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, height),
+            [&](const tbb::blocked_range<int> &range) {
+                std::vector<float> weights(width);
+                for (int y = range.begin(); y != range.end(); ++y) {
+                    // solid angle covered by the texels of this row (up to a constant)
+                    const float sinTheta = std::sin((y + 0.5f) * M_PI / height);
+                    double rowSum = 0.0;
+                    for (int x = 0; x < width; ++x) {
+                        weights[x] = std::max(0.0f, m_bitmap->coeff(y, x).getLuminance()) * sinTheta;
+                        rowSum += weights[x];
+                    }
+                    // black rows are never chosen and keep an empty table
+                    rowWeights[y] = rowSum > 0.0 ? m_conditional[y].build(weights.data(), weights.size()) : 0.0f;
+                }
+            }
+        );
 
-        // TODO: Exercise 9.1: evaluate the environment map
+        m_texelPdf.assign((size_t) width * height, 0.0f);
+        double totalWeight = 0.0;
+        for (float weight : rowWeights)
+            totalWeight += weight;
+        if (!(totalWeight > 0.0))
+            return;
+        m_marginal.build(rowWeights.data(), rowWeights.size());
 
-        throw NoriException("Envmap::eval() is not yet implemented!");
-        // silence unused variable warnings
-        (void)width, (void)height, (void)localDir;
+        /* Density of the texel in (phi, theta) is p(x,y) * w * h / (2 pi^2) */
+        const float jacobian = width * height / (2.0f * M_PI * M_PI);
+        tbb::parallel_for(tbb::blocked_range<int>(0, height),
+            [&](const tbb::blocked_range<int> &range) {
+                for (int y = range.begin(); y != range.end(); ++y) {
+                    if (rowWeights[y] <= 0.0f)
+                        continue;
+                    for (int x = 0; x < width; ++x)
+                        m_texelPdf[(size_t) y * width + x] = m_marginal[y] * m_conditional[y][x] * jacobian;
+                }
+            }
+        );
     }
 
-    Color3f samplePhoton(Ray3f &ray, Sampler* sampler) const override {
-        // implementing this for the envmap is not part of the exercises
-        throw NoriException("Envmap::samplePhoton() is not yet implemented!");
+    /**
+     * \brief Importance sample an outward-pointing direction in the local
+     * coordinate system
+     *
+     * \return \c false if the environment map is black
+     */
+    bool sampleDirection(Point2f sample, Vector3f &localDir, size_t &index, float &pdf) const {
+        if (!m_bitmap || m_marginal.getSum() <= 0.0f)
+            return false;
+
+        const int width  = m_bitmap->cols();
+        const int height = m_bitmap->rows();
+
+        /* Choose a texel (the sample is reused to place the direction inside it) */
+        const size_t row = m_marginal.sampleReuse(sample.y());
+        const size_t col = m_conditional[row].sampleReuse(sample.x());
+
+        const float phi = (col + sample.x()) * (2.0f * M_PI / width);
+        const float theta = (row + sample.y()) * (M_PI / height);
+        const float sinTheta = std::sin(theta);
+        if (sinTheta <= 0.0f)
+            return false;
+
+        localDir = Vector3f(sinTheta * std::cos(phi), std::cos(theta), sinTheta * std::sin(phi));
+        index = row * width + col;
+        pdf = m_texelPdf[index] / sinTheta;
+        return pdf > 0.0f;
     }
 
-    std::string toString() const override {
+    /// Return the scaled radiance of a texel
+    Color3f radiance(size_t index) const {
+        const int width = m_bitmap->cols();
+        return m_scale * m_bitmap->coeff((int) (index / width), (int) (index % width));
+    }
+
+    /// Return the index of the texel seen in direction \c wi (incident, world space)
+    size_t texelIndex(const Vector3f &wi, float &sinTheta) const {
+        const int width  = m_bitmap->cols();
+        const int height = m_bitmap->rows();
 
-        std::ostringstream oss;
-        oss << "Envmap[" << endl
-            << "]";
-        return oss.str();
+        /* Flip the incident direction into an outward-pointing direction
+         * and transform it into the local coordinate system of the envmap.
+         * (y = up, x = right, z = front)
+         */
+        const Vector3f localDir = (m_toLocal*Vector3f(-wi)).normalized();
 
+        const float cosTheta = clamp(localDir.y(), -1.0f, 1.0f);
+        sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        float phi = std::atan2(localDir.z(), localDir.x());
+        if (phi < 0.0f)
+            phi += 2.0f * M_PI;
+
+        const int x = clamp((int) (phi * INV_TWOPI * width), 0, width - 1);
+        const int y = clamp((int) (std::acos(cosTheta) * INV_PI * height), 0, height - 1);
+        return (size_t) y * width + x;
     }
 
-private:
     Transform m_toWorld;
     Transform m_toLocal;
     std::unique_ptr<Bitmap> m_bitmap;
+    float m_scale;
+
+    AliasTable m_marginal;
+    std::vector<AliasTable> m_conditional;
+    std::vector<float> m_texelPdf;
 
-    // TODO: Exercise 9.2: importance sampling: switch this to true
-    static constexpr bool m_useImportanceSampling = false;
+    /// Scene providing the bounds for photon emission
+    const Scene *m_scene = nullptr;
 };
 
 NORI_REGISTER_CLASS(Envmap, "envmap");
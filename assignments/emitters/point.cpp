@@ -1,4 +1,6 @@
 #include <nori/emitter.h>
+#include <nori/sampler.h>
+#include <nori/warp.h>
 
 NORI_NAMESPACE_BEGIN
 
@@ -42,8 +44,9 @@ public:
     }
 
     Color3f samplePhoton(Ray3f &ray, Sampler *sampler) const override {
-        // implementing this for the point light is not part of the exercises
-        throw NoriException("PointLight::samplePhoton() is not yet implemented!");
+        /* Emit uniformly into all directions */
+        ray = Ray3f(m_toWorld * Point3f(0.0f), Warp::squareToUniformSphere(sampler->next2D()));
+        return m_power;
     }
 
     /* Return a human-readable summary */
@@ -10,6 +10,7 @@
 #include <nori/warp.h>
 #include <nori/emitter.h>
 #include <nori/bsdf.h>
+#include <nori/path.h>
 
 NORI_NAMESPACE_BEGIN
     /**
@@ -22,47 +23,42 @@ public:
         m_rrMinBounces = propList.getInteger("rrMinBounces", m_maxBounces);
     }
 
-    struct RayBounce
-    {
-        Intersection intersection;
-        Vector3f dir;
-    };
-
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay) const override {
-        auto throughput = Color3f(1.0f);
-        auto radiance = Color3f(0);
-        Ray3f currentRay = cameraRay;
-
-        for (int bounce = 0; bounce < m_maxBounces; ++bounce) {
-            Intersection its;
-            if (scene->rayIntersect(currentRay, its)) {
-                const Emitter *emitter = its.mesh->getEmitter();
-                Vector3f wi = its.toLocal(-currentRay.d).normalized();
+        return tracePath(scene, sampler, cameraRay, nullptr);
+    }
 
-                BSDFQueryRecord bsdfRec(wi, its.uv);
+    Color3f LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay, AOVRecord &aovs) const override {
+        return tracePath(scene, sampler, cameraRay, &aovs);
+    }
 
-                auto bsdfColor = its.mesh->getBSDF()->sample(bsdfRec, sampler->next2D());
+    bool stepPath(const Scene *scene, Sampler *sampler, PathState &state, AOVRecord *aovs) const override {
+        /* The emitter found by the extension ray is part of the next vertex */
+        const PathVertex vertex(scene, state.ray);
+        if (aovs && state.bounce == 0 && vertex.hit)
+            aovs->record(vertex.its, sampler, state.ray);
+        state.radiance += state.throughput * vertex.getEmittedRadiance(scene);
 
-                float probabilityToDie = std::max(0.01f, Vector3f(bsdfColor.x(), bsdfColor.y(), bsdfColor.z()).norm());
-                if (bounce < m_rrMinBounces)
-                    probabilityToDie = 1.f;
+        if (!vertex.hit || state.bounce >= m_maxBounces)
+            return false;
 
-                if (emitter) {
-                    radiance += throughput * emitter->eval(wi);
-                }
+        BSDFQueryRecord bsdfRec = vertex.createBSDFRecord();
+        auto bsdfColor = vertex.getBSDF()->sample(bsdfRec, sampler->next2D());
+        if (bsdfColor.isZero())
+            return false;
 
-                if (bounce >= m_rrMinBounces)
-                    if (sampler->next1D() > probabilityToDie)
-                        break;
+        state.throughput *= bsdfColor;
 
-                throughput *= bsdfColor / probabilityToDie;
-                currentRay = Ray3f(its.p, its.toWorld(bsdfRec.wo));
-            } else {
-                break;
-            }
+        /* Russian roulette */
+        if (state.bounce >= m_rrMinBounces) {
+            const float survival = std::min(0.99f, state.throughput.maxCoeff());
+            if (sampler->next1D() > survival)
+                return false;
+            state.throughput /= survival;
         }
 
-        return radiance;
+        state.ray = vertex.spawnRay(bsdfRec);
+        ++state.bounce;
+        return true;
     }
 
     std::string toString() const override {
@@ -75,7 +71,6 @@ public:
 private:
     int m_maxBounces;
     int m_rrMinBounces;
-    const float m_probabilityToDie = 0.1f;
 
 };
 
@@ -0,0 +1,265 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Path tracer with path guiding
+*/
+
+#include <nori/integrator.h>
+#include <nori/sampler.h>
+#include <nori/scene.h>
+#include <nori/emitter.h>
+#include <nori/bsdf.h>
+#include <nori/path.h>
+#include <nori/sdtree.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Path tracer that learns where the incident radiance comes from
+ *
+ * The incident radiance is learned in an \ref SDTree while rendering.
+ * Training proceeds in iterations that last 1, 2, 4, ... passes of the
+ * progressive render manager. At the end of an iteration, the recorded
+ * samples become the sampling distributions of the next one (see
+ * \ref Integrator::finishPass()). After \c trainingIterations iterations,
+ * the distributions are kept fixed.
+ *
+ * Directions are sampled from the BSDF with probability
+ * \c bsdfSamplingFraction and from the learned distribution otherwise,
+ * the result is weighted with the density of the mixture. Emitter
+ * sampling is combined with the mixture using MIS (balance heuristic).
+ * Render managers that don't render in passes (see
+ * \ref Integrator::beginPasses()) only sample the BSDF and don't train.
+ */
+class GuidedPath : public Integrator {
+public:
+    GuidedPath(const PropertyList &propList) {
+        m_maxBounces = propList.getInteger("maxBounces", 10);
+        m_rrMinBounces = propList.getInteger("rrMinBounces", m_maxBounces);
+
+        /* probability of sampling the BSDF instead of the learned distribution */
+        m_bsdfSamplingFraction = propList.getFloat("bsdfSamplingFraction", 0.5f);
+        if (m_bsdfSamplingFraction <= 0.0f || m_bsdfSamplingFraction > 1.0f)
+            throw NoriException("GuidedPath: the BSDF sampling fraction must be in (0, 1]!");
+
+        /* number of training iterations (iteration i lasts 2^i passes) */
+        m_trainingIterations = propList.getInteger("trainingIterations", 6);
+
+        /* samples of a spatial leaf (in the first iteration) before it is split */
+        m_spatialThreshold = propList.getInteger("spatialThreshold", 12000);
+
+        /* share of the energy above which a directional quadrant is subdivided */
+        m_directionalThreshold = propList.getFloat("directionalThreshold", 0.01f);
+    }
+
+    void preprocess(const Scene *scene) override {
+        m_sdTree.init(scene->getBoundingBox());
+        m_iteration = 0;
+        m_iterationEnd = 1;
+        m_passes = false;
+    }
+
+    void beginPasses(const Scene *scene) override {
+        m_passes = true;
+    }
+
+    void finishPass(const Scene *scene, uint32_t passes) override {
+        if (m_iteration >= m_trainingIterations || passes < m_iterationEnd)
+            return;
+
+        /* more samples per iteration allow for a finer subdivision */
+        const float sampleThreshold = (float) m_spatialThreshold * std::sqrt((float) (1u << m_iteration));
+        m_sdTree.refine((uint32_t) sampleThreshold, MaxDirectionalDepth, m_directionalThreshold);
+
+        ++m_iteration;
+        m_iterationEnd = passes + (1u << m_iteration);
+        cout << "GuidedPath: finished training iteration " << m_iteration
+             << " (" << m_sdTree.getLeafCount() << " spatial leaves)" << endl;
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay) const override {
+        return trace(scene, sampler, cameraRay, nullptr);
+    }
+
+    Color3f LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay, AOVRecord &aovs) const override {
+        return trace(scene, sampler, cameraRay, &aovs);
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "GuidedPath[\n"
+            "  maxBounces = %i,\n"
+            "  rrMinBounces = %i,\n"
+            "  bsdfSamplingFraction = %f,\n"
+            "  trainingIterations = %i,\n"
+            "  spatialThreshold = %i,\n"
+            "  directionalThreshold = %f\n"
+            "]",
+            m_maxBounces, m_rrMinBounces, m_bsdfSamplingFraction,
+            m_trainingIterations, m_spatialThreshold, m_directionalThreshold
+        );
+    }
+
+private:
+
+    /// Trace a camera path, recording the AOVs at the first intersection if \c aovs is given
+    Color3f trace(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay, AOVRecord *aovs) const {
+        const bool guide = m_iteration > 0;
+        const bool train = m_passes && m_iteration < m_trainingIterations;
+
+        auto throughput = Color3f(1.0f);
+        std::vector<GuidingRecord> records;
+
+        PathVertex vertex(scene, cameraRay);
+        if (aovs && vertex.hit)
+            aovs->record(vertex.its, sampler, cameraRay);
+        auto radiance = vertex.getEmittedRadiance(scene);
+
+        for (int bounce = 0; bounce < m_maxBounces && vertex.hit; ++bounce) {
+            const Intersection &its = vertex.its;
+            const BSDF *bsdf = vertex.getBSDF();
+            DTreeWrapper *dTree = m_sdTree.lookup(its.p);
+
+            /* emitter, BSDF and guiding sample of this vertex */
+            Point2f vertexSamples[3];
+            sampler->fill2D(vertexSamples, 3);
+            const float strategySample = sampler->next1D();
+
+            /* Emitter sampling */
+            if (!scene->getEmitters().empty()) {
+                EmitterQueryRecord eRec(its.p);
+                const Color3f emitterColor = scene->sampleEmitterDirect(eRec, vertexSamples[0]);
+                if (!emitterColor.isZero() &&
+                    !scene->rayIntersect(Ray3f(its.p, -eRec.ws_wi, Epsilon, eRec.distance * (1.f - Epsilon)))) {
+                    BSDFQueryRecord bRec(vertex.wi, its.toLocal(-eRec.ws_wi), ESolidAngle, its.uv);
+                    bRec.duvdx = its.duvdx;
+                    bRec.duvdy = its.duvdy;
+
+                    const Color3f bsdfColor = bsdf->eval(bRec);
+                    const float weight = eRec.measure == EDiscrete ? 1.f
+                        : misBalance(scene->pdfEmitterDirect(eRec), mixturePdf(bsdf, bRec, dTree, -eRec.ws_wi, guide));
+                    radiance += throughput * weight * emitterColor * bsdfColor * std::abs(Frame::cosTheta(bRec.wo));
+                }
+            }
+
+            /* Sample the extension ray from the mixture */
+            BSDFQueryRecord bRec = vertex.createBSDFRecord();
+            float pdf;
+            const Color3f weight = sampleDirection(bsdf, its, dTree, bRec, vertexSamples[1], vertexSamples[2],
+                                                   strategySample, guide, pdf);
+            if (weight.isZero())
+                break;
+
+            throughput *= weight;
+
+            /* Russian roulette */
+            if (bounce >= m_rrMinBounces) {
+                const float survival = std::min(0.99f, throughput.maxCoeff());
+                if (sampler->next1D() > survival)
+                    break;
+                throughput /= survival;
+            }
+
+            const Ray3f ray = vertex.spawnRay(bRec);
+            if (train && pdf > 0.0f)
+                records.push_back(GuidingRecord{ dTree, ray.d, throughput, radiance, pdf });
+
+            vertex = PathVertex(scene, ray);
+
+            /* Emitter found by the extension ray */
+            const Color3f emitted = vertex.getEmittedRadiance(scene);
+            if (!emitted.isZero()) {
+                const float emitterWeight = pdf == 0.f ? 1.f
+                    : misBalance(pdf, vertex.getEmitterPdf(scene));
+                radiance += throughput * emitterWeight * emitted;
+            }
+        }
+
+        /* The radiance gathered after a vertex is the incident radiance from the sampled direction */
+        for (const GuidingRecord &record : records) {
+            const float throughputLuminance = record.throughput.getLuminance();
+            if (throughputLuminance > 0.0f) {
+                const float incident = Color3f(radiance - record.radiance).getLuminance() / throughputLuminance;
+                record.dTree->record(record.d, std::max(0.0f, incident) / record.pdf);
+            }
+        }
+
+        return radiance;
+    }
+
+    /// Sampled direction of a training path
+    struct GuidingRecord {
+        DTreeWrapper *dTree;
+        Vector3f d;
+        /// Throughput after sampling the direction
+        Color3f throughput;
+        /// Radiance of the path before the direction was sampled
+        Color3f radiance;
+        /// Density of the mixture
+        float pdf;
+    };
+
+    /// Maximum depth of the directional quadtrees
+    static constexpr int MaxDirectionalDepth = 20;
+
+    /// Density of sampling the direction \c d (world space) from the mixture
+    float mixturePdf(const BSDF *bsdf, const BSDFQueryRecord &bRec, const DTreeWrapper *dTree,
+                     const Vector3f &d, bool guide) const {
+        const float bsdfPdf = bsdf->pdf(bRec);
+        if (!guide)
+            return bsdfPdf;
+        return m_bsdfSamplingFraction * bsdfPdf + (1.0f - m_bsdfSamplingFraction) * dTree->pdf(d);
+    }
+
+    /**
+     * \brief Sample a direction from the mixture of the BSDF and the learned
+     * distribution, returns the sample weight and its density (0 for
+     * discrete BSDF samples)
+     */
+    Color3f sampleDirection(const BSDF *bsdf, const Intersection &its, const DTreeWrapper *dTree,
+                            BSDFQueryRecord &bRec, const Point2f &bsdfSample, const Point2f &guideSample,
+                            float strategySample, bool guide, float &pdf) const {
+        Color3f value = bsdf->sample(bRec, bsdfSample);
+
+        /* The BSDFs are either discrete or continuous, discrete ones are not guided */
+        if (bRec.measure == EDiscrete) {
+            pdf = 0.0f;
+            return value;
+        }
+        if (!guide) {
+            pdf = bsdf->pdf(bRec);
+            return value;
+        }
+
+        if (strategySample < m_bsdfSamplingFraction) {
+            if (value.isZero())
+                return Color3f(0.0f);
+            value *= bsdf->pdf(bRec);
+        } else {
+            bRec.wo = its.toLocal(dTree->sample(guideSample));
+            bRec.measure = ESolidAngle;
+            value = bsdf->eval(bRec) * std::abs(Frame::cosTheta(bRec.wo));
+        }
+
+        pdf = mixturePdf(bsdf, bRec, dTree, its.toWorld(bRec.wo), true);
+        if (!(pdf > 0.0f))
+            return Color3f(0.0f);
+        return value / pdf;
+    }
+
+    int m_maxBounces;
+    int m_rrMinBounces;
+    float m_bsdfSamplingFraction;
+    int m_trainingIterations;
+    int m_spatialThreshold;
+    float m_directionalThreshold;
+
+    /// Recorded into by all rendering threads (lock-free), refined between passes
+    mutable SDTree m_sdTree;
+    int m_iteration = 0;
+    uint32_t m_iterationEnd = 1;
+    /// Does the render manager call \ref finishPass()? Otherwise the tree is never used
+    bool m_passes = false;
+};
+
+NORI_REGISTER_CLASS(GuidedPath, "guidedpath");
+NORI_NAMESPACE_END
@@ -0,0 +1,308 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Irradiance caching for diffuse interreflection
+*/
+
+#include <nori/integrator.h>
+#include <nori/sampler.h>
+#include <nori/scene.h>
+#include <nori/emitter.h>
+#include <nori/bsdf.h>
+#include <nori/path.h>
+#include <nori/irradiancecache.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Path tracer that reuses the indirect illumination of diffuse
+ * surfaces with an \ref IrradianceCache
+ *
+ * Camera paths follow specular and glossy reflection (\ref BSDF::isDiffuse()
+ * is \c false) until they reach a diffuse surface. There, the direct
+ * illumination is computed with \c emitterSamples shadow rays, and the
+ * indirect illumination is interpolated from nearby irradiance records.
+ * If there is no valid record, a new one is computed by tracing
+ * \c hemisphereSamples stratified paths and added to the cache, which
+ * is thus filled lazily while rendering.
+ *
+ * The indirect illumination of diffuse surfaces is evaluated as for a
+ * Lambertian surface, i.e. with the BSDF value towards the normal.
+ */
+class IrradianceCaching : public Integrator {
+public:
+    IrradianceCaching(const PropertyList &propList) {
+        m_maxBounces = propList.getInteger("maxBounces", 10);
+        m_rrMinBounces = propList.getInteger("rrMinBounces", m_maxBounces);
+
+        /* maximum interpolation error of a record (smaller is more accurate) */
+        m_accuracy = propList.getFloat("accuracy", 0.2f);
+
+        /* paths traced to compute a record (rounded to M x N strata with N = pi M) */
+        const int hemisphereSamples = propList.getInteger("hemisphereSamples", 256);
+        m_thetaStrata = std::max(1, (int) std::round(std::sqrt((float) hemisphereSamples * INV_PI)));
+        m_phiStrata = std::max(1, (int) std::round((float) m_thetaStrata * M_PI));
+
+        /* shadow rays for the direct illumination of diffuse surfaces */
+        m_emitterSamples = propList.getInteger("emitterSamples", 4);
+
+        /* bounds of the record radius relative to the scene size */
+        m_minRadius = propList.getFloat("minRadius", 0.005f);
+        m_maxRadius = propList.getFloat("maxRadius", 0.1f);
+
+        if (m_accuracy <= 0.0f || m_emitterSamples <= 0 || m_minRadius <= 0.0f || m_maxRadius < m_minRadius)
+            throw NoriException("IrradianceCaching: invalid parameters!");
+    }
+
+    void preprocess(const Scene *scene) override {
+        m_cache.init(scene->getBoundingBox(), m_accuracy);
+        m_sceneSize = scene->getBoundingBox().getExtents().norm();
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay) const override {
+        return trace(scene, sampler, cameraRay, nullptr);
+    }
+
+    Color3f LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay, AOVRecord &aovs) const override {
+        return trace(scene, sampler, cameraRay, &aovs);
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "IrradianceCaching[\n"
+            "  maxBounces = %i,\n"
+            "  rrMinBounces = %i,\n"
+            "  accuracy = %f,\n"
+            "  hemisphereSamples = %i x %i,\n"
+            "  emitterSamples = %i,\n"
+            "  minRadius = %f,\n"
+            "  maxRadius = %f\n"
+            "]",
+            m_maxBounces, m_rrMinBounces, m_accuracy, m_thetaStrata, m_phiStrata,
+            m_emitterSamples, m_minRadius, m_maxRadius
+        );
+    }
+
+private:
+
+    /// Trace a camera path, recording the AOVs at the first intersection if \c aovs is given
+    Color3f trace(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay, AOVRecord *aovs) const {
+        auto throughput = Color3f(1.0f);
+
+        PathVertex vertex(scene, cameraRay);
+        if (aovs && vertex.hit)
+            aovs->record(vertex.its, sampler, cameraRay);
+        auto radiance = vertex.getEmittedRadiance(scene);
+
+        for (int bounce = 0; bounce < m_maxBounces && vertex.hit; ++bounce) {
+            const BSDF *bsdf = vertex.getBSDF();
+            if (bsdf->isDiffuse()) {
+                radiance += throughput * (sampleDirect(scene, sampler, vertex, m_emitterSamples)
+                                          + cachedIndirect(scene, sampler, vertex));
+                break;
+            }
+
+            /* Emitters reached by specular and glossy reflection are not sampled directly */
+            BSDFQueryRecord bRec = vertex.createBSDFRecord();
+            const Color3f bsdfColor = bsdf->sample(bRec, sampler->next2D());
+            if (bsdfColor.isZero())
+                break;
+            throughput *= bsdfColor;
+
+            vertex = PathVertex(scene, vertex.spawnRay(bRec));
+            radiance += throughput * vertex.getEmittedRadiance(scene);
+        }
+
+        return radiance;
+    }
+
+    /// Direct illumination at the vertex estimated with \c count shadow rays
+    Color3f sampleDirect(const Scene *scene, Sampler *sampler, const PathVertex &vertex, int count) const {
+        if (scene->getEmitters().empty())
+            return Color3f(0.0f);
+
+        const Intersection &its = vertex.its;
+        Color3f result(0.0f);
+        for (int i = 0; i < count; ++i) {
+            EmitterQueryRecord eRec(its.p);
+            const Color3f emitterColor = scene->sampleEmitterDirect(eRec, sampler->next2D());
+            if (emitterColor.isZero() ||
+                scene->rayIntersect(Ray3f(its.p, -eRec.ws_wi, Epsilon, eRec.distance * (1.f - Epsilon))))
+                continue;
+
+            BSDFQueryRecord bRec(vertex.wi, its.toLocal(-eRec.ws_wi), ESolidAngle, its.uv);
+            bRec.duvdx = its.duvdx;
+            bRec.duvdy = its.duvdy;
+            result += emitterColor * vertex.getBSDF()->eval(bRec) * std::abs(Frame::cosTheta(bRec.wo));
+        }
+        return result / (float) count;
+    }
+
+    /// Indirect illumination reflected at the (diffuse) vertex
+    Color3f cachedIndirect(const Scene *scene, Sampler *sampler, const PathVertex &vertex) const {
+        const Intersection &its = vertex.its;
+
+        Color3f E;
+        if (!m_cache.lookup(its.p, its.shFrame.n, E)) {
+            const IrradianceRecord record = computeRecord(scene, sampler, its);
+            m_cache.insert(record);
+            E = record.E;
+        }
+
+        BSDFQueryRecord bRec(vertex.wi, Vector3f(0.0f, 0.0f, 1.0f), ESolidAngle, its.uv);
+        bRec.duvdx = its.duvdx;
+        bRec.duvdy = its.duvdy;
+        return vertex.getBSDF()->eval(bRec) * E;
+    }
+
+    /**
+     * \brief Radiance arriving along a ray leaving a diffuse surface,
+     * without the direct illumination (which is sampled separately)
+     *
+     * \param distance
+     *    Set to the distance of the first intersection
+     */
+    Color3f traceIndirect(const Scene *scene, Sampler *sampler, const Ray3f &ray, float &distance) const {
+        PathVertex vertex(scene, ray);
+        distance = vertex.hit ? vertex.its.t : std::numeric_limits<float>::infinity();
+
+        auto throughput = Color3f(1.0f);
+        auto radiance = Color3f(0.0f);
+
+        for (int bounce = 0; bounce < m_maxBounces && vertex.hit; ++bounce) {
+            const BSDF *bsdf = vertex.getBSDF();
+            const bool diffuse = bsdf->isDiffuse();
+            if (diffuse)
+                radiance += throughput * sampleDirect(scene, sampler, vertex, 1);
+
+            BSDFQueryRecord bRec = vertex.createBSDFRecord();
+            const Color3f bsdfColor = bsdf->sample(bRec, sampler->next2D());
+            if (bsdfColor.isZero())
+                break;
+            throughput *= bsdfColor;
+
+            /* Russian roulette */
+            if (bounce >= m_rrMinBounces) {
+                const float survival = std::min(0.99f, throughput.maxCoeff());
+                if (sampler->next1D() > survival)
+                    break;
+                throughput /= survival;
+            }
+
+            vertex = PathVertex(scene, vertex.spawnRay(bRec));
+
+            /* Emitters reached from diffuse surfaces were sampled directly */
+            if (!diffuse)
+                radiance += throughput * vertex.getEmittedRadiance(scene);
+        }
+
+        return radiance;
+    }
+
+    /**
+     * \brief Compute the irradiance and its gradients at a surface point by
+     * stratified sampling of the hemisphere (Ward and Heckbert 1992)
+     *
+     * The strata are uniform in <tt>sin^2(theta)</tt> and \c phi, i.e. they
+     * have the same cosine-weighted solid angle.
+     */
+    IrradianceRecord computeRecord(const Scene *scene, Sampler *sampler, const Intersection &its) const {
+        const int M = m_thetaStrata, N = m_phiStrata;
+        std::vector<Color3f> L((size_t) (M * N));
+        std::vector<float> R((size_t) (M * N));
+
+        IrradianceRecord record;
+        record.p = its.p;
+        record.n = its.shFrame.n;
+        record.E = Color3f(0.0f);
+
+        Vector3f rotGrad[3] = { Vector3f(0.0f), Vector3f(0.0f), Vector3f(0.0f) };
+        float inverseDistanceSum = 0.0f;
+
+        for (int j = 0; j < M; ++j) {
+            for (int k = 0; k < N; ++k) {
+                const Point2f sample = sampler->next2D();
+                const float sinTheta = std::sqrt(((float) j + sample.x()) / (float) M);
+                const float cosTheta = std::sqrt(std::max(0.0f, 1.0f - sinTheta * sinTheta));
+                const float phi = 2.0f * M_PI * ((float) k + sample.y()) / (float) N;
+
+                const Vector3f local(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+                Ray3f ray(its.p, its.shFrame.toWorld(local));
+
+                float &distance = R[(size_t) (j * N + k)];
+                const Color3f &value = L[(size_t) (j * N + k)] = traceIndirect(scene, sampler, ray, distance);
+                record.E += value;
+                inverseDistanceSum += 1.0f / distance;
+
+                /* rotating the normal towards phi + pi/2 */
+                const Vector3f v = its.shFrame.toWorld(Vector3f(-std::sin(phi), std::cos(phi), 0.0f));
+                const float tanTheta = sinTheta / std::max(cosTheta, Epsilon);
+                for (int c = 0; c < 3; ++c)
+                    rotGrad[c] -= v * (tanTheta * value[c]);
+            }
+        }
+
+        const float strataWeight = M_PI / (float) (M * N);
+        record.E *= strataWeight;
+        for (int c = 0; c < 3; ++c)
+            record.rotGrad[c] = rotGrad[c] * strataWeight;
+
+        /* Harmonic mean distance, clamped to the configured range */
+        const float harmonicMean = inverseDistanceSum > 0.0f ? (float) (M * N) / inverseDistanceSum
+                                                             : std::numeric_limits<float>::infinity();
+        record.R = std::clamp(harmonicMean, m_minRadius * m_sceneSize, m_maxRadius * m_sceneSize);
+
+        /* Translational gradient: change of the radiance across the strata boundaries */
+        Vector3f transGrad[3] = { Vector3f(0.0f), Vector3f(0.0f), Vector3f(0.0f) };
+        for (int k = 0; k < N; ++k) {
+            const float phi = 2.0f * M_PI * ((float) k + 0.5f) / (float) N;
+            const float phiBoundary = 2.0f * M_PI * (float) k / (float) N;
+            const Vector3f u = its.shFrame.toWorld(Vector3f(std::cos(phi), std::sin(phi), 0.0f));
+            const Vector3f v = its.shFrame.toWorld(Vector3f(-std::sin(phiBoundary), std::cos(phiBoundary), 0.0f));
+            const int kPrev = (k + N - 1) % N;
+
+            for (int j = 0; j < M; ++j) {
+                const size_t index = (size_t) (j * N + k);
+                const float sinThetaMinus = std::sqrt((float) j / (float) M);
+                const float sinThetaPlus = std::sqrt((float) (j + 1) / (float) M);
+
+                /* boundary towards the previous theta stratum */
+                if (j > 0) {
+                    const size_t prev = (size_t) ((j - 1) * N + k);
+                    const float cos2ThetaMinus = 1.0f - (float) j / (float) M;
+                    const float factor = 2.0f * M_PI / (float) N * sinThetaMinus * cos2ThetaMinus
+                        / std::min(R[index], R[prev]);
+                    for (int c = 0; c < 3; ++c)
+                        transGrad[c] += u * (factor * (L[index][c] - L[prev][c]));
+                }
+
+                /* boundary towards the previous phi stratum */
+                if (N > 1) {
+                    const size_t prev = (size_t) (j * N + kPrev);
+                    const float factor = (sinThetaPlus - sinThetaMinus) / std::min(R[index], R[prev]);
+                    for (int c = 0; c < 3; ++c)
+                        transGrad[c] += v * (factor * (L[index][c] - L[prev][c]));
+                }
+            }
+        }
+        for (int c = 0; c < 3; ++c)
+            record.transGrad[c] = transGrad[c];
+
+        return record;
+    }
+
+    int m_maxBounces;
+    int m_rrMinBounces;
+    float m_accuracy;
+    int m_thetaStrata;
+    int m_phiStrata;
+    int m_emitterSamples;
+    float m_minRadius;
+    float m_maxRadius;
+    float m_sceneSize = 1.0f;
+
+    /// Filled by all rendering threads (lock-free)
+    mutable IrradianceCache m_cache;
+};
+
+NORI_REGISTER_CLASS(IrradianceCaching, "irradiancecache");
+NORI_NAMESPACE_END
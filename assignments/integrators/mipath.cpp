@@ -7,209 +7,359 @@
     Copyright (c) 2012 by Wenzel Jakob and Steve Marschner.
 */
 
-#include <execution>
-#include <numeric>
-#include <ranges>
-#include <algorithm>
-
 #include <nori/integrator.h>
 #include <nori/sampler.h>
 #include <nori/scene.h>
 #include <nori/emitter.h>
 #include <nori/bsdf.h>
+#include <nori/camera.h>
+#include <nori/path.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <mutex>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief Coarse estimate of the radiance reflected at the surfaces of the
+ * scene, averaged over the cells of a regular grid
+ */
+class RadianceGrid {
+public:
+    /// Cover the bounding box with cubic cells, \c resolution along its longest axis
+    void init(const BoundingBox3f &bbox, int resolution) {
+        m_bbox = bbox;
+        const Vector3f extents = bbox.getExtents();
+        m_cellSize = std::max(extents.maxCoeff(), Epsilon) / (float) resolution;
+        for (int i = 0; i < 3; ++i)
+            m_res[i] = std::max(1, (int) std::ceil(extents[i] / m_cellSize));
+        m_sum.assign((size_t) m_res.prod(), 0.0f);
+        m_count.assign((size_t) m_res.prod(), 0);
+    }
+
+    /// Index of the cell containing \c p
+    size_t cellIndex(const Point3f &p) const {
+        Vector3i cell;
+        for (int i = 0; i < 3; ++i)
+            cell[i] = std::clamp((int) ((p[i] - m_bbox.min[i]) / m_cellSize), 0, m_res[i] - 1);
+        return (size_t) ((cell.z() * m_res.y() + cell.y()) * m_res.x() + cell.x());
+    }
+
+    /// Add a sample of the reflected radiance at \c p
+    void add(const Point3f &p, float value) {
+        const size_t index = cellIndex(p);
+        m_sum[index] += value;
+        ++m_count[index];
+    }
+
+    /// Merge the samples of another grid with the same layout
+    void add(const RadianceGrid &other) {
+        for (size_t i = 0; i < m_sum.size(); ++i) {
+            m_sum[i] += other.m_sum[i];
+            m_count[i] += other.m_count[i];
+        }
+    }
+
+    /// Turn the sums into averages, empty cells get the average of all samples
+    void finalize() {
+        double total = 0.0;
+        uint64_t count = 0;
+        for (size_t i = 0; i < m_sum.size(); ++i) {
+            total += m_sum[i];
+            count += m_count[i];
+        }
+        const float mean = count > 0 ? (float) (total / (double) count) : 0.0f;
+        for (size_t i = 0; i < m_sum.size(); ++i)
+            m_sum[i] = m_count[i] > 0 ? m_sum[i] / (float) m_count[i] : mean;
+        m_count.clear();
+    }
+
+    /// Return the estimate at \c p (only after \ref finalize())
+    float lookup(const Point3f &p) const { return m_sum[cellIndex(p)]; }
+
+private:
+    BoundingBox3f m_bbox;
+    float m_cellSize = 1.0f;
+    Vector3i m_res = Vector3i::Ones();
+    std::vector<float> m_sum;
+    std::vector<uint32_t> m_count;
+};
+
 /**
  * \brief MIPath
+ *
+ * Path tracer combining emitter sampling and BSDF sampling at every vertex
+ * with multiple importance sampling (balance heuristic).
+ *
+ * Each bounce traces one shadow ray towards a sampled emitter and one
+ * extension ray in a sampled BSDF direction. The extension ray serves as
+ * the BSDF strategy for direct illumination (an emitter it hits is added
+ * with the MIS weight) and at the same time becomes the next vertex of
+ * the path. After \c rrMinBounces bounces, paths are terminated by
+ * Russian roulette based on their throughput.
+ *
+ * With <tt>rrMode = "adrrs"</tt>, Russian roulette and splitting are
+ * driven by the expected contribution of the path instead (adjoint-driven
+ * Russian roulette and splitting, Vorba and Krivanek 2016). A coarse
+ * training pass estimates the radiance reflected at the surfaces of the
+ * scene in a \ref RadianceGrid. At every vertex, the throughput times
+ * this estimate is compared with the estimated pixel value: paths that
+ * contribute much less are terminated, paths that contribute much more
+ * are split into several paths continuing from the vertex.
  */
 class MIPath : public Integrator {
 public:
     MIPath(const PropertyList &propList){
         m_maxBounces = propList.getInteger("maxBounces", 10);
         m_rrMinBounces = propList.getInteger("rrMinBounces", m_maxBounces);
+
+        /* "throughput" or "adrrs" (adjoint-driven Russian roulette and splitting) */
+        const std::string rrMode = propList.getString("rrMode", "throughput");
+        if (rrMode == "throughput")
+            m_adrrs = false;
+        else if (rrMode == "adrrs")
+            m_adrrs = true;
+        else
+            throw NoriException("MIPath: unknown Russian roulette mode \"%s\"!", rrMode);
+
+        /* training paths per pixel of the training pass (traced at a quarter of the resolution) */
+        m_trainingSamples = propList.getInteger("adrrsTrainingSamples", 4);
+        /* cells of the radiance grid along the longest axis of the scene */
+        m_gridResolution = propList.getInteger("adrrsGridResolution", 32);
+        /* maximum number of paths a path is split into at one vertex */
+        m_maxSplit = propList.getInteger("adrrsMaxSplit", 8);
+        if (m_trainingSamples <= 0 || m_gridResolution <= 0 || m_maxSplit <= 0)
+            throw NoriException("MIPath: the ADRRS parameters must be positive!");
+    }
+
+    void preprocess(const Scene *scene) override {
+        if (!m_adrrs)
+            return;
+
+        m_cacheReady = false;
+        m_cache.init(scene->getBoundingBox(), m_gridResolution);
+
+        const Camera *camera = scene->getCamera();
+        const Vector2i size = (camera->getOutputSize() + Vector2i::Constant(TrainingStride - 1)) / TrainingStride;
+        const uint32_t firstSample = (uint32_t) scene->getSampler()->getSampleCount();
+        std::mutex cacheMutex;
+
+        /* Trace the training paths and record the radiance reflected at each of their vertices */
+        tbb::parallel_for(tbb::blocked_range<int>(0, size.y()), [&](const tbb::blocked_range<int> &range) {
+            std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+            RadianceGrid grid;
+            grid.init(scene->getBoundingBox(), m_gridResolution);
+            std::vector<TrainingVertex> vertices;
+
+            for (int y = range.begin(); y < range.end(); ++y) {
+                for (int x = 0; x < size.x(); ++x) {
+                    const Point2i pixel(x * TrainingStride, y * TrainingStride);
+                    for (int i = 0; i < m_trainingSamples; ++i) {
+                        /* use samples beyond those of the actual rendering */
+                        sampler->startPixelSample(pixel, firstSample + (uint32_t) i);
+
+                        Point2f cameraSamples[2];
+                        sampler->fill2D(cameraSamples, 2);
+                        Ray3f ray;
+                        const Point2f pixelSample = Point2f((float) pixel.x(), (float) pixel.y())
+                            + cameraSamples[0] * (float) TrainingStride;
+                        camera->sampleRay(ray, pixelSample, cameraSamples[1]);
+
+                        vertices.clear();
+                        PathState state(ray);
+                        while (step(scene, sampler.get(), state, nullptr, &vertices)) { }
+
+                        for (const TrainingVertex &vertex : vertices) {
+                            const float throughput = vertex.throughput.getLuminance();
+                            if (throughput > 0.0f)
+                                grid.add(vertex.p, std::max(0.0f,
+                                    Color3f(state.radiance - vertex.radiance).getLuminance() / throughput));
+                        }
+                    }
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            m_cache.add(grid);
+        });
+
+        m_cache.finalize();
+        m_cacheReady = true;
     }
 
+    bool preprocessUsesCamera() const override { return m_adrrs; }
+
     /* Li is called N times, where N stands for the amount of samples
      * which are set in the XML file (check the sampleCount parameter)
      *
      * (have a look at assignments/integrators/depth.cpp for an example)
      */
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay) const override {
-        auto throughput = Color3f(1.0f);
-        auto radiance = Color3f(0);
-        Ray3f currentRay = cameraRay;
-
-        for (int bounce = 0; bounce < m_maxBounces; ++bounce) {
-            Intersection its;
-            if (scene->rayIntersect(currentRay, its)) {
-                const Emitter *emitter = its.mesh->getEmitter();
-                Vector3f wi = its.toLocal(-currentRay.d).normalized();
-
-                BSDFQueryRecord bsdfRec(wi, its.uv);
-
-                const auto [directIllumination, sample] = direct_illumination(currentRay, scene, sampler);
-
-                auto bsdfColor = its.mesh->getBSDF()->sample(bsdfRec, sample);
-
-                float probabilityToDie = std::max(0.01f, Vector3f(bsdfColor.x(), bsdfColor.y(), bsdfColor.z()).norm());
-                if (bounce < m_rrMinBounces)
-                    probabilityToDie = .9f;
-
-                if (emitter && bounce == 0) {
-                    radiance += throughput * emitter->eval(wi);
-                }
-
-                radiance += throughput * directIllumination;
-
-                if (bounce >= m_rrMinBounces)
-                    if (sampler->next1D() > probabilityToDie)
-                        break;
+        return tracePath(scene, sampler, cameraRay, nullptr);
+    }
 
-                throughput *= bsdfColor / probabilityToDie;
-                currentRay = Ray3f(its.p, its.toWorld(bsdfRec.wo));
-            } else {
-                break;
-            }
-        }
+    Color3f LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay, AOVRecord &aovs) const override {
+        return tracePath(scene, sampler, cameraRay, &aovs);
+    }
 
-        return radiance;
+    bool stepPath(const Scene *scene, Sampler *sampler, PathState &state, AOVRecord *aovs) const override {
+        return step(scene, sampler, state, aovs, nullptr);
     }
 
     std::string toString() const override {
         std::ostringstream oss;
         oss << "MIPath[" << endl
+            << "  maxBounces = " << m_maxBounces << "," << endl
+            << "  rrMinBounces = " << m_rrMinBounces << "," << endl
+            << "  rrMode = " << (m_adrrs ? "adrrs" : "throughput") << endl
             << "]";
         return oss.str();
     }
 
 private:
 
-    std::tuple<Color3f, Point2f> direct_illumination(Ray3f& ray, const Scene* scene, Sampler* sampler) const
-    {
-        Point2f sample;
-
-        Intersection hitInfo;
-        if (!scene->rayIntersect(ray, hitInfo))
-            return { 0.f, sample };
-
-        const auto bsdf = hitInfo.mesh->getBSDF();
-        const auto wi = hitInfo.toLocal(-ray.d).normalized();
-
-        auto startColor = Color3f(0.f);
-        if (hitInfo.mesh->isEmitter())
-        {
-            startColor = hitInfo.mesh->getEmitter()->eval(wi);
+    /// Vertex of a training path, see \ref preprocess()
+    struct TrainingVertex {
+        Point3f p;
+        /// Throughput towards the vertex
+        Color3f throughput;
+        /// Radiance of the path up to (and including) the emission of the vertex
+        Color3f radiance;
+    };
+
+    /// Pixel spacing of the training paths
+    static constexpr int TrainingStride = 4;
+
+    /// Ratio of the upper and lower bound of the ADRRS weight window
+    static constexpr float WindowWidth = 5.0f;
+
+    /// Lower bound of the ADRRS survival probability
+    static constexpr float MinSurvival = 0.05f;
+
+    /* One step creates the vertex hit by state.ray, adds its MIS-weighted
+       emission and samples the extension ray (after the shadow ray).
+       Training passes record the vertices of the path */
+    bool step(const Scene *scene, Sampler *sampler, PathState &state, AOVRecord *aovs,
+              std::vector<TrainingVertex> *training) const {
+        const PathVertex vertex(scene, state.ray);
+        if (aovs && state.bounce == 0 && vertex.hit)
+            aovs->record(vertex.its, sampler, state.ray);
+
+        /* Emitter found by the ray (area light or environment). Emitters
+           seen directly or by a discrete BSDF sample are not weighted */
+        const Color3f emitted = vertex.getEmittedRadiance(scene);
+        if (!emitted.isZero()) {
+            const float weight = state.pdf == 0.f ? 1.f
+                : misBalance(state.pdf, vertex.getEmitterPdf(scene));
+            state.radiance += state.throughput * weight * emitted;
         }
 
-        auto accColor = Color3f(0.f);
-        constexpr auto sampleCount = 1;
-        for (size_t i = 0; i < sampleCount; ++i)
-        {
-            auto misColor = Color3f(0.f);
-
-            // shoot ray against emitter
-            if (true)
-            {
-                EmitterQueryRecord emitterSampleInfo{ hitInfo.p };
-                const auto emitterColor = scene->sampleEmitterDirect(emitterSampleInfo, sampler->next2D());
-                if (emitterColor.isZero())
-                    goto end_emitter_eval;
-
-                const auto emitterPdf = scene->pdfEmitterDirect(emitterSampleInfo);
-
-                const auto isShadowed = scene->rayIntersect({ hitInfo.p, -emitterSampleInfo.ws_wi, Epsilon, emitterSampleInfo.distance * (1.f - Epsilon) });
-
-                if (isShadowed || emitterPdf <= 0.f)
-                    goto end_emitter_eval;
-
-                const auto wo = hitInfo.toLocal(-emitterSampleInfo.ws_wi);
-                BSDFQueryRecord bsdfQueryRecord(
-                    wi,
-                    wo,
-                    ESolidAngle
-                ); // UV is not needed here
-
-                auto bsdfPdf= bsdf->pdf(bsdfQueryRecord);
-                auto bsdfColor = bsdf->eval(bsdfQueryRecord);
-
-                float misWeight;
-                if (emitterSampleInfo.measure == EDiscrete)
-                    misWeight = 1.f;
-                else
-                    misWeight = weighting_heuristic(emitterPdf, { bsdfPdf, emitterPdf });
-                misColor += misWeight * emitterColor * bsdfColor * std::abs(Frame::cosTheta(wo));
+        if (!vertex.hit || state.bounce >= m_maxBounces)
+            return false;
+
+        if (training)
+            training->push_back(TrainingVertex{ vertex.its.p, state.throughput, state.radiance });
+
+        const bool adrrs = m_adrrs && m_cacheReady;
+        if (adrrs && state.bounce == 0)
+            state.pixelEstimate = emitted.getLuminance() + m_cache.lookup(vertex.its.p);
+
+        const Intersection &its = vertex.its;
+        const BSDF *bsdf = vertex.getBSDF();
+
+        /* fetch the emitter and BSDF sample of this vertex at once */
+        Point2f vertexSamples[2];
+        sampler->fill2D(vertexSamples, 2);
+
+        /* Emitter sampling (one shadow ray) */
+        if (!scene->getEmitters().empty()) {
+            EmitterQueryRecord eRec(its.p);
+            const Color3f emitterColor = scene->sampleEmitterDirect(eRec, vertexSamples[0]);
+            if (!emitterColor.isZero() &&
+                !scene->rayIntersect(Ray3f(its.p, -eRec.ws_wi, Epsilon, eRec.distance * (1.f - Epsilon)))) {
+                BSDFQueryRecord bRec(vertex.wi, its.toLocal(-eRec.ws_wi), ESolidAngle, its.uv);
+                bRec.duvdx = its.duvdx;
+                bRec.duvdy = its.duvdy;
+
+                const Color3f bsdfColor = bsdf->eval(bRec);
+                const float weight = eRec.measure == EDiscrete ? 1.f
+                    : misBalance(scene->pdfEmitterDirect(eRec), bsdf->pdf(bRec));
+                state.radiance += state.throughput * weight * emitterColor * bsdfColor * std::abs(Frame::cosTheta(bRec.wo));
             }
-            end_emitter_eval:
-
-            // shoot ray with BSDF
-            if (true)
-            {
-                BSDFQueryRecord bsdfQueryRecord(wi, hitInfo.uv);
-                sample = sampler->next2D();
-                const auto bsdfColor = bsdf->sample(bsdfQueryRecord, sample);
-                if (bsdfColor.isZero())
-                    goto end_bsdf_eval;
-
-                const auto bsdfPdf = bsdf->pdf(bsdfQueryRecord);
-
-                Intersection emitterHitInfo;
-                const auto intersected = scene->rayIntersect({ hitInfo.p, hitInfo.toWorld(bsdfQueryRecord.wo) }, emitterHitInfo);
-
-                if (bsdfPdf <= 0.f || !intersected || !emitterHitInfo.mesh-> isEmitter())
-                    goto end_bsdf_eval;
-
-                EmitterQueryRecord emitterQueryRecord(
-                    hitInfo.p,
-                    emitterHitInfo.p,
-                    emitterHitInfo.t,
-                    hitInfo.toWorld(wi),
-                    wi,
-                    bsdfQueryRecord.measure,
-                    emitterHitInfo.mesh->getEmitter()->idx
-                );
-                auto emitterColor = emitterHitInfo.mesh->getEmitter()->eval(wi);
-                auto emitterPdf = scene->pdfEmitterDirect(emitterQueryRecord);
-
-                auto cosTheta = std::abs(Frame::cosTheta(wi));
-
-                auto misWeight = weighting_heuristic(bsdfPdf, { bsdfPdf, emitterPdf });
-                misColor += misWeight * emitterColor * bsdfColor;
+        }
+
+        /* Adjoint-driven Russian roulette and splitting: keep the expected
+           contribution (throughput times the cached reflected radiance)
+           within a window around the pixel estimate */
+        int copies = 1;
+        bool rouletteDone = false;
+        if (adrrs) {
+            const float adjoint = m_cache.lookup(its.p);
+            if (adjoint > 0.0f && state.pixelEstimate > 0.0f) {
+                const float lower = 2.0f * state.pixelEstimate / (adjoint * (1.0f + WindowWidth));
+                const float upper = WindowWidth * lower;
+                const float weight = state.throughput.getLuminance();
+                if (weight < lower) {
+                    const float survival = std::max(weight / lower, MinSurvival);
+                    if (sampler->next1D() > survival)
+                        return false;
+                    state.throughput /= survival;
+                } else if (weight > upper) {
+                    copies = std::min((int) std::ceil(weight / upper), m_maxSplit);
+                    state.throughput /= (float) copies;
+                }
+                rouletteDone = true;
             }
-            end_bsdf_eval:
+        }
 
-            accColor += misColor;
+        /* Trace the additional paths of a split to completion */
+        for (int copy = 1; copy < copies; ++copy) {
+            BSDFQueryRecord splitRec = vertex.createBSDFRecord();
+            const Color3f splitColor = bsdf->sample(splitRec, sampler->next2D());
+            if (splitColor.isZero())
+                continue;
+
+            PathState split(vertex.spawnRay(splitRec));
+            split.throughput = state.throughput * splitColor;
+            split.pdf = splitRec.measure == EDiscrete ? 0.f : bsdf->pdf(splitRec);
+            split.bounce = state.bounce + 1;
+            split.pixelEstimate = state.pixelEstimate;
+            while (step(scene, sampler, split, nullptr, nullptr)) { }
+            state.radiance += split.radiance;
         }
 
-        return { accColor, sample };
-    }
+        /* BSDF sampling (the extension ray) */
+        BSDFQueryRecord bRec = vertex.createBSDFRecord();
+        const Color3f bsdfColor = bsdf->sample(bRec, vertexSamples[1]);
+        if (bsdfColor.isZero())
+            return false;
 
-    using pdfvec = const std::vector<float>&;
+        state.throughput *= bsdfColor;
 
-    static float weighting_heuristic(float pdf, pdfvec pdfs)
-    {
-        return balance_wh(pdf, pdfs);
-    }
+        /* Russian roulette */
+        if (!rouletteDone && state.bounce >= m_rrMinBounces) {
+            const float survival = std::min(0.99f, state.throughput.maxCoeff());
+            if (sampler->next1D() > survival)
+                return false;
+            state.throughput /= survival;
+        }
 
-    static float uniform_wh(float pdf, pdfvec pdfs)
-    {
-        const auto sum = std::transform_reduce(pdfs.cbegin(), pdfs.cend(), 0.f, std::plus<>(), [](float v){ return v > 0 ? 1.f : 0.f; });
-        if (!isnormal(sum))
-            return 0.f;
-        return (pdf > 0 ? 1.f : 0.f) / sum;
-    }
-    static float balance_wh(float pdf, pdfvec pdfs)
-    {
-        return pdf / std::reduce(pdfs.cbegin(), pdfs.cend(), 0.f, std::plus<>());
-    }
-    static float power_wh(float pdf, pdfvec pdfs)
-    {
-        return pdf*pdf / std::transform_reduce(pdfs.cbegin(), pdfs.cend(), 0.f, std::plus<>(), [](float v){ return v*v; });
+        state.pdf = bRec.measure == EDiscrete ? 0.f : bsdf->pdf(bRec);
+        state.ray = vertex.spawnRay(bRec);
+        ++state.bounce;
+        return true;
     }
 
     int m_maxBounces;
     int m_rrMinBounces;
 
+    bool m_adrrs;
+    int m_trainingSamples;
+    int m_gridResolution;
+    int m_maxSplit;
+    RadianceGrid m_cache;
+    bool m_cacheReady = false;
+
 };
 
 NORI_REGISTER_CLASS(MIPath, "mipath");
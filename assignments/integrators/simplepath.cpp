@@ -21,6 +21,7 @@ class SimplePathIntegrator : public Integrator {
 public:
     SimplePathIntegrator(const PropertyList &propList){
         m_maxBounces = propList.getInteger("maxBounces", 10);
+        m_rrMinBounces = propList.getInteger("rrMinBounces", m_maxBounces);
     }
 
     struct RayBounce
@@ -31,33 +32,48 @@ public:
 
     Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay) const override {
         // TODO: Exercise 3.3: Implement the simple path tracer
-        auto throughput = Color3f(1.0f);
-        auto radiance = Color3f(0);
-        Ray3f currentRay = cameraRay;
-
-        for (int bounce = 0; bounce < m_maxBounces; ++bounce) {
-            Intersection its;
-            if (scene->rayIntersect(currentRay, its)) {
-                const Emitter *emitter = its.mesh->getEmitter();
-                Vector3f wi = its.toLocal(-currentRay.d).normalized();
-                Vector3f wo = Warp::squareToUniformHemisphere(sampler->next2D());
-                float pdf = Warp::squareToUniformHemispherePdf(wo);
-
-                if (emitter) {
-                    radiance += throughput * emitter->eval(wi);
-                }
-
-                BSDFQueryRecord bsdfRec(wi, wo, ESolidAngle, its.uv);
-                Color3f bsdfColor = its.mesh->getBSDF()->eval(bsdfRec);
-                float cosTheta = Frame::cosTheta(wo);
-                throughput *= (bsdfColor * cosTheta) / pdf;
-                currentRay = Ray3f(its.p, its.toWorld(wo));
-            } else {
-                break;
-            }
+        return tracePath(scene, sampler, cameraRay, nullptr);
+    }
+
+    Color3f LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay, AOVRecord &aovs) const override {
+        return tracePath(scene, sampler, cameraRay, &aovs);
+    }
+
+    bool stepPath(const Scene *scene, Sampler *sampler, PathState &state, AOVRecord *aovs) const override {
+        Intersection its;
+        if (!scene->rayIntersect(state.ray, its))
+            return false;
+        if (aovs && state.bounce == 0)
+            aovs->record(its, sampler, state.ray);
+
+        const Emitter *emitter = its.mesh->getEmitter();
+        Vector3f wi = its.toLocal(-state.ray.d).normalized();
+        if (emitter) {
+            state.radiance += state.throughput * emitter->eval(wi);
+        }
+
+        if (state.bounce + 1 >= m_maxBounces)
+            return false;
+
+        Vector3f wo = Warp::squareToUniformHemisphere(sampler->next2D());
+        float pdf = Warp::squareToUniformHemispherePdf(wo);
+
+        BSDFQueryRecord bsdfRec(wi, wo, ESolidAngle, its.uv);
+        Color3f bsdfColor = its.mesh->getBSDF()->eval(bsdfRec);
+        float cosTheta = Frame::cosTheta(wo);
+        state.throughput *= (bsdfColor * cosTheta) / pdf;
+
+        /* Russian roulette */
+        if (state.bounce >= m_rrMinBounces) {
+            const float survival = std::min(0.99f, state.throughput.maxCoeff());
+            if (sampler->next1D() > survival)
+                return false;
+            state.throughput /= survival;
         }
 
-        return radiance;
+        state.ray = Ray3f(its.p, its.toWorld(wo));
+        ++state.bounce;
+        return true;
     }
 
     /* "verry verry complex"
@@ -120,12 +136,14 @@ public:
     std::string toString() const override {
         std::ostringstream oss;
             oss << "SimplePathIntegrator[" << endl
-                << " maxBounces = " << m_maxBounces << endl
+                << " maxBounces = " << m_maxBounces << "," << endl
+                << " rrMinBounces = " << m_rrMinBounces << endl
                 << "]";
         return oss.str();
     }
 private:
     int m_maxBounces;
+    int m_rrMinBounces;
 
     // returns the emittance of a mesh and 0 if it is no emitter
     Color3f emittance(const Mesh* mesh, const Vector3f& localDir) const
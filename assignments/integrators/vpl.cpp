@@ -0,0 +1,382 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Instant radiosity with lightcuts
+*/
+
+#include <nori/integrator.h>
+#include <nori/sampler.h>
+#include <nori/scene.h>
+#include <nori/emitter.h>
+#include <nori/bsdf.h>
+#include <nori/path.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <pcg32.h>
+#include <queue>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Instant radiosity integrator (Keller 1997) with lightcuts
+ * (Walter et al. 2005)
+ *
+ * The preprocess step traces \c lightPaths paths from the emitters and
+ * places a virtual point light (VPL) at every diffuse surface they hit, up
+ * to \c maxDepth bounces. The VPLs are organized in a binary light tree,
+ * every cluster stores its total intensity and one representative VPL.
+ *
+ * Camera paths follow specular and glossy reflection until they reach a
+ * diffuse surface. There, the direct illumination is sampled with
+ * \c emitterSamples shadow rays, and the indirect illumination is gathered
+ * from the VPLs: starting at the root of the light tree, the cluster with
+ * the largest error bound is replaced by its children until all bounds
+ * are below \c maxError times the estimate (or the cut contains
+ * \c maxCutSize clusters). Each cluster of the cut costs a single shadow
+ * ray towards its representative, so the cost grows sublinearly with the
+ * number of VPLs.
+ *
+ * The geometry term is clamped at a distance of \c clamping times the
+ * scene size to avoid bright spots next to VPLs.
+ */
+class VPLIntegrator : public Integrator {
+public:
+    VPLIntegrator(const PropertyList &propList) {
+        /* number of paths traced from the emitters */
+        m_lightPaths = propList.getInteger("lightPaths", 1024);
+        /* maximum number of bounces of the light paths */
+        m_maxDepth = propList.getInteger("maxDepth", 3);
+        /* bounces of camera paths through specular and glossy surfaces */
+        m_maxBounces = propList.getInteger("maxBounces", 10);
+        /* shadow rays for the direct illumination */
+        m_emitterSamples = propList.getInteger("emitterSamples", 1);
+        /* relative error of the lightcut */
+        m_maxError = propList.getFloat("maxError", 0.02f);
+        /* maximum number of clusters in a lightcut */
+        m_maxCutSize = propList.getInteger("maxCutSize", 1000);
+        /* minimum distance of the geometry term relative to the scene size */
+        m_clamping = propList.getFloat("clamping", 0.01f);
+
+        if (m_lightPaths <= 0 || m_emitterSamples <= 0 || m_maxCutSize <= 0)
+            throw NoriException("VPLIntegrator: invalid parameters!");
+    }
+
+    void preprocess(const Scene *scene) override {
+        m_vpls.clear();
+        m_nodes.clear();
+        const float clampDistance = m_clamping * scene->getBoundingBox().getExtents().norm();
+        m_minDistance2 = clampDistance * clampDistance;
+
+        if (scene->getEmitters().empty())
+            return;
+
+        /* Trace the light paths in parallel, the VPLs of each path are kept in path order */
+        std::vector<std::vector<VPL>> pathVPLs((size_t) m_lightPaths);
+        tbb::parallel_for(tbb::blocked_range<int>(0, m_lightPaths), [&](const tbb::blocked_range<int> &range) {
+            std::unique_ptr<Sampler> sampler(
+                static_cast<Sampler *>(NoriObjectFactory::createInstance("independent", PropertyList())));
+            for (int i = range.begin(); i < range.end(); ++i) {
+                sampler->startPixelSample(Point2i(i, 0), 0);
+                traceLightPath(scene, sampler.get(), pathVPLs[(size_t) i]);
+            }
+        });
+
+        for (auto &vpls : pathVPLs)
+            m_vpls.insert(m_vpls.end(), vpls.begin(), vpls.end());
+
+        if (!m_vpls.empty()) {
+            std::vector<uint32_t> indices(m_vpls.size());
+            for (uint32_t i = 0; i < (uint32_t) indices.size(); ++i)
+                indices[i] = i;
+            m_nodes.reserve(2 * m_vpls.size() - 1);
+            pcg32 random;
+            buildTree(indices, 0, (uint32_t) indices.size(), random);
+        }
+
+        cout << "VPLIntegrator: " << m_vpls.size() << " VPLs from " << m_lightPaths << " light paths" << endl;
+    }
+
+    Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay) const override {
+        return trace(scene, sampler, cameraRay, nullptr);
+    }
+
+    Color3f LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay, AOVRecord &aovs) const override {
+        return trace(scene, sampler, cameraRay, &aovs);
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "VPLIntegrator[\n"
+            "  lightPaths = %i,\n"
+            "  maxDepth = %i,\n"
+            "  maxBounces = %i,\n"
+            "  emitterSamples = %i,\n"
+            "  maxError = %f,\n"
+            "  maxCutSize = %i,\n"
+            "  clamping = %f\n"
+            "]",
+            m_lightPaths, m_maxDepth, m_maxBounces, m_emitterSamples,
+            m_maxError, m_maxCutSize, m_clamping
+        );
+    }
+
+private:
+
+    /// Trace a camera path, recording the AOVs at the first intersection if \c aovs is given
+    Color3f trace(const Scene *scene, Sampler *sampler, const Ray3f &cameraRay, AOVRecord *aovs) const {
+        auto throughput = Color3f(1.0f);
+
+        PathVertex vertex(scene, cameraRay);
+        if (aovs && vertex.hit)
+            aovs->record(vertex.its, sampler, cameraRay);
+        auto radiance = vertex.getEmittedRadiance(scene);
+
+        for (int bounce = 0; bounce < m_maxBounces && vertex.hit; ++bounce) {
+            const BSDF *bsdf = vertex.getBSDF();
+            if (bsdf->isDiffuse()) {
+                radiance += throughput * (sampleDirect(scene, sampler, vertex) + gatherVPLs(scene, vertex));
+                break;
+            }
+
+            /* Emitters reached by specular and glossy reflection are not sampled directly */
+            BSDFQueryRecord bRec = vertex.createBSDFRecord();
+            const Color3f bsdfColor = bsdf->sample(bRec, sampler->next2D());
+            if (bsdfColor.isZero())
+                break;
+            throughput *= bsdfColor;
+
+            vertex = PathVertex(scene, vertex.spawnRay(bRec));
+            radiance += throughput * vertex.getEmittedRadiance(scene);
+        }
+
+        return radiance;
+    }
+
+    /// Virtual point light at a diffuse surface
+    struct VPL {
+        Intersection its;
+        /// Direction towards the previous vertex of the light path (local)
+        Vector3f wi;
+        /// Power arriving at the surface
+        Color3f flux;
+        /// Flux times the BSDF value towards the normal (bound of the emitted intensity)
+        Color3f intensity;
+    };
+
+    /// Cluster of the light tree
+    struct LightNode {
+        BoundingBox3f bbox;
+        /// Total intensity of the VPLs
+        Color3f intensity;
+        /// Representative VPL
+        uint32_t rep;
+        /// Child clusters, 0 for single VPLs
+        uint32_t child[2];
+    };
+
+    /// Cluster of a lightcut
+    struct CutEntry {
+        uint32_t node;
+        /// Contribution of the representative (unscaled)
+        Color3f repContribution;
+        /// Contribution of the cluster
+        Color3f estimate;
+        /// Upper bound of the error of \ref estimate
+        float bound;
+
+        bool operator<(const CutEntry &other) const { return bound < other.bound; }
+    };
+
+    void traceLightPath(const Scene *scene, Sampler *sampler, std::vector<VPL> &vpls) const {
+        Ray3f ray;
+        Color3f power = scene->sampleEmitterPhoton(ray, sampler) / (float) m_lightPaths;
+
+        for (int depth = 0; depth < m_maxDepth && !power.isZero(); ++depth) {
+            Intersection its;
+            if (!scene->rayIntersect(ray, its))
+                break;
+
+            const BSDF *bsdf = its.mesh->getBSDF();
+            const Vector3f wi = its.toLocal(-ray.d).normalized();
+            if (bsdf->isDiffuse()) {
+                const Color3f f = bsdf->eval(BSDFQueryRecord(wi, Vector3f(0.0f, 0.0f, 1.0f), ESolidAngle, its.uv));
+                vpls.push_back(VPL{ its, wi, power, power * f });
+            }
+
+            BSDFQueryRecord bRec(wi, its.uv);
+            const Color3f bsdfColor = bsdf->sample(bRec, sampler->next2D());
+            if (bsdfColor.isZero())
+                break;
+            power *= bsdfColor;
+            ray = Ray3f(its.p, its.toWorld(bRec.wo));
+        }
+    }
+
+    /// Build the cluster of the VPLs <tt>indices[start, end)</tt>, returns its index
+    uint32_t buildTree(std::vector<uint32_t> &indices, uint32_t start, uint32_t end, pcg32 &random) {
+        const uint32_t index = (uint32_t) m_nodes.size();
+        m_nodes.emplace_back();
+
+        if (end - start == 1) {
+            const VPL &vpl = m_vpls[indices[start]];
+            LightNode &node = m_nodes[index];
+            node.bbox = BoundingBox3f(vpl.its.p);
+            node.intensity = vpl.intensity;
+            node.rep = indices[start];
+            node.child[0] = node.child[1] = 0;
+            return index;
+        }
+
+        /* Split at the median along the largest axis */
+        BoundingBox3f bbox;
+        for (uint32_t i = start; i < end; ++i)
+            bbox.expandBy(m_vpls[indices[i]].its.p);
+        const int axis = bbox.getLargestAxis();
+        const uint32_t mid = start + (end - start) / 2;
+        std::nth_element(indices.begin() + start, indices.begin() + mid, indices.begin() + end,
+            [&](uint32_t a, uint32_t b) { return m_vpls[a].its.p[axis] < m_vpls[b].its.p[axis]; });
+
+        const uint32_t left = buildTree(indices, start, mid, random);
+        const uint32_t right = buildTree(indices, mid, end, random);
+
+        /* The representative is chosen proportional to the intensity of the children */
+        const float leftWeight = m_nodes[left].intensity.getLuminance();
+        const float totalWeight = leftWeight + m_nodes[right].intensity.getLuminance();
+        const bool chooseLeft = totalWeight > 0.0f ? random.nextFloat() * totalWeight < leftWeight
+                                                   : random.nextFloat() < 0.5f;
+
+        LightNode &node = m_nodes[index];
+        node.bbox = bbox;
+        node.intensity = m_nodes[left].intensity + m_nodes[right].intensity;
+        node.rep = m_nodes[chooseLeft ? left : right].rep;
+        node.child[0] = left;
+        node.child[1] = right;
+        return index;
+    }
+
+    /// Direct illumination at the vertex estimated with \c emitterSamples shadow rays
+    Color3f sampleDirect(const Scene *scene, Sampler *sampler, const PathVertex &vertex) const {
+        if (scene->getEmitters().empty())
+            return Color3f(0.0f);
+
+        const Intersection &its = vertex.its;
+        Color3f result(0.0f);
+        for (int i = 0; i < m_emitterSamples; ++i) {
+            EmitterQueryRecord eRec(its.p);
+            const Color3f emitterColor = scene->sampleEmitterDirect(eRec, sampler->next2D());
+            if (emitterColor.isZero() ||
+                scene->rayIntersect(Ray3f(its.p, -eRec.ws_wi, Epsilon, eRec.distance * (1.f - Epsilon))))
+                continue;
+
+            BSDFQueryRecord bRec(vertex.wi, its.toLocal(-eRec.ws_wi), ESolidAngle, its.uv);
+            bRec.duvdx = its.duvdx;
+            bRec.duvdy = its.duvdy;
+            result += emitterColor * vertex.getBSDF()->eval(bRec) * std::abs(Frame::cosTheta(bRec.wo));
+        }
+        return result / (float) m_emitterSamples;
+    }
+
+    /// Radiance reflected at the vertex from the light of a single VPL (with visibility)
+    Color3f evalVPL(const Scene *scene, const PathVertex &vertex, const VPL &vpl) const {
+        const Intersection &its = vertex.its;
+        Vector3f d = vpl.its.p - its.p;
+        const float distance2 = d.squaredNorm();
+        const float distance = std::sqrt(distance2);
+        if (distance == 0.0f)
+            return Color3f(0.0f);
+        d /= distance;
+
+        const Vector3f wo = its.toLocal(d);
+        const Vector3f vplWo = vpl.its.toLocal(-d);
+        const float cosTheta = Frame::cosTheta(wo), vplCosTheta = Frame::cosTheta(vplWo);
+        if (cosTheta <= 0.0f || vplCosTheta <= 0.0f)
+            return Color3f(0.0f);
+
+        BSDFQueryRecord bRec(vertex.wi, wo, ESolidAngle, its.uv);
+        bRec.duvdx = its.duvdx;
+        bRec.duvdy = its.duvdy;
+        const Color3f contribution = vpl.flux
+            * vpl.its.mesh->getBSDF()->eval(BSDFQueryRecord(vpl.wi, vplWo, ESolidAngle, vpl.its.uv))
+            * vertex.getBSDF()->eval(bRec)
+            * (cosTheta * vplCosTheta / std::max(distance2, m_minDistance2));
+        if (contribution.isZero() || scene->rayIntersect(Ray3f(its.p, d, Epsilon, distance * (1.f - Epsilon))))
+            return Color3f(0.0f);
+        return contribution;
+    }
+
+    /// Upper bound of the (unoccluded) radiance reflected at the vertex from a cluster
+    float errorBound(const PathVertex &vertex, float bsdfBound, const LightNode &node) const {
+        const Intersection &its = vertex.its;
+
+        /* Clusters behind the tangent plane don't contribute */
+        bool visible = false;
+        for (int i = 0; i < 8 && !visible; ++i)
+            visible = (node.bbox.getCorner(i) - its.p).dot(its.shFrame.n) > 0.0f;
+        if (!visible)
+            return 0.0f;
+
+        const float distance2 = std::max(node.bbox.squaredDistanceTo(its.p), m_minDistance2);
+        return node.intensity.getLuminance() * bsdfBound / distance2;
+    }
+
+    /// Indirect illumination at the vertex from the VPLs of a lightcut
+    Color3f gatherVPLs(const Scene *scene, const PathVertex &vertex) const {
+        if (m_nodes.empty())
+            return Color3f(0.0f);
+
+        const Intersection &its = vertex.its;
+        BSDFQueryRecord bRec(vertex.wi, Vector3f(0.0f, 0.0f, 1.0f), ESolidAngle, its.uv);
+        bRec.duvdx = its.duvdx;
+        bRec.duvdy = its.duvdy;
+        const float bsdfBound = vertex.getBSDF()->eval(bRec).getLuminance();
+
+        /* Scale the contribution of the representative to the cluster */
+        auto makeEntry = [&](uint32_t index, const Color3f &repContribution) {
+            const LightNode &node = m_nodes[index];
+            const float repIntensity = m_vpls[node.rep].intensity.getLuminance();
+            const float scale = repIntensity > 0.0f ? node.intensity.getLuminance() / repIntensity : 0.0f;
+            /* single VPLs are exact */
+            const float bound = node.child[0] ? errorBound(vertex, bsdfBound, node) : 0.0f;
+            return CutEntry{ index, repContribution, repContribution * scale, bound };
+        };
+
+        std::priority_queue<CutEntry> cut;
+        cut.push(makeEntry(0, evalVPL(scene, vertex, m_vpls[m_nodes[0].rep])));
+        Color3f total = cut.top().estimate;
+
+        while ((int) cut.size() < m_maxCutSize) {
+            const CutEntry entry = cut.top();
+            if (entry.bound <= m_maxError * total.getLuminance())
+                break;
+            cut.pop();
+            total -= entry.estimate;
+
+            /* Refine the cluster, the child with the same representative reuses its contribution */
+            const LightNode &node = m_nodes[entry.node];
+            for (uint32_t child : node.child) {
+                const uint32_t rep = m_nodes[child].rep;
+                const Color3f repContribution = rep == node.rep ? entry.repContribution
+                                                                : evalVPL(scene, vertex, m_vpls[rep]);
+                const CutEntry childEntry = makeEntry(child, repContribution);
+                total += childEntry.estimate;
+                cut.push(childEntry);
+            }
+        }
+
+        return Color3f(total.cwiseMax(0.0f));
+    }
+
+    int m_lightPaths;
+    int m_maxDepth;
+    int m_maxBounces;
+    int m_emitterSamples;
+    float m_maxError;
+    int m_maxCutSize;
+    float m_clamping;
+    float m_minDistance2 = 0.0f;
+
+    std::vector<VPL> m_vpls;
+    std::vector<LightNode> m_nodes;
+};
+
+NORI_REGISTER_CLASS(VPLIntegrator, "vpl");
+NORI_NAMESPACE_END
@@ -10,37 +10,99 @@ NORI_NAMESPACE_BEGIN
 
 /// Perturb the sample value using a box mutation
 void PSSMLT::boxPerturbation(Sampler *sampler, float &value) {
-    // Exercise 8.2: Implement the box perturbation
-    throw NoriException("PSSMLT::boxPerturbation() is not yet implemented!");
+    // uniform offset within [-s, s], wrapped around by the ReplaySampler
+    constexpr float s = 1.0f/64.0f;
+    value += (2.0f*sampler->next1D()-1.0f)*s;
 }
 
 /// Perturb the sample value using a smooth mutation
 void PSSMLT::smoothPerturbation(Sampler *sampler, float &value) {
-    // Exercise 8.3: Implement the smooth perturbation
-    throw NoriException("PSSMLT::smoothPerturbation() is not yet implemented!");
+    // exponentially distributed offset between s1 and s2 (Kelemen et al. 2002)
+    constexpr float s1 = 1.0f/1024.0f, s2 = 1.0f/64.0f;
+    const float dv = s2*std::exp(-std::log(s2/s1)*sampler->next1D());
+    value += sampler->next1D() < 0.5f ? dv : -dv;
 }
 
 /// Process the Markov Chain. Mutate for \param chainlength steps
-void PSSMLT::processMarkovChain(const Scene* scene, Integrator* integrator, Sampler* sampler, HistogramImage &histogram) {
-    // TODO: Exercise 8.2, 8.3: Implement the Markov Chain
+void PSSMLT::processMarkovChain(const Scene* scene, Integrator* integrator, Sampler* sampler, SplatTarget &histogram,
+                                const ChainStart &start) {
+    const Vector2i outputSize = scene->getCamera()->getOutputSize();
+    const auto toPixel = [&outputSize](const Point2f &pixelSample) {
+        return Point2f(pixelSample.x()*outputSize.x(), pixelSample.y()*outputSize.y());
+    };
 
-    const Point2i outputSize = scene->getCamera()->getOutputSize();
+    const int chainlength = start.chainlength > 0 ? start.chainlength : m_chainlength;
 
-    /// Current and tentative MCMC states
-    ReplaySampler currentState(sampler), tentativeState(sampler);
-    Color3f currentContribution, tentativeContribution;
+    /// MCMC state, mutated lazily and restored on rejection
+    std::unique_ptr<Sampler> seedSampler;
+    ReplaySampler state(sampler);
 
-    throw NoriException("PSSMLT::processMarkovChain() is not yet implemented!");
-    // silence unused variable warning
-    (void) outputSize;
+    Color3f currentContribution;
+    int startup = m_startup;
+    if (start.seed >= 0) {
+        // reconstruct the bootstrap state, then continue with the chain's own random numbers
+        seedSampler = sampler->clone();
+        state = reconstructState(seedSampler.get(), start.seed);
+        currentContribution = computeContribution(scene, integrator, state);
+        state.setFallbackSampler(sampler);
+        // the seed is already distributed proportional to its contribution
+        startup = 0;
+    } else {
+        currentContribution = newChain(scene, integrator, state);
+    }
+    Point2f currentPixel = toPixel(state.getPixelSample());
+    state.accept();
+
+    for (int i=-startup; i<chainlength; ++i) {
+        Color3f tentativeContribution;
+        if (sampler->next1D() < m_newChain)
+            tentativeContribution = newChain(scene, integrator, state);
+        else if (sampler->next1D() < 0.5f)
+            tentativeContribution = perturbChainBox(scene, integrator, state);
+        else
+            tentativeContribution = perturbChainSmooth(scene, integrator, state);
+        const Point2f tentativePixel = toPixel(state.getPixelSample());
+
+        // multiplexed chains only visit paths of their own stratum
+        if (start.dimension >= 0 && state.getPathDimension() != static_cast<uint32_t>(start.dimension))
+            tentativeContribution = Color3f(0.0f);
+
+        const float currentBrightness = currentContribution.isValid() ? currentContribution.mean() : 0.0f;
+        const float tentativeBrightness = tentativeContribution.isValid() ? tentativeContribution.mean() : 0.0f;
+        const float acceptance = currentBrightness > 0.0f ? std::min(1.0f, tentativeBrightness/currentBrightness) : 1.0f;
+
+        // record both states weighted by their acceptance probability (expected values)
+        if (i >= 0) {
+            if (currentBrightness > 0.0f)
+                histogram.splat(currentPixel, currentContribution*(start.splatScale*(1.0f-acceptance)/currentBrightness));
+            if (tentativeBrightness > 0.0f)
+                histogram.splat(tentativePixel, tentativeContribution*(start.splatScale*acceptance/tentativeBrightness));
+        }
+
+        if (sampler->next1D() < acceptance) {
+            state.accept();
+            currentContribution = tentativeContribution;
+            currentPixel = tentativePixel;
+        } else {
+            state.reject();
+        }
+    }
 }
 
 /// Compute the contribution of a given Markov Chain state
 Color3f PSSMLT::computeContribution(const Scene *scene, Integrator *integrator, ReplaySampler &state) const {
-    //TODO: Exercise 8.4: Implement PSSMLT
+    // the empty test scene renders the testpattern instead
+    if (scene->getMeshes().empty())
+        return testpattern(state.getPixelSample());
 
-    // return the testpattern
-    return testpattern(state.getPixelSample());
+    // trace a path through the scene, the integrator draws all further dimensions from the state
+    const Camera *camera = scene->getCamera();
+    const Vector2i outputSize = camera->getOutputSize();
+    const Point2f &pixelSample = state.getPixelSample();
+    Ray3f ray;
+    const Color3f value = camera->sampleRay(ray,
+        Point2f(pixelSample.x()*outputSize.x(), pixelSample.y()*outputSize.y()), state.getApertureSample());
+    return value*integrator->Li(scene, &state, ray);
 }
 
 NORI_NAMESPACE_END
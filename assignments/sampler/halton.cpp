@@ -1,14 +1,29 @@
-#include <numeric>
 #include <nori/sampler.h>
 #include <nori/block.h>
-#include <pcg32.h>
+#include <nori/qmc.h>
+#include <nori/bluenoise.h>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * Halton sampler backed by the table-driven radical inverse in qmc.h.
+ *
+ * Every requested dimension uses its own prime base (the first
+ * \ref RadicalInverse::Dimensions primes), with digits scrambled by random
+ * permutations unless <tt>permute</tt> is disabled. Pixels are decorrelated
+ * by starting each of them at a different, hashed offset into the sequence.
+ * Dimensions beyond the prime table wrap around with a random rotation.
+ *
+ * With <tt>blueNoise</tt> enabled, all pixels instead start at the same
+ * index and every dimension is rotated by a tiled blue-noise mask.
+ */
 class Halton : public Sampler {
 public:
     Halton(const PropertyList &propList) {
         m_sampleCount = static_cast<size_t>(propList.getInteger("sampleCount", 1));
+        m_permute = propList.getBoolean("permute", true);
+        m_blueNoise = propList.getBoolean("blueNoise", false);
+        m_radicalInverse = &RadicalInverse::get(m_permute);
     }
 
     std::unique_ptr<Sampler> clone() const override {
@@ -16,16 +31,16 @@ public:
     }
 
     void prepare(const ImageBlock &block) override {
-        /* noop */
-        m_random.seed(
-            block.getOffset().x(),
-            block.getOffset().y()
-        );
+        /* callers that don't address pixels (e.g. Markov chains) are told
+           apart by the block offset only; they advance through long runs
+           of the sequence, so use the full hash as starting index */
+        m_pixel = block.getOffset();
+        m_pixelOffset = hashValues(block.getOffset().x(), block.getOffset().y());
     }
 
     void generate() override
     {
-        m_pathDepth = 0;
+        m_pathDepth = m_pixelOffset;
         m_sample = 0;
     }
     void advance()  override
@@ -33,61 +48,59 @@ public:
         ++m_pathDepth;
         m_sample = 0;
     }
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex) override
+    {
+        m_pixel = pixel;
+        m_pixelOffset = m_blueNoise ? 0 : hashValues(pixel.x(), pixel.y()) & 0xFFFFu;
+        m_pathDepth = m_pixelOffset + sampleIndex;
+        m_sample = 0;
+    }
 
-float next1D() override {
-    const size_t sample = m_sample;
-    ++m_sample;
-    if (sample >= 4)
-        return m_random.nextFloat();
-    return static_cast<float>(radical_inverse(m_pathDepth, prime_numbers[halton_1d[sample]]));
-}
+    float next1D() override {
+        return sample(m_sample++);
+    }
 
-Point2f next2D() override {
-    const size_t sample = m_sample;
-    ++m_sample;
-    if (sample >= 4)
-        return Point2f(
-            m_random.nextFloat(),
-            m_random.nextFloat()
-        );
-    return {
-        static_cast<float>(radical_inverse(m_pathDepth, prime_numbers[halton_2d_a[sample]])),
-        static_cast<float>(radical_inverse(m_pathDepth, prime_numbers[halton_2d_b[sample]]))
-    };
-}
+    Point2f next2D() override {
+        const uint32_t dim = m_sample;
+        m_sample += 2;
+        return Point2f(sample(dim), sample(dim + 1));
+    }
+
+    void fill1D(float *values, size_t count) override {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = sample(m_sample++);
+    }
+
+    void fill2D(Point2f *values, size_t count) override {
+        for (size_t i = 0; i < count; ++i, m_sample += 2)
+            values[i] = Point2f(sample(m_sample), sample(m_sample + 1));
+    }
 
     std::string toString() const override {
-        return tfm::format("Halton[sampleCount=%i]", m_sampleCount);
+        return tfm::format("Halton[sampleCount=%i, permute=%s, blueNoise=%s]",
+            m_sampleCount, m_permute ? "true" : "false", m_blueNoise ? "true" : "false");
     }
 protected:
     Halton() = default;
 
 private:
-    size_t m_sample{ 0 };
-    size_t m_pathDepth{ 0 };
-const size_t prime_numbers[12] = {
-    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37
-};
-const size_t halton_2d_a[4] = { 1, 3, 5, 7 };
-const size_t halton_2d_b[4] = { 2, 4, 6, 8 };
-const size_t halton_1d[4] = { 9, 10, 11, 12 };
-
-static double radical_inverse(size_t i, const size_t base)
-{
-    const auto dbase = static_cast<double>(base);
-    double inverse = 0.0;
-    double factor = 1.0 / dbase;
-
-    while (i > 0) {
-        inverse += static_cast<double>(i % base) * factor;
-        i /= base;
-        factor /= dbase;
+    float sample(uint32_t dim) const {
+        constexpr uint32_t dims = RadicalInverse::Dimensions;
+        float value = (*m_radicalInverse)(static_cast<int>(dim % dims), m_pathDepth);
+        if (dim >= dims) {
+            value += fixedToFloat(hashValues(dim));
+            value = value < 1.f ? value : value - 1.f;
+        }
+        return m_blueNoise ? applyBlueNoise(value, m_pixel, dim) : value;
     }
 
-    return inverse;
-}
-
-    pcg32 m_random;
+    bool m_permute{ true };
+    bool m_blueNoise{ false };
+    Point2i m_pixel{ 0, 0 };
+    const RadicalInverse *m_radicalInverse{ nullptr };
+    uint32_t m_sample{ 0 };
+    uint64_t m_pathDepth{ 0 };
+    uint64_t m_pixelOffset{ 0 };
 };
 
 NORI_REGISTER_CLASS(Halton, "halton");
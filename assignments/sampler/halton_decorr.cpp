@@ -1,10 +1,14 @@
-#include <numeric>
 #include <nori/sampler.h>
 #include <nori/block.h>
+#include <nori/qmc.h>
 #include <pcg32.h>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * Halton sampler decorrelated between pixels by a random per-pixel
+ * Cranley-Patterson rotation of every dimension.
+ */
 class HaltonDecorr : public Sampler {
 public:
     HaltonDecorr(const PropertyList &propList) {
@@ -24,9 +28,7 @@ public:
 
     void generate() override
     {
-        m_randomVec.clear();
-        for (int dim = 0; dim < 4; ++dim)
-            m_randomVec.push_back(m_random.nextFloat());
+        m_rotationSeed = m_random.nextUInt();
         m_pathDepth = 0;
         m_dimension = 0;
     }
@@ -35,28 +37,33 @@ public:
         ++m_pathDepth;
         m_dimension = 0;
     }
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex) override
+    {
+        /* keep the rotation fixed over all samples of the pixel */
+        m_rotationSeed = hashValues(pixel.x(), pixel.y());
+        m_pathDepth = sampleIndex;
+        m_dimension = 0;
+    }
 
-float next1D() override {
-    const size_t sample = m_dimension;
-    ++m_dimension;
-    if (sample >= 4)
-        return m_random.nextFloat();
-    return std::fmodf(static_cast<float>(m_randomVec[sample] + radical_inverse(m_pathDepth, prime_numbers[halton_1d[sample]])), 1.f);
-}
+    float next1D() override {
+        return sample(m_dimension++);
+    }
 
-Point2f next2D() override {
-    const size_t sample = m_dimension;
-    ++m_dimension;
-    if (sample >= 4)
-        return Point2f(
-            m_random.nextFloat(),
-            m_random.nextFloat()
-        );
-    return {
-        std::fmodf(static_cast<float>(m_randomVec[sample] + radical_inverse(m_pathDepth, prime_numbers[halton_2d_a[sample]])), 1.f),
-        std::fmodf(static_cast<float>(m_randomVec[sample] + radical_inverse(m_pathDepth, prime_numbers[halton_2d_b[sample]])), 1.f)
-    };
-}
+    Point2f next2D() override {
+        const uint32_t dim = m_dimension;
+        m_dimension += 2;
+        return Point2f(sample(dim), sample(dim + 1));
+    }
+
+    void fill1D(float *values, size_t count) override {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = sample(m_dimension++);
+    }
+
+    void fill2D(Point2f *values, size_t count) override {
+        for (size_t i = 0; i < count; ++i, m_dimension += 2)
+            values[i] = Point2f(sample(m_dimension), sample(m_dimension + 1));
+    }
 
     std::string toString() const override {
         return tfm::format("HaltonDecorr[sampleCount=%i]", m_sampleCount);
@@ -65,31 +72,16 @@ protected:
     HaltonDecorr() = default;
 
 private:
-    size_t m_dimension{ 0 };
-    size_t m_pathDepth{ 0 };
-    const size_t prime_numbers[12] = {
-        2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37
-    };
-    const size_t halton_2d_a[4] = { 1, 3, 5, 7 };
-    const size_t halton_2d_b[4] = { 2, 4, 6, 8 };
-    const size_t halton_1d[4] = { 9, 10, 11, 12 };
-
-    std::vector<float> m_randomVec;
-
-static double radical_inverse(size_t i, const size_t base)
-{
-    const auto dbase = static_cast<double>(base);
-    double inverse = 0.0;
-    double factor = 1.0 / dbase;
-
-    while (i > 0) {
-        inverse += static_cast<double>(i % base) * factor;
-        i /= base;
-        factor /= dbase;
+    float sample(uint32_t dim) const {
+        const RadicalInverse &radicalInverse = RadicalInverse::get(false);
+        const float value = radicalInverse(static_cast<int>(dim % RadicalInverse::Dimensions), m_pathDepth)
+                          + fixedToFloat(hashValues(m_rotationSeed, dim));
+        return value < 1.f ? value : value - 1.f;
     }
 
-    return inverse;
-}
+    uint32_t m_dimension{ 0 };
+    uint64_t m_pathDepth{ 0 };
+    uint32_t m_rotationSeed{ 0 };
 
     pcg32 m_random;
 };
@@ -6,7 +6,9 @@
 
 #include <nori/sampler.h>
 #include <nori/block.h>
+#include <nori/bluenoise.h>
 #include <pcg32.h>
+#include <bit>
 
 NORI_NAMESPACE_BEGIN
 
@@ -15,13 +17,29 @@ NORI_NAMESPACE_BEGIN
  * random numbers on <tt>[0, 1)x[0, 1)</tt>.
  *
  * This class is essentially just a wrapper around the pcg32 pseudorandom
- * number generator. For more details on what sample generators do in
- * general, refer to the \ref Sampler class.
+ * number generator. Values are produced by several interleaved pcg32
+ * streams in batches, either directly into the output of \ref fill1D()
+ * or into a small prefetch buffer serving \ref next1D() and \ref next2D().
+ * The stream states are stored as plain arrays (structure of arrays), so
+ * the compiler can vectorize the generator step and output permutation
+ * over all streams at once without explicit intrinsics.
+ * For more details on what sample generators do in general, refer to the
+ * \ref Sampler class.
+ *
+ * With <tt>blueNoise</tt> enabled, sample j of every pixel instead uses one
+ * random value per dimension shared by all pixels, rotated per pixel by a
+ * tiled blue-noise mask. Each pixel still receives independent uniform
+ * samples, but the error is spread over the image as blue noise.
  */
 class Independent : public Sampler {
 public:
     Independent(const PropertyList &propList) {
         m_sampleCount = static_cast<size_t>(propList.getInteger("sampleCount", 1));
+        m_blueNoise = propList.getBoolean("blueNoise", false);
+
+        /* distinct streams for callers that never call prepare() or startPixelSample() */
+        for (uint32_t lane = 0; lane < Lanes; ++lane)
+            seedLane(lane, PCG32_DEFAULT_STATE, lane);
     }
 
     std::unique_ptr<Sampler> clone() const override {
@@ -29,34 +47,139 @@ public:
     }
 
     void prepare(const ImageBlock &block) override {
-        m_random.seed(
-            block.getOffset().x(),
-            block.getOffset().y()
-        );
+        /* one pcg32 stream per lane */
+        for (uint32_t lane = 0; lane < Lanes; ++lane)
+            seedLane(lane,
+                block.getOffset().x(),
+                static_cast<uint64_t>(block.getOffset().y()) * Lanes + lane
+            );
+        m_bufferPos = BufferSize;
+        m_pixel = block.getOffset();
+    }
+
+    void generate() override {
+        m_index = 0;
+        m_dimension = 0;
+    }
+
+    void advance() override {
+        ++m_index;
+        m_dimension = 0;
     }
 
-    void generate() override { /* No-op for this sampler */ }
-    void advance()  override { /* No-op for this sampler */ }
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex) override {
+        /* key the streams by pixel and sample index only, independent of
+           how pixels were distributed over blocks and threads */
+        const uint32_t seed = hashValues(pixel.x(), pixel.y(), sampleIndex);
+        for (uint32_t lane = 0; lane < Lanes; ++lane)
+            seedLane(lane, hashValues(seed, lane), lane);
+        m_bufferPos = BufferSize;
+
+        m_pixel = pixel;
+        m_index = sampleIndex;
+        m_dimension = 0;
+    }
 
     float next1D() override {
-        return m_random.nextFloat();
+        if (m_blueNoise)
+            return blueNoiseSample(m_dimension++);
+        return nextBuffered();
     }
 
     Point2f next2D() override {
-        return Point2f(
-            m_random.nextFloat(),
-            m_random.nextFloat()
-        );
+        if (m_blueNoise) {
+            const uint32_t dim = m_dimension;
+            m_dimension += 2;
+            return Point2f(blueNoiseSample(dim), blueNoiseSample(dim + 1));
+        }
+        const float x = nextBuffered();
+        return Point2f(x, nextBuffered());
+    }
+
+    void fill1D(float *values, size_t count) override {
+        if (m_blueNoise) {
+            for (size_t i = 0; i < count; ++i)
+                values[i] = blueNoiseSample(m_dimension++);
+            return;
+        }
+
+        /* drain the prefetch buffer first to keep the stream order */
+        while (count > 0 && m_bufferPos < BufferSize) {
+            *values++ = m_buffer[m_bufferPos++];
+            --count;
+        }
+        const size_t direct = count - count % Lanes;
+        fillLanes(values, direct);
+        for (size_t i = direct; i < count; ++i)
+            values[i] = nextBuffered();
+    }
+
+    void fill2D(Point2f *values, size_t count) override {
+        /* generate the coordinates in chunks and copy them into the points */
+        float buffer[BufferSize];
+        while (count > 0) {
+            const size_t chunk = std::min<size_t>(count, BufferSize / 2);
+            fill1D(buffer, 2 * chunk);
+            for (size_t i = 0; i < chunk; ++i)
+                values[i] = Point2f(buffer[2 * i], buffer[2 * i + 1]);
+            values += chunk;
+            count -= chunk;
+        }
     }
 
     std::string toString() const override {
-        return tfm::format("Independent[sampleCount=%i]", m_sampleCount);
+        return tfm::format("Independent[sampleCount=%i, blueNoise=%s]",
+            m_sampleCount, m_blueNoise ? "true" : "false");
     }
 protected:
     Independent() = default;
 
 private:
-    pcg32 m_random;
+    static constexpr uint32_t Lanes = 8;
+    static constexpr uint32_t BufferSize = 8 * Lanes;
+
+    /// Seed a lane like pcg32::seed()
+    void seedLane(uint32_t lane, uint64_t initState, uint64_t initSeq) {
+        const pcg32 rng(initState, initSeq);
+        m_state[lane] = rng.state;
+        m_inc[lane] = rng.inc;
+    }
+
+    /// Generate \c count (a multiple of \ref Lanes) values, interleaving the lanes
+    void fillLanes(float *values, size_t count) {
+        for (size_t i = 0; i < count; i += Lanes) {
+            /* same step and output function as pcg32::nextFloat(), for all lanes */
+            for (uint32_t lane = 0; lane < Lanes; ++lane) {
+                const uint64_t oldState = m_state[lane];
+                m_state[lane] = oldState * PCG32_MULT + m_inc[lane];
+                const uint32_t xorShifted = static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+                const uint32_t rot = static_cast<uint32_t>(oldState >> 59u);
+                const uint32_t bits = (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31));
+                values[i + lane] = std::bit_cast<float>((bits >> 9) | 0x3f800000u) - 1.0f;
+            }
+        }
+    }
+
+    float nextBuffered() {
+        if (m_bufferPos == BufferSize) {
+            fillLanes(m_buffer, BufferSize);
+            m_bufferPos = 0;
+        }
+        return m_buffer[m_bufferPos++];
+    }
+
+    float blueNoiseSample(uint32_t dim) const {
+        return applyBlueNoise(fixedToFloat(hashValues(m_index, dim)), m_pixel, dim);
+    }
+
+    bool m_blueNoise{ false };
+    Point2i m_pixel{ 0, 0 };
+    uint32_t m_index{ 0 };
+    uint32_t m_dimension{ 0 };
+    uint64_t m_state[Lanes];
+    uint64_t m_inc[Lanes];
+    float m_buffer[BufferSize];
+    uint32_t m_bufferPos{ BufferSize };
 };
 
 NORI_REGISTER_CLASS(Independent, "independent");
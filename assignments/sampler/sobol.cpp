@@ -0,0 +1,138 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Owen-scrambled Sobol sampler
+*/
+
+#include <nori/sampler.h>
+#include <nori/block.h>
+#include <nori/qmc.h>
+#include <nori/bluenoise.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * Sobol sampler with hash-based Owen scrambling.
+ *
+ * All pixels share the same Sobol sequence; decorrelation between pixels
+ * is achieved by a per-pixel nested uniform scramble of both the sample
+ * index (shuffling the order in which points are visited) and the point
+ * values of every dimension. Sample values only require a few bit
+ * operations and the N-th sample of a pixel can be accessed directly,
+ * see \ref startPixelSample().
+ *
+ * Dimensions beyond the precomputed generator matrices are padded by
+ * reusing them with an independently shuffled sample index. The sequence
+ * is best used with power-of-two sample counts.
+ *
+ * With <tt>blueNoise</tt> enabled, all pixels share a single scrambled
+ * sequence which is rotated per pixel by a tiled blue-noise mask. This
+ * distributes the error of low sample count previews as blue noise.
+ */
+class Sobol : public Sampler {
+public:
+    Sobol(const PropertyList &propList) {
+        m_sampleCount = static_cast<size_t>(propList.getInteger("sampleCount", 1));
+        m_scramble = propList.getBoolean("scramble", true);
+        m_seed = static_cast<uint32_t>(propList.getInteger("seed", 0));
+        m_blueNoise = propList.getBoolean("blueNoise", false);
+    }
+
+    std::unique_ptr<Sampler> clone() const override {
+        return std::make_unique<Sobol>(*this);
+    }
+
+    void prepare(const ImageBlock &block) override {
+        /* only used by callers that do not address pixels explicitly */
+        setPixel(block.getOffset());
+    }
+
+    void generate() override {
+        m_index = 0;
+        m_dimension = 0;
+    }
+
+    void advance() override {
+        ++m_index;
+        m_dimension = 0;
+    }
+
+    void startPixelSample(const Point2i &pixel, uint32_t sampleIndex) override {
+        setPixel(pixel);
+        m_index = sampleIndex;
+        m_dimension = 0;
+    }
+
+    float next1D() override {
+        return sample(m_dimension++);
+    }
+
+    Point2f next2D() override {
+        const uint32_t dim = m_dimension;
+        m_dimension += 2;
+        return sample2D(dim);
+    }
+
+    void fill1D(float *values, size_t count) override {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = sample(m_dimension++);
+    }
+
+    void fill2D(Point2f *values, size_t count) override {
+        for (size_t i = 0; i < count; ++i, m_dimension += 2)
+            values[i] = sample2D(m_dimension);
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "Sobol[sampleCount=%i, scramble=%s, seed=%i, blueNoise=%s]",
+            m_sampleCount, m_scramble ? "true" : "false", m_seed,
+            m_blueNoise ? "true" : "false");
+    }
+protected:
+    Sobol() = default;
+
+private:
+    void setPixel(const Point2i &pixel) {
+        m_pixel = pixel;
+        m_pixelSeed = m_blueNoise ? hashValues(m_seed) : hashValues(pixel.x(), pixel.y(), m_seed);
+    }
+
+    uint32_t shuffledIndex(uint32_t dim) const {
+        const uint32_t group = dim / SobolDimensions;
+        if (!m_scramble && group == 0)
+            return m_index;
+        return owenScramble(m_index, hashValues(m_pixelSeed, group));
+    }
+
+    float value(uint32_t index, uint32_t dim) const {
+        uint32_t bits = sobolSampleBits(index, static_cast<int>(dim % SobolDimensions));
+        if (m_scramble)
+            bits = owenScramble(bits, hashValues(m_pixelSeed, dim, 0x50b0u));
+        if (m_blueNoise)
+            return applyBlueNoise(fixedToFloat(bits), m_pixel, dim);
+        return fixedToFloat(bits);
+    }
+
+    float sample(uint32_t dim) const {
+        return value(shuffledIndex(dim), dim);
+    }
+
+    Point2f sample2D(uint32_t dim) const {
+        /* use a shared shuffled index for both components */
+        if (dim % SobolDimensions == SobolDimensions - 1)
+            return Point2f(sample(dim), sample(dim + 1));
+        const uint32_t index = shuffledIndex(dim);
+        return Point2f(value(index, dim), value(index, dim + 1));
+    }
+
+    bool m_scramble{ true };
+    bool m_blueNoise{ false };
+    Point2i m_pixel{ 0, 0 };
+    uint32_t m_seed{ 0 };
+    uint32_t m_pixelSeed{ 0 };
+    uint32_t m_index{ 0 };
+    uint32_t m_dimension{ 0 };
+};
+
+NORI_REGISTER_CLASS(Sobol, "sobol");
+NORI_NAMESPACE_END
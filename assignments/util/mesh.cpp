@@ -21,13 +21,29 @@ Mesh::Mesh() = default;
 Mesh::~Mesh() = default;
 
 void Mesh::activate() {
+    updateAreaDistribution();
+
+    if (!m_bsdf) {
+        /* If no material was assigned, instantiate a diffuse BRDF */
+        m_bsdf = static_cast<BSDF *>(
+            NoriObjectFactory::createInstance("diffuse", PropertyList()));
+    }
+
+    if(m_emitter) {
+        m_emitter->setParent(this);
+    }
+}
+
+void Mesh::updateAreaDistribution() {
 
     /* Create a discrete distribution for sampling triangles
      * with respect to their surface area (use the existing \c m_distr)
      */
 
     const auto triCount = getTriangleCount();
+    m_distr.clear();
     m_distr.reserve(triCount);
+    m_cachedArea = 0.f;
     for (uint32_t i = 0; i < triCount; ++i)
     {
         const auto area = surfaceArea(i);
@@ -36,16 +52,20 @@ void Mesh::activate() {
     }
 
     m_distr.normalize();
+}
 
-    if (!m_bsdf) {
-        /* If no material was assigned, instantiate a diffuse BRDF */
-        m_bsdf = static_cast<BSDF *>(
-            NoriObjectFactory::createInstance("diffuse", PropertyList()));
-    }
+void Mesh::setVertexPositions(MatrixXf &&V, MatrixXf &&N) {
+    if (V.cols() != m_V.cols() || (N.size() > 0 && N.cols() != m_V.cols()))
+        throw NoriException("Mesh \"%s\": the number of vertices must not change between frames!", m_name);
 
-    if(m_emitter) {
-        m_emitter->setParent(this);
-    }
+    m_V = std::move(V);
+    m_N = std::move(N);
+
+    m_bbox.reset();
+    for (uint32_t i = 0; i < getVertexCount(); ++i)
+        m_bbox.expandBy(m_V.col(i));
+
+    updateAreaDistribution();
 }
 
 /// uniformly sample a position on the mesh
@@ -56,10 +76,13 @@ void Mesh::samplePosition(const Point2f &sample, Point3f &p, Normal3f &n) const
      * on the actual triangle using the barycentric coordinates.
      */
 
-    const auto uniTriPos = Warp::squareToUniformTriangle(sample);
-    const auto barycentricPos = barycentric(uniTriPos);
+    /* choose the triangle with the first sample dimension and rescale it for reuse,
+       so that the result only depends on the provided sample */
+    Point2f reusedSample = sample;
+    const auto triIndex = m_distr.sampleReuse(reusedSample.x());
 
-    const auto triIndex = m_distr.sample(uniformRandomValue());
+    const auto uniTriPos = Warp::squareToUniformTriangle(reusedSample);
+    const auto barycentricPos = barycentric(uniTriPos);
 
     p = apply_barycentric(barycentricPos, triangle(static_cast<uint32_t>(triIndex)));
     n = apply_barycentric(barycentricPos, normals(static_cast<uint32_t>(triIndex)));
@@ -156,11 +179,6 @@ void Mesh::addChild(NoriObject *obj) {
     }
 }
 
-float Mesh::uniformRandomValue() const
-{
-    return m_uniformDistribution(m_rng);
-}
-
 Point3f Mesh::barycentric(const Point2f &p) const
 {
     const auto sqrtU = std::sqrt(p.x());
@@ -225,6 +243,45 @@ std::string Mesh::toString() const {
     );
 }
 
+void Intersection::computeDifferentials(const Ray3f &ray) {
+    dpdx = dpdy = Vector3f(0.0f);
+    duvdx = duvdy = Vector2f(0.0f);
+    if (!ray.hasDifferentials)
+        return;
+
+    /* Intersect the offset rays with the tangent plane at p */
+    const Normal3f &n = geoFrame.n;
+    const float dnx = n.dot(ray.rxDirection), dny = n.dot(ray.ryDirection);
+    if (dnx == 0.0f || dny == 0.0f)
+        return;
+    const float tx = n.dot(p - ray.rxOrigin) / dnx;
+    const float ty = n.dot(p - ray.ryOrigin) / dny;
+    if (!std::isfinite(tx) || !std::isfinite(ty))
+        return;
+    dpdx = ray.rxOrigin + tx * ray.rxDirection - p;
+    dpdy = ray.ryOrigin + ty * ray.ryDirection - p;
+
+    /* Solve dp = dpdu * du + dpdv * dv in the least-squares sense */
+    const float a = dpdu.dot(dpdu), b = dpdu.dot(dpdv), c = dpdv.dot(dpdv);
+    const float det = a * c - b * b;
+    if (std::abs(det) < 1e-12f)
+        return;
+    const float invDet = 1.0f / det;
+    auto solve = [&](const Vector3f &dp) {
+        const float pu = dpdu.dot(dp), pv = dpdv.dot(dp);
+        return Vector2f((c * pu - b * pv) * invDet, (a * pv - b * pu) * invDet);
+    };
+    duvdx = solve(dpdx);
+    duvdy = solve(dpdy);
+}
+
+void Intersection::spawnDifferentials(Ray3f &ray) const {
+    ray.hasDifferentials = !dpdx.isZero() || !dpdy.isZero();
+    ray.rxOrigin = p + dpdx;
+    ray.ryOrigin = p + dpdy;
+    ray.rxDirection = ray.ryDirection = ray.d;
+}
+
 std::string Intersection::toString() const {
     if (!mesh)
         return "Intersection[invalid]";
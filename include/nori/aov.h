@@ -0,0 +1,69 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Arbitrary output variables
+*/
+
+#pragma once
+
+#include <nori/color.h>
+#include <nori/vector.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Arbitrary output variables (AOVs) that can be rendered in the
+ * same pass as the radiance
+ *
+ * AOVs are box filtered, i.e. every sample only contributes to the pixel
+ * it lies in, and averaged over the samples of a pixel.
+ */
+enum EAOVType {
+    EAOVDepth = 0,     ///< distance to the first intersection along the camera ray
+    EAOVNormal,        ///< shading normal at the first intersection (world space)
+    EAOVAlbedo,        ///< directional albedo of the BSDF at the first intersection
+    EAOVPrimitiveId,   ///< mesh and triangle index at the first intersection (not averaged)
+    EAOVSampleCount,   ///< number of samples taken in the pixel
+    EAOVVariance,      ///< sample variance of the radiance estimates of the pixel
+    EAOVTypeCount
+};
+
+/// Look up the AOV type with the given name (throws on failure)
+extern EAOVType aovTypeFromString(const std::string &name);
+
+/// Return the name of an AOV type (also used as the OpenEXR layer name)
+extern const char *aovTypeName(EAOVType type);
+
+/// Parse a comma-separated list of AOV names (e.g. "albedo, normal, depth")
+extern std::vector<EAOVType> parseAOVList(const std::string &list);
+
+/// Turn a list of AOVs into a comma-separated string
+extern std::string aovListString(const std::vector<EAOVType> &aovs);
+
+/**
+ * \brief Surface AOVs of a single camera sample, filled in by
+ * \ref Integrator::LiAOV()
+ *
+ * The per-pixel AOVs (sample count and variance) are derived from the
+ * radiance values by \ref ImageBlock.
+ */
+struct AOVRecord {
+    /// Distance to the first intersection (0 if the camera ray escapes)
+    float depth = 0.0f;
+
+    /// Shading normal at the first intersection (world space)
+    Normal3f normal;
+
+    /// Single-sample estimate of the directional albedo at the first intersection
+    Color3f albedo = Color3f(0.0f);
+
+    /// Index of the intersected mesh in the scene and of the triangle in the mesh (-1 if the ray escapes)
+    int meshIndex = -1, primIndex = -1;
+
+    /// Intersect the camera ray with the scene and record the first intersection
+    void record(const Scene *scene, Sampler *sampler, const Ray3f &ray);
+
+    /// Record an intersection of the camera ray found by the integrator
+    void record(const Intersection &its, Sampler *sampler, const Ray3f &ray);
+};
+
+NORI_NAMESPACE_END
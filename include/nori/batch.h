@@ -0,0 +1,80 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Batch rendering of several jobs with the same scene
+*/
+
+#pragma once
+
+#include <nori/object.h>
+
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Variation of a scene that is rendered in a batch
+ *
+ * A job replaces any of the camera, integrator, sampler and render
+ * manager of the scene, and can select an animation frame. Everything
+ * else (geometry, BVH, textures) is shared with the other jobs of the
+ * batch. The result is saved as <tt>&lt;scene&gt;_&lt;name&gt;</tt>.
+ */
+class RenderJob : public NoriObject {
+public:
+    RenderJob(const PropertyList &propList);
+
+    /// Release all memory
+    virtual ~RenderJob() override;
+
+    /// Return the name of the job (used as suffix of the output file)
+    const std::string &getName() const { return m_name; }
+
+    /// Return the animation frame of the job (or -1 to keep the current geometry)
+    int getFrame() const { return m_frame; }
+
+    /**
+     * \brief Exchange the objects given by the job with those of the scene
+     *
+     * Calling this a second time restores the original scene.
+     */
+    void swap(Scene *scene);
+
+    /// Register a camera, integrator, sampler or render manager
+    void addChild(NoriObject *obj) override;
+
+    std::string toString() const override;
+
+    EClassType getClassType() const override { return EJob; }
+
+private:
+    std::string m_name;
+    int m_frame;
+    std::unique_ptr<Camera> m_camera;
+    std::unique_ptr<Integrator> m_integrator;
+    std::unique_ptr<const Sampler> m_sampler;
+    std::unique_ptr<RenderManager> m_rendermanager;
+};
+
+/// List of jobs loaded from a batch file (root element <tt>&lt;batch&gt;</tt>)
+class RenderBatch : public NoriObject {
+public:
+    RenderBatch(const PropertyList &) { }
+
+    /// Return the jobs in the order of the batch file
+    const std::vector<std::unique_ptr<RenderJob>> &getJobs() const { return m_jobs; }
+
+    /// Register a job
+    void addChild(NoriObject *obj) override;
+
+    /// Check that the job names are unique
+    void activate() override;
+
+    std::string toString() const override;
+
+    EClassType getClassType() const override { return EBatch; }
+
+private:
+    std::vector<std::unique_ptr<RenderJob>> m_jobs;
+};
+
+NORI_NAMESPACE_END
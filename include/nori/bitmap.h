@@ -8,9 +8,36 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
+#include <nori/texel.h>
+#include <memory>
+#include <mutex>
 
 NORI_NAMESPACE_BEGIN
 
+/// Settings for writing OpenEXR files
+struct EXROptions {
+    /// Compression scheme of the written file
+    enum ECompression {
+        ENone = 0, ///< uncompressed
+        EZip,      ///< lossless, zlib compressed blocks of 16 scanlines
+        EPiz,      ///< lossless, wavelet based (good for noisy images)
+        EDWAA      ///< lossy, DCT based (blocks of 32 scanlines)
+    };
+
+    ECompression compression = EZip;
+
+    /// Store half precision instead of single precision channels
+    bool half = false;
+
+    /// Look up the compression scheme with the given name (throws on failure)
+    static ECompression compressionFromString(const std::string &name);
+
+    /// Return the name of a compression scheme
+    static const char *compressionName(ECompression compression);
+
+    std::string toString() const;
+};
+
 /**
  * \brief Stores a RGB high dynamic-range bitmap
  *
@@ -32,11 +59,103 @@ public:
     /// Load an OpenEXR file with the specified filename
     Bitmap(const std::string &filename);
 
-    /// Save the bitmap as an EXR file with the specified filename
-    void saveEXR(const std::string &filename);
+    /// Save the bitmap as an EXR file with the specified filename (using \ref getEXROptions())
+    void saveEXR(const std::string &filename) const;
+
+    /**
+     * \brief Save the bitmap as an EXR file with the specified filename and settings
+     *
+     * The bitmap is stored in the R, G and B channels. Additional layers
+     * (e.g. AOVs) are stored in the channels "<layer>.<channel>".
+     */
+    void saveEXR(const std::string &filename, const EXROptions &options,
+                 const std::vector<BitmapLayer> &layers = {}) const;
 
     /// Save the bitmap as a PNG file (with sRGB tonemapping) with the specified filename
-    void savePNG(const std::string &filename);
+    void savePNG(const std::string &filename) const;
+
+    /**
+     * \brief Save the bitmap as both EXR and PNG file, the two files are
+     * written concurrently
+     *
+     * Additional layers are only stored in the EXR file.
+     */
+    void save(const std::string &filename, const std::vector<BitmapLayer> &layers = {}) const;
+
+    /// Set the settings used for all EXR output without explicit settings
+    static void setEXROptions(const EXROptions &options);
+
+    /// Return the settings used for EXR output
+    static const EXROptions &getEXROptions();
+
+    /**
+     * \brief Set the number of threads OpenEXR uses to compress and
+     * decompress blocks of scanlines (0 disables threading)
+     */
+    static void setIOThreadCount(int count);
+};
+
+/// Named layer of a multi-layer OpenEXR file
+struct BitmapLayer {
+    /// Layer name, used as prefix of the channel names
+    std::string name;
+
+    /// Channel names, mapped to the first color components of the bitmap
+    std::vector<std::string> channels;
+
+    /**
+     * \brief Store the channels as 32 bit unsigned integers (e.g. ids),
+     * independent of \ref EXROptions::half. Negative values become 0xFFFFFFFF.
+     */
+    bool integer = false;
+
+    Bitmap bitmap;
 };
 
+/**
+ * \brief Writes a tiled OpenEXR file tile by tile
+ *
+ * Tiles can be written in any order and from multiple threads, only the
+ * tile currently being written is held in memory (the file is stored in
+ * random tile order so that OpenEXR doesn't buffer out-of-order tiles).
+ */
+class TiledEXRWriter {
+public:
+    /// Create the file \c filename.exr with the given image and tile size
+    TiledEXRWriter(const std::string &filename, const Vector2i &size, int tileSize,
+                   const EXROptions &options = Bitmap::getEXROptions());
+
+    ~TiledEXRWriter();
+
+    /// Return the number of tiles in each direction
+    Vector2i getTileCount() const;
+
+    /**
+     * \brief Write the tile with the given tile coordinates
+     *
+     * The bitmap must have the size of the tile, which is smaller than the
+     * tile size at the right and bottom border of the image.
+     */
+    void writeTile(int tx, int ty, const Bitmap &tile);
+
+private:
+    struct File;
+
+    std::unique_ptr<File> m_file;
+    Vector2i m_size;
+    int m_tileSize;
+    bool m_half;
+    std::mutex m_mutex;
+};
+
+/**
+ * \brief Load a low dynamic-range image (PNG, JPEG, TGA, BMP, ...)
+ *
+ * The 8 bit sRGB values are kept as they are, see \ref TexelSRGB8.
+ */
+extern BitmapSRGB8 loadLDRBitmap(const std::string &filename);
+
+/// Check whether the file name refers to an OpenEXR image
+extern bool isOpenEXRFile(const std::string &filename);
+
 NORI_NAMESPACE_END
@@ -12,6 +12,9 @@
 
 #include <nori/color.h>
 #include <nori/vector.h>
+#include <nori/aov.h>
+#include <map>
+#include <memory>
 #include <mutex>
 
 #define NORI_BLOCK_SIZE 32 /* Block size used for parallelization */
@@ -74,11 +77,39 @@ public:
     void fromBitmap(const Bitmap &bitmap);
 
     /// Clear all contents
-    void clear() { setConstant(Color4f()); }
+    void clear() {
+        setConstant(Color4f());
+        std::fill(m_aovData.begin(), m_aovData.end(), 0.0f);
+    }
+
+    /**
+     * \brief Configure the AOVs recorded in addition to the radiance
+     *
+     * This allocates (and clears) the AOV storage. Blocks that are merged
+     * into each other must have the same AOVs.
+     */
+    void setAOVs(const std::vector<EAOVType> &aovs);
+
+    /// Return the recorded AOVs
+    const std::vector<EAOVType> &getAOVs() const { return m_aovTypes; }
+
+    /// Are any AOVs recorded?
+    bool hasAOVs() const { return !m_aovTypes.empty(); }
+
+    /**
+     * \brief Turn the AOVs into bitmap layers (one per AOV)
+     *
+     * This entails averaging over the samples of every pixel and
+     * discarding the border region.
+     */
+    std::vector<BitmapLayer> toAOVLayers() const;
 
     /// Record a sample with the given position and radiance value
     void put(const Point2f &pos, const Color3f &value);
 
+    /// Record a sample with the given position, radiance value and surface AOVs
+    void put(const Point2f &pos, const Color3f &value, const AOVRecord &aovs);
+
     /**
      * \brief Merge another image block into this one
      *
@@ -105,6 +136,13 @@ protected:
     float *m_weightsY = nullptr;
     float m_lookupFactor = 0;
     mutable std::mutex m_mutex;
+
+    /* AOVs: per pixel (including the border), a sample count followed
+       by the sums of all AOVs at their offsets */
+    std::vector<EAOVType> m_aovTypes;
+    std::vector<int> m_aovOffsets;
+    int m_aovStride = 0;
+    std::vector<float> m_aovData;
 };
 
 /**
@@ -135,6 +173,15 @@ public:
      */
     bool next(ImageBlock &block);
 
+    /**
+     * \brief Return the next block to be rendered along with its index
+     * in the spiral order
+     *
+     * The index does not depend on thread scheduling and can be used
+     * to merge blocks in a fixed order, see \ref OrderedBlockMerger.
+     */
+    bool next(ImageBlock &block, int &index);
+
     /// Return the total number of blocks
     int getBlockCount() const { return m_blocksLeft; }
 
@@ -154,4 +201,28 @@ protected:
     std::mutex m_mutex;
 };
 
+/**
+ * \brief Merges rendered image blocks into a target block in index order
+ *
+ * Floating point accumulation of overlapping block borders is order
+ * dependent. Blocks finishing out of order are held back until all of
+ * their predecessors have been merged, so the merged result is identical
+ * regardless of thread count and scheduling.
+ */
+class OrderedBlockMerger {
+public:
+    explicit OrderedBlockMerger(ImageBlock &target) : m_target(target) { }
+
+    /// Submit the block with the given index and merge all blocks that became ready
+    void put(int index, std::unique_ptr<ImageBlock> block);
+
+    /// Restart the index sequence at zero (e.g. for the next progressive pass)
+    void reset();
+protected:
+    ImageBlock &m_target;
+    std::map<int, std::unique_ptr<ImageBlock>> m_pending;
+    int m_next = 0;
+    std::mutex m_mutex;
+};
+
 NORI_NAMESPACE_END
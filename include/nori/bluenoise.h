@@ -0,0 +1,305 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Tileable blue-noise mask for screen-space sample decorrelation
+*/
+
+#pragma once
+
+#include <nori/vector.h>
+#include <nori/qmc.h>
+
+NORI_NAMESPACE_BEGIN
+
+/// Side length of the (square, toroidally tileable) blue-noise mask
+static constexpr int BlueNoiseResolution = 64;
+
+/**
+ * \brief 64x64 blue-noise rank mask
+ *
+ * Each entry holds the rank 0..4095 of its texel, so thresholding the mask
+ * at any level yields an evenly spread point set. The table was produced
+ * offline with the void-and-cluster method (Ulichney 1993) using a
+ * toroidal Gaussian energy kernel with sigma = 1.9.
+ */
+static const uint16_t BlueNoiseMask[BlueNoiseResolution * BlueNoiseResolution] = {
+    2789, 1931, 3041,   98, 1485, 2847,  404, 1382, 1885, 2231,  276,  816, 3725, 1149, 3455,  189,
+    2476,  545, 2766,  854, 2250, 3116,  744,  180, 3260, 2307,  628, 3624, 2623, 2387,  396, 3731,
+    3087, 2058,  423, 1741, 3771,  534, 3898, 2180, 1221,   60, 1578,  468, 3111, 1255,   87, 1605,
+     576, 2890, 3557, 3951, 2537, 3065, 1817, 3663, 3406, 2015, 4003, 3271, 2676, 1099, 2068, 2506,
+     442, 3946, 2382,  605, 1742, 2491,  904, 3083, 2615, 3824, 1051, 2866, 3171, 1610, 1877,  772,
+    2988, 1039, 2026, 3569,    9, 1196, 1762, 3510, 1043, 2960, 1818,   82, 1406, 3492, 1683, 2918,
+     862, 1302, 3501, 1014, 2748, 1993, 1499,  325, 2934, 3250, 3842, 1070, 1833, 2732, 2351, 3237,
+    3819, 1878, 2312,  739, 1496,  478, 2160, 1160,  294, 1009, 2484,  680, 1339, 3590,   71, 3735,
+    1437, 3208, 1011, 3667, 3387, 2018, 1161, 3615,   21, 3248, 1756,  493, 2567,   73, 3835, 2192,
+    1416, 3926, 3282, 1544, 2631, 3983, 2045, 2426,  443, 1574, 3880, 3107, 2080, 1024,  653, 2222,
+    1504, 2542, 3284, 2261,  208, 3084, 1103, 3424, 2658,  800, 2051, 2541, 3511, 3753,  308, 1010,
+    2603, 1188,  114, 3212,  984, 3868, 3290, 2663, 1573, 2902, 2216,  150, 1907, 3104, 2284,  837,
+    1831,  293, 2143, 1309, 2920,  232, 4066, 1619,  718, 2404, 1442, 3525, 1997, 1285, 3375, 2688,
+     388, 2400,  231, 1892,  503, 3362, 1368, 3744, 2784,  873, 1251, 2494,  315, 4068, 3345, 3806,
+     191,  544, 3943,  769, 1644, 3632,  660, 2334, 1747, 3697,  223,  565, 1433,  733, 1722, 4065,
+     445, 2142, 3477, 2753, 1693, 2394,   30, 3778,  595, 3162, 3481, 3860,  965, 2879, 1604, 3421,
+    1172, 2747, 2524, 3884,  822,  509, 2702, 2173, 2977,  370, 3934,  833, 2303, 3075,  578,  909,
+    1688, 3671, 1171, 3031,  957, 2873,  665,  264, 3197, 2270, 3687,  559, 2854, 1898, 2667, 1155,
+    1759, 2799, 1945, 2974, 1207, 2527, 4085,  417, 1371,  964, 3068, 2290, 2913, 3357, 2003, 2841,
+    1403, 3045,  641, 1967, 1299, 2983,  857, 2061, 1855, 1216,  357, 1733, 2613,  222,  600, 4043,
+    3020,  704,   50, 1691, 3285, 2338, 1413, 3474, 1867, 1201, 2752, 3689,  263, 1098, 4077, 2872,
+    2118, 3203,  740, 3881, 2230, 2535, 1636, 1115, 1916,  123, 1707, 3299, 1502,  912,   41, 2350,
+    3194, 3654,  278, 1412, 3342,   47, 2072, 2807, 3222, 1940, 3873, 1617, 1185,   19, 2493,  841,
+    3574, 1597, 3715,  250, 4016,  437, 3602, 1410, 2469, 4083,  814, 1464, 3665, 3301, 2422, 2002,
+    3764, 3495, 1470, 3090, 1938, 1086, 3736,  112,  961, 3311, 2092, 1587, 2640, 1847, 1466, 3584,
+      86, 1340, 2481, 1769,  131, 3577, 3803, 2140, 3996, 2602, 3534,  754, 2120, 3097, 3585, 1349,
+     713, 2154,  989, 2416, 3777, 1709,  827, 3496, 1142,  134, 2698, 3564,  434, 3945, 3207, 2219,
+     197, 1031, 2441, 3326, 2260, 1117, 2634, 3403,  194, 3024, 2788, 2356, 2095, 1295, 1032,  384,
+    2597, 2233,  920, 3659,  333, 2852,  648, 2584, 4011,  553, 3123,  154,  697, 3458, 2440,  358,
+    1929, 2739,  558, 3437, 1486,  334, 3086,  825, 1420, 2981,  405, 1197, 3954, 2449,  467, 1655,
+    2897, 4028,  412, 2720,  597, 3147, 2242, 1531, 3959,  587, 2450, 2139,  921, 1874, 1338,  589,
+    3836, 2678, 1834,  776, 1512, 2893, 1758,  689, 2201, 1050, 3553,  487,  716, 3822, 2838, 1558,
+    1871,  530, 1269, 2412, 3944, 2114, 1523, 3027, 1731, 2375, 1364, 3875, 2912, 2165,  968, 3259,
+    3733,  835, 4021, 2947, 2041, 1242, 2726,  575, 3422, 1027, 2315, 2756,  221, 1839, 3756, 1065,
+    3386, 1873, 1493, 3507, 1981, 1061,  247, 2580, 2995, 1804,  777, 1473, 3122, 2745, 3432, 1649,
+    2953, 1227, 3168,  486, 3747,   81, 3244, 3927,  408, 1639, 1923, 3235,   14, 1770, 3121,  267,
+    4020, 3341, 2764,  166, 1755,  808, 3390, 1181,  280, 1971,  870, 3603, 1151, 1666,  527, 3008,
+    1208, 1589, 2210, 1038,  452, 3286, 1830, 2451,   22, 1660, 1999, 3807, 1430, 2944,  642, 2651,
+     142, 2475,  866, 3887, 1294, 2883, 3817,  407, 1316, 3633, 3336,  254, 3767, 1095,  147, 2363,
+    2039,  351, 3939, 2147, 2562,  926, 1987, 1249, 3078, 3693, 2577, 1187, 3957, 2220, 3427,  817,
+    2103, 2970, 1094, 3575, 3202,  477, 2483, 3634, 3827, 2785,  436, 2540, 3355,   15, 3995, 2319,
+    2574,  322, 3187, 2654, 3672,  891, 2182, 3549, 4094, 3131,  683, 3315,  934, 3483, 2236, 1243,
+    3234,  332, 3057, 2296,   75, 1790, 3428, 2388,  970, 1995, 2843, 2232,  525, 2548, 4054,  753,
+    3644,  979, 2779, 1363, 1658, 3551, 2341, 2751, 1454,  136,  902, 2930, 1492, 2687, 1004, 1376,
+      77,  671, 1577, 1998, 2645, 1391, 2221,   84,  985, 3177, 2185, 1459, 1829, 2815, 1985, 1397,
+     700, 3847, 1711,   78, 1362, 3906, 1540,  281, 2823, 1281, 2525,  160, 1606,  378, 1976, 3903,
+    1720, 3714, 2073,  636, 3288, 2653,  761, 1642, 3166,   90, 3991, 1226, 1736, 3029, 1948, 1513,
+    3257,   42, 3493,  676, 3037,  210,  557, 3784,  774, 2128, 3447, 2378,  570,  227, 3595, 2515,
+    3844, 2354, 3705,  320,  933, 4091, 2941, 1899, 1641, 3480,  644, 3931,  260,  811, 3688, 3295,
+     213, 3526, 1913, 2435, 2906,  590, 2370, 1136,  805, 1799, 2134, 3592, 2700, 3080, 2419,  796,
+    1414, 2755, 1008, 1583, 1164, 4062,  475, 2183, 3757,  629, 1562, 2681,  884, 3535,  292, 1276,
+    2495, 1723, 2258, 1925, 4045, 1178, 3335, 1780, 2517, 3984,  310, 1677, 3799, 2011, 3079, 1735,
+    2712, 3291, 1287, 3126, 1718,  579, 3331, 1270,  326, 2665, 1089, 3000, 2454, 1250, 3074,  981,
+    2130, 2798, 1121,  752, 3410, 2066, 3048, 3790, 3256,  455, 3863, 1023,  603, 4041, 1126,   65,
+    3578,  497, 2502, 2957, 3514, 2017, 1375, 3026, 1109, 2519, 3461,  354, 3236, 2318,  657, 2833,
+    3908, 3124, 1079,  415, 2657, 1542, 2868,  360, 1102, 1944, 3161, 1283, 3322,  748, 1147,  466,
+    1914,  799,  146, 2237, 2864, 3732,  768, 2410, 3973, 2098, 1517, 3760,  479, 2224, 1634, 2669,
+     453, 1497, 3127, 3987,  366, 1675,  139, 1897, 2621, 1500, 2964, 2328, 1334, 1771, 3372, 2896,
+    2177, 3193, 3961,  126,  397, 2414, 3685,  277, 2816, 1891, 1350, 2106, 3891, 1044, 3683, 2046,
+     215,  864, 3419, 2417, 3677,  813, 2209, 3089, 3563,  631, 2638,  958, 2806, 2188, 3988, 1524,
+    3499, 1035, 3936, 2585, 2048, 1152,  399, 2770, 3139,   49,  848, 1904, 3339, 3616,  122, 4074,
+    1806, 3708, 2283,  907, 1323, 2721, 3570,  645,  973, 3425,   54, 2014, 3723,  246, 2588, 1924,
+     694, 1645, 1272, 1879,  847, 2707, 1743,  941, 3220, 3841,  794,   12, 2909, 1815, 1478, 2610,
+     566, 1613, 2914, 1336,  104, 2034, 3839, 1359,  172, 2316, 1508, 3716,   46, 2457,  355, 2921,
+    2331,  561, 1449, 3622,  255, 1608, 3467, 1379, 1751, 3561, 2381, 2858, 1331,  687, 2516, 1158,
+    3436,  618,   32, 2559, 3306, 3762, 1157, 2463, 2247, 3967,  402, 2822, 3180,  887, 1458,  356,
+    3854,  974, 2347, 3770, 3071, 1474, 3444,  144, 2309,  522, 1648, 2461, 3129,  414, 1229, 3348,
+    3792, 2146, 4001, 1800,  654, 3279,  992, 2704, 1695, 4076, 2948,  506, 1836, 3617, 1313, 3219,
+    2060, 2810, 1792, 3061,  875, 2480, 3859, 2259,  954,  615, 3826,  367, 1670, 3112,  924, 2028,
+    2871, 1389, 3019, 1927, 2167, 1568,  251, 3109, 1370, 1734,  767, 1191, 1625, 3566, 2402, 3034,
+    3423, 2637,  240, 3300, 2090,  668, 4007, 1264, 1982, 3601, 2690, 4090,  932, 3517, 2287,  129,
+    3046, 1127,  343, 2730, 3589, 2464,  470, 1905, 3214,  844, 1166, 2075, 3366, 1618,  900,  199,
+    3686, 1177,    2, 3393, 1952,  524, 3224,  158, 2023, 2991, 1194, 2625, 2163, 3904,  237, 3263,
+    2367,  377, 3937, 1059,  719,  488, 4061, 2903, 2054, 3666, 3318, 2641, 2157,  516, 4014, 1134,
+    2043, 1395,  568, 2797, 1112,  425, 2514, 2916, 3365, 1084, 1421, 2162,  616, 1603, 2760,  745,
+    1852, 2359,  918, 3146, 1498, 1204, 3941,  275, 3450, 2544,  127, 3874, 3033,  643, 2605, 4049,
+    1662,  756, 2668, 3963, 1317, 2911, 1101, 2694, 4060, 1520, 3320,  108, 3527, 1863, 2754, 1565,
+     765, 3612, 1692, 3465, 2814, 3241, 1838,  883,  192,  563, 2364, 3900,  128, 1846,  743, 2771,
+       4, 3702, 1820, 3571, 1571, 3849, 2199, 1708,  742,  353, 2862,  216, 3184, 2006, 3938, 3607,
+    1361, 2595, 3722,   24, 2067, 2932, 2262, 1599, 2828,  690, 2207, 1411, 2735, 1067, 2244, 3106,
+     482, 3293, 2392,  346, 2193, 1699,  727, 3439, 1819,  471, 2438,  812, 1047, 1378,  498, 3748,
+    1233, 2102, 2636,  168, 2344, 1263, 2543, 3537, 1118, 2768, 1511,  977, 2965, 1328, 3294, 2248,
+    1678,  908, 3007, 2293,  193, 3201,  991,   52, 3110, 3805, 1813, 3661, 1274, 2444, 1029,  286,
+    3240,  520, 1659, 3359,  806,  594, 3523, 1017, 1282, 3758, 1748, 3587,  389, 1912,  243, 1374,
+    2029, 3783, 1041, 1521, 3532, 3766, 2531,  269, 1280, 3678, 2053, 2846, 3958, 2285, 3360, 2526,
+      62, 3144,  939, 1468, 3878,  313, 1616, 2215, 3853, 1951, 3151,  337, 3478, 2530, 3749,  390,
+    3156, 3982,  682, 2589, 1304, 1954, 3619, 2684, 1481, 2317, 2576,  846, 3412,   59, 2989, 1535,
+    2124, 2842, 4063, 1894, 2497, 3843,  164, 3063, 1994,  342, 2477,  922, 3145, 3915, 3485, 2532,
+     880, 1824, 2849,  625,  103, 3102,  940, 2310, 3018,  693, 3239, 1598,  314, 2997,  663, 1737,
+    4009, 2917, 1875,  574, 3640, 2954,  746, 3363,   27, 1306, 3638, 1721,  626, 1974, 1026, 1475,
+    2460, 1219,  319, 3430, 2940,  802,  473, 4048, 1213, 2031,  424, 3953, 1673,  592, 1901, 3840,
+     708, 1184,  359,  980, 1351, 2725, 1717, 2362, 4035, 3275, 2898,  606, 1533, 2324, 1199, 2928,
+     196, 3154, 4032, 2127, 1218, 2722, 1975, 1424, 3992,   26, 2661, 1190, 1910, 3653,  910, 2184,
+    1148,  290, 3429, 2291, 2010, 1054, 2695,  500, 3059, 2490,  804, 2298, 2731, 4086,  171, 2877,
+    3554, 1890, 2138, 1538, 3918, 1726, 2409, 3401,  664, 3258, 1042, 2933, 2234, 2703, 3328, 2529,
+    3544, 2286, 3070, 3648, 2166, 3209,  458,  859, 1483,   37, 1128, 1862, 3389,  102,  703, 3645,
+    1427,  410, 2428, 1623, 3354, 3879,  517, 3509, 1674, 2189,  993, 3793, 2420,  140, 3188, 1501,
+    2793, 3828,  785, 1348, 3205, 4047, 1761, 2122, 1528, 3969,  258, 1146, 3255, 1575, 2197,  819,
+     518, 3800,  975,   67, 2749, 1092, 2164,  212, 2795, 1622,  133, 3512, 1429, 1153,  338,  906,
+    1402,  101, 2670, 1543,  209, 3738, 1222, 3446, 2590, 2156, 3684, 2774, 3981, 2055, 1668, 2660,
+    2205, 1085, 3573,  755,  291, 1849,  863, 2473,  348, 3332, 2924,  451, 3408, 1333, 2628, 1980,
+     491, 2384, 1643, 2643,  386,   94, 1245, 3530,  930, 2869, 1883, 3681,  492, 3002, 1279, 3383,
+    2633, 3056, 2330, 3287,  583, 3547, 1392, 3069, 1869, 3713, 2466,  730, 2082, 3745, 3130, 1784,
+    3978, 1988, 3391,  771, 1845,  610, 2951, 1939, 3897,  717, 1354,  462, 2429, 1001, 3025, 3833,
+    1785, 3243, 2796, 1341, 2592, 2962, 3216, 1141, 3818, 1949,  779, 1530, 1798,  637, 4093, 3576,
+     190, 3296, 3694,  990, 3011, 2462, 3785,  650, 2368, 3317, 1393, 2582, 2050,   48, 3895, 1822,
+    1628,  214, 1357, 1972, 3734, 2538,  347, 3890,  917, 1253, 3010, 4031,  507, 2825,  157, 2374,
+     602, 2901, 1060, 2423, 4019, 2790, 2304, 1034,  219, 3036, 1750, 3227,  274, 1293, 3350,  541,
+     898, 3964, 2022,   34, 3690, 2243, 1488,  156, 2803, 1312, 2564, 3916, 2299, 3035, 1083,  853,
+    2892, 1827,  624, 2086, 1418, 3404, 1865, 2738,  419,  185, 3821,  741, 1012, 3567, 2289,  684,
+    1081, 4024, 2839,  872, 1767, 3172,  760, 2096, 2656,  400, 2301, 1714, 1007, 1928, 3448, 1223,
+    1620, 3223,  438, 3568, 1337, 1652,  376, 3292, 1514, 3598, 2715, 2254,  766, 3662, 2560,  137,
+    2339, 2986,  620, 1679,  997, 4071,  658, 2094, 3646,  551, 3141,   64, 3516,  289, 2133, 2508,
+    1467, 1210, 3108, 4004,  303,  830, 2226, 1077, 1627, 2978, 2195, 1777, 3185, 2800,  371, 2505,
+    3117, 3519,  306, 2413, 1202,   92, 1614, 3302, 1453, 3631,   29, 3376, 1503, 2492, 3901,  829,
+    3637, 2594, 2158,    6, 3100,  845, 3871, 2062, 2499,  546,  947, 4092, 1609, 2865, 1937, 1479,
+     340, 1205, 3515, 2439,  448, 3370, 1797, 3053, 2343, 1704, 1013, 2037, 1239, 2836, 1653, 3379,
+    3888,   13, 2313, 2708, 1700, 2929, 3597, 3226, 3914, 1262, 3479,  536, 1546, 1193, 3786, 1957,
+    1461, 2123,  622, 3832, 2992, 2218, 4070, 2851,  599, 1941, 3101,  790, 2733,  299, 3044, 2093,
+     211, 1407, 3942, 1920, 1130, 3471, 2618,  152, 1259, 1880, 3377,   88, 2099, 1097, 3877, 3433,
+    2677, 2107, 3813, 1404, 2882, 2624, 1189,  890,  245, 4008, 3266, 2644,  815, 3769,  598,  373,
+    1919, 3611, 1057,  521, 3796,  202, 1482,  569, 2063,   85, 2648, 4044, 2358,  823, 3344,   99,
+    2716,  967, 3405, 1522, 2617,  459, 3540,  943, 2398, 1159, 3960, 2152, 3680, 1344,  640, 1801,
+    2876,  982,  577, 2762, 2323, 1740,  670, 3669, 2967, 3837, 2365, 1383, 3073,  432,  679, 3164,
+    1809,  170,  803, 3265, 1903,   97, 3845, 3494, 2488, 1518,  411, 3605, 1857, 1388, 3150, 2689,
+    2202,  722, 3229, 2470, 1961, 1235, 2581,  780, 2415, 1851,  960, 3095,  259, 2925, 1744, 1311,
+    3989,  413, 1858, 3230, 1064, 2009, 1342,  165, 3397, 1808, 2579,  446, 1056, 3245, 2340, 3810,
+    3396, 1563, 3703, 3038,  241, 1447, 3174, 2159, 1069,  798,  300, 2692, 3538, 1680, 2486,  956,
+    3642, 1554, 3058, 1066, 2191,  382, 1612, 2782, 1318,  677, 2946, 2249,  195, 2411, 4025,  935,
+    2980, 1314, 1594, 3452,  901, 3092, 3968, 2884, 3698, 3378,  456, 1435, 2001, 3635, 2586,  711,
+    3556, 2200, 2831,  135,  696, 3730, 1712, 2776, 3851,  256, 1422, 2952, 1681,  105, 2652, 1174,
+     398, 2214, 2504,  793, 3364, 4051,  450, 2783, 1560, 1793, 3247,  617, 3775, 2223, 1267, 4034,
+    2321, 2767,  535, 3998, 2401, 3655,  763, 2111, 3325, 1958, 1048, 3850, 1624, 3462, 1154,  107,
+    1773, 3704,  261, 2829, 2135,   70, 1745,  344, 1555, 1170, 2792, 3825, 2256, 1075,  504, 3175,
+    2427, 1156, 1654, 3909, 2325, 3081, 2507,  826, 2084, 3186,  678, 3798, 3426, 2000, 4082,  818,
+    3128,   68, 1727, 1273, 2033, 1018, 2433,   56, 3604, 3930, 2510, 1135, 1906,   25, 2959,  317,
+    2030,  725, 3418, 1725, 1347, 2973, 3173,  472, 3947,   74, 2717, 3125,  731,  447, 2593, 2040,
+    3337, 2342,  469, 4067, 1385, 3548, 2308,  999, 3169, 2155,  698, 3468,   39, 1661, 3928, 1950,
+     203, 3017,  865, 3456, 1426,  296, 3351,  494, 1119, 1596, 2379,  949, 2245,  573, 1401, 1826,
+    2804, 3582, 3886,  537, 2662, 3759, 1888, 1327, 2935,  501, 2074, 1456, 2777,  882, 3340, 1436,
+    3572, 1183,  132, 2520,  330,  966, 1853, 1163, 2337, 3591, 1765, 1277, 2174, 2886, 1455, 3933,
+     612, 2680, 1120, 1896,  758, 3273,  581, 3870, 2612,  177, 1802, 2513,  894, 3303, 2840, 1353,
+    1550, 3815,  533, 2547, 1908, 1206, 2190, 2963, 3990, 3498, 2675, 2888,  169, 3628, 2555, 3323,
+    1022, 2081, 1480, 2999,  273, 3199,  834, 3415, 2252,  972,  173, 3508, 3039, 3856,  483, 2565,
+    3902, 2894, 1918, 3801, 3358, 2679, 3718, 1561, 2578,  297,  571, 3407,  927, 3751, 3204, 1694,
+     861, 3060, 3816, 1549, 2511, 2765, 1214, 1989, 3643, 1373, 2955, 4084, 1266, 2346,  352,  791,
+    3650, 2052, 2742,   76, 4058,  942, 3706, 1687,   10, 1332,  374, 1872, 1211, 1579, 2972,  229,
+     463, 2396,  732, 3476, 1179, 2178, 1615,  633, 2705, 3138, 4036, 1650,  686, 2168, 1781, 1002,
+    1564, 3114,  885, 1477, 2076,    3,  613, 2915,  876, 1434, 4080, 2391, 1942,  204,  395, 2487,
+    1297,   57, 3420, 2186,  217,  418, 3032, 1607,  849,  312, 3215,  538, 2024, 3729, 3054, 2639,
+    2240, 1036, 3338, 1763, 3178, 2834,  627, 2622, 1962,  775, 3763, 3085, 3923,  879, 2198, 3750,
+    1291, 3956, 2763, 1841, 2521, 4006,  110, 3565, 1775, 1231, 2568,  266, 2390, 1292, 3189,  235,
+     619, 2246,  440, 2791, 1246, 2295, 3892, 3472, 2148, 3261, 2993, 2630, 1569, 1140, 3505, 2227,
+    3652, 2008,  995, 2949, 3709, 1796, 3962, 2406, 3438, 2203, 2727,  988, 1559,  159, 1821,  582,
+    3488,  252, 1288,  734, 2297,  368, 1444, 3579, 2361, 3252, 2145,  511, 2465, 3457,  685, 1970,
+    1667, 3115,  161,  953,  391, 2878, 1381, 2360,  321, 3765, 1983,  842, 3442, 3691, 2674, 2064,
+    3312, 2430, 3491, 3980,  738, 3190, 1664,  220, 1902, 1090,  726,  117, 3858, 3076, 2736,  737,
+    1779, 2830,  529, 1440,  786, 3334, 1063,    5,  659, 1753, 3889, 2448, 3581, 3262, 1192, 3993,
+    1489, 2891, 2446, 3679, 1576, 2049, 3371,  239,  978, 2848, 1510, 1096, 1757,  304, 3183, 2620,
+    1105, 3522, 2302, 1586, 3246, 3811, 2071, 3004, 1015, 3280, 1526,  435, 2855, 1076,   66, 4078,
+    1697, 1144,  307, 1811, 2976, 1028, 2468, 1352, 2772,  379, 3707, 1805, 2100,  514, 1380, 3905,
+     288, 3251, 4010, 2345, 2647, 2105, 1315, 2845, 3739, 1438, 1129,  422, 2125,  705, 2561,  913,
+    1935, 3143,  480, 3950, 1106, 2971, 3852, 1240, 1814, 4038,  118, 3385, 2724, 1356, 4017,   33,
+    2927,  532, 3700, 1990,  672, 1133,  465, 3639,  714, 2778, 3917, 2238, 3093, 1876, 1423,  783,
+    3599, 2723, 1400, 3682,  149, 1986,  489, 3543, 4005, 2320, 1248, 3313,  871, 3434, 2372, 1053,
+    2556, 1580, 1169,  116, 3562,  461, 3170, 1893, 2546, 3307, 3015,   95, 2805, 1690, 2968, 3814,
+      28, 2149, 1706, 2606,  153,  792, 2408,  542, 3096, 2534,  724, 3719, 2322,  905, 1881, 2228,
+    1505,  869, 2570, 1335, 3435, 2683, 1812, 1494, 2471,   11, 1175, 1719,  591, 3797, 2500, 2966,
+     121,  944, 2171, 2553, 3264, 3812, 2666,  701, 3119, 1638, 2936, 2518, 1487, 2857,   20, 1977,
+    3727,  604, 3028, 1943, 1657,  915, 4056,  233,  555,  893, 1984, 3475, 4030, 1387, 2280,  363,
+    3374, 1252,  662, 3536, 3268, 1911, 2744, 3630, 1394, 2079,  339, 1582, 3001, 3593,  608, 3830,
+    3369,  365, 3979, 2853,   80, 2281, 4069,  895, 3152, 2137, 3497, 2642,  931, 3380,  387, 2019,
+    3894, 3099,  580, 1593,  831, 1225, 1536, 2187,  950,   91,  567, 3629,  323, 4040, 1738, 3163,
+     899, 2217, 3411, 2781, 3820, 2443, 1484, 2172, 3586, 1591, 2353, 1268,  821,  515, 3627, 1062,
+    2509, 3752, 2835, 1451, 1005, 2204, 1602,   45,  914, 3896, 3211, 1176, 1991,  181, 2780, 1234,
+    2482, 1828, 2116, 1045, 1698, 3042,  238, 3382, 1886,  350, 1367, 3994,  176, 1590, 2288, 1265,
+    2812, 3361, 1887, 4050, 2333, 2919,  385, 3384, 3921, 2057, 1861, 1073, 2253,  712, 1230, 3600,
+    2672,  201, 1365,  735,  316, 3120, 1215, 2956, 2697, 3935,  309, 3200, 2607, 1864, 3094, 1566,
+    2007,  856, 2314,  225, 3047, 3972,  428, 3416, 2895, 2251, 1783, 2635,  481, 3298, 1003, 1671,
+    3098,  141, 3225,  782, 3846,  586, 1298, 2558, 3728,  623, 2376, 2931, 1968, 3134, 3668,  723,
+    2421,  230, 1107,  449, 3614,   40, 1791, 2786, 1377, 2569, 3191, 3823, 2729, 3043, 2089,  381,
+    1516, 3975, 1825, 1074, 2267, 3506,  639,  109, 1020, 1787,  673, 3834, 2119,  244, 2728, 3297,
+     124, 4073, 1746,  550, 3651, 1275, 1840, 2573, 1111,  601, 3552,  820, 4095, 2437, 2097, 3761,
+     681, 1417, 3658, 2386, 3513, 1556, 2056, 1088, 2824, 1611, 3550,  787, 1145, 2693,  499, 1462,
+    2115, 1730, 3502, 2629, 2005, 3155, 3773, 1124,  257, 3533,  788, 1284,  187, 1588, 3490, 2489,
+     549, 2880, 3673, 3324, 2609, 1724, 2044, 3755, 3272, 2479, 1173, 2899, 1452,  937, 3772,  692,
+    1319, 2943, 2611, 3218, 2059, 2434,  720, 3788, 3276, 1491,  236, 2850, 1296, 1529, 3489,  406,
+    2889, 2616, 1167,  272, 2710, 2945, 3309,  431, 3920,  959, 2087,  298, 3327, 1803, 4029,  996,
+    3016, 3743, 1303,  695, 1445,  916, 2442,  666, 2263, 2961,  430, 1749, 2399, 3717,  951, 3278,
+    1165, 2336, 2016,   43,  490, 3925, 1326, 2827,  441, 1959, 3413,   36, 2275, 3503, 1768, 2418,
+     393, 3531, 1091, 1506,  305,  952, 3003,  183, 1696, 2369, 3711, 1930, 3088,   17, 2292,  928,
+    3971, 1960, 2206,  513, 1856,  851, 2329,   61, 1764, 3149, 2474, 3808, 1329,   35, 2539, 3242,
+     840,  113, 2826, 2208, 2984, 3453, 1651, 3907, 1932, 1476, 4057, 3373, 2021,  634,   83, 2958,
+    1682,  747, 3158,  938, 1581, 3049,  797, 2305, 1534,  874, 3674, 1676,  547, 2996, 1132, 3899,
+    2169, 1921,  770, 3867, 3347, 2773, 4039, 2151, 1325, 2734,  454, 1037, 3919,  709, 1816, 3012,
+     198, 1632, 3464, 3787, 1472, 4000, 1258, 3656, 2649, 1425,  556, 2990, 2269, 3610, 1553,  361,
+    3911, 2377, 1631, 4012,  284,  505, 2691,  111, 3232,  881, 2743, 1046, 2557, 3861, 1450, 1947,
+    4027,  324, 3742, 2737, 1182, 2455, 3621,  282, 4088, 2673, 3105, 1307, 3974, 2598,  175, 1557,
+    3157, 2860,    8, 2294, 1656, 1200, 1934,  585, 3135,  850, 3402, 2085, 2512, 3310, 2718, 1390,
+    1125, 3281,  729, 3118, 1019,  234, 3055, 2141,  762, 3470,  163, 1104, 1884,  651, 2787, 2025,
+    3449,  596, 1049, 3289, 1212, 2110, 3657, 1290, 2389,  552, 2121,  218, 3133, 1254, 2775, 2271,
+    3459, 2554, 1369, 2132, 3431, 1926,  125, 3228, 1113, 2129,  329, 2393,  764, 1868, 3283,  502,
+     919, 1384, 3746, 2587,  485, 3473,  100, 3626, 2545, 3883,  145, 1585, 1217,  543, 3809, 3588,
+    2397,  426, 2552, 2811, 2035, 2456, 3417,  457, 1917, 4075, 1600, 2861, 3866, 3395,  969, 1278,
+    1778, 2699, 3696, 1909, 2549, 3062,  987, 1823, 3409, 3776, 2987, 1672,  403, 3606,  801,  512,
+    1071,  151, 1795,  433, 3985,  630, 2950, 1398, 1807,  667, 3356, 2870, 1055, 2091, 3482, 2713,
+    2452, 3596,  675, 1772, 2979,  886, 1463, 2276, 1108, 1810, 2875, 3559, 2239,  328, 1685, 2042,
+     832, 4059, 1343,  106, 1705,  652, 1541, 2740, 1162, 2311, 3217,  877, 2131,  427, 2501, 3113,
+     148,  394, 1495,  781,   23, 3862,  638, 2874,  174, 1525, 1168, 3940, 2332, 1848, 3249, 1551,
+    3794, 3067, 3333, 2859,  878, 1647, 2277, 3528, 2523, 3781, 1552,   72, 3855, 1409,  242, 4023,
+    1220, 1969,  283, 3213, 3977, 2047, 2714, 3270,  706,  311, 1345, 3072,  923, 2608, 3167,  162,
+    2922, 1842, 2268, 3195, 3545, 3932, 2937,  925, 3712,  318, 2571, 1754,  205, 1469, 3754, 2273,
+    1992, 3541, 2926, 2326, 3238, 1702, 1408, 2472, 2013,  749, 2646, 3451,  945,    1, 2923, 2069,
+    2447,  707, 2213, 1137, 2632, 3720,  345,  976, 2817,  464, 1978, 3618, 3066, 2335,  635, 1640,
+    3030, 2211, 1058, 2407, 1300,  224, 3701, 1637, 3949, 2403, 2012, 3741,  647, 4002, 1443, 1040,
+    3398,  528, 3774, 1087,  336, 1271, 2194,   16, 3304, 1358,  632, 3952, 2706, 2998,  710, 1114,
+    3165, 1321, 4089,  963, 2078, 3521,  372, 3986, 3210, 3636,  484, 2176, 1439, 2522, 4079, 1289,
+     253, 1703, 3912, 1465,   38, 3196, 1256, 2083, 3948,  807, 1228, 2627,  936, 1789, 2820,  852,
+     349, 3329, 3869, 1570, 2885,  562, 1006, 3103,  421, 2650, 3353,   79, 1739, 2357, 2802, 3649,
+    2161, 1572, 2701,  868, 1964, 2626, 3804, 1837, 2432, 3023, 2004, 3560, 1232, 3321, 1684, 3893,
+     508, 2459,  674, 2794,  270, 1236, 2719, 2235, 1068, 1766,  249, 2856, 3308,  611, 3660,  897,
+    2746, 3539,  526, 1963, 3469, 2405, 1786, 3050,  130, 3254, 1689, 2225,  184, 3233, 3558, 3789,
+    1870, 2664,  120,  784, 3414, 2566, 2229, 1915, 1238,  867, 1507, 2942, 1116, 1936,  262,  736,
+    1260,   63, 3051, 2373, 3367, 1509,  519,  795, 3500, 1567, 1016,  474, 2385,   58,  903, 2614,
+    1519,  186, 1832, 3346, 1595, 3724,  560,  860, 3006, 1366, 3910, 1966, 1123, 1686,  331, 1922,
+    3176, 1033, 2599, 2985,  789, 4042,  609, 2682, 1415, 2371, 3487,  584, 4064, 1308,  439, 2496,
+    1025, 1428, 3676, 2101, 1760, 4081,   44, 3484, 2809, 3647, 2170,  540, 3460, 3791, 3231, 2572,
+    3913, 1794, 3583,  646, 3976,  206, 3136, 1139, 2761,  265, 3737, 2179, 2900, 1889, 3623, 2144,
+    3463, 3780, 2257, 1100, 3082, 2575, 1882, 3443,   55, 2424, 3137,  828, 2619, 3486, 3009, 2196,
+    3740,  167, 2306, 1324,  268, 1601, 1082, 3388,  327, 3831, 2904, 1110, 2769, 2104, 1527, 2282,
+    3159,  614, 2939,  429, 1150, 3192, 1419,  661, 1710,  207, 4022, 2498, 1322,  383, 1626,  946,
+    2274, 2881,  362, 1355, 1716, 2818, 2036, 2279, 4052, 1782, 3206,  757, 1372, 4015,  302, 2821,
+    1261, 2969,  824, 3929,  115, 2150, 1448, 4033, 2808, 1621,  523, 3768,  182, 2349, 1490,  721,
+    1203, 1629, 3349, 3848, 2070, 2844, 3675, 1859,  911, 2032, 1547,  271, 1850,  778, 3441,   69,
+    3999, 1965, 3524, 2355, 2759,  836, 2485, 3838, 3040, 1078, 3179,  773, 2757, 2088, 3077,  593,
+    3394, 1973, 1143, 3221, 2528,  962, 3625, 1301,  656, 2478,  119, 2659, 3368, 1630,  588, 1021,
+    3267, 1729,  392, 2445, 3580,  655,  998,  380, 2272, 1186, 3352, 2112, 1310, 3885,  460, 2863,
+    4013, 1835,  495,  892, 2458, 3181,  444, 2266, 2583,  715, 3546, 3132, 3876, 2601, 3014, 1198,
+    1715,  896, 1320,  179, 1592, 3695, 1956,  476, 2108, 2380, 1539, 1843,   18, 3882, 2348, 1457,
+     138, 4087,  759, 2153, 3829,   51, 3319,  369, 2994, 1515,  929, 3802, 1131, 3091, 2536, 1979,
+       7, 2696, 1471, 1996, 1286, 2907, 3795, 3160, 1953, 3692,  699, 2750, 1774,  994, 3253, 2503,
+      53, 2671, 3021, 3620, 1460,   93, 1224, 3922, 3005, 1330,   31, 2425,  971,  539, 3670,  295,
+    2837, 2551, 3864, 3052, 3399,  335, 1030, 2686, 1305,  279, 3782, 3305, 1000, 3520, 1195, 2832,
+    3613, 2604, 1584, 3013,  531, 2395, 1635, 1900, 3872, 3466, 2117, 1866,  401, 2300, 3857,  728,
+    3641, 4055, 3153,  510, 3400, 1776, 2655, 1532,  228,  948, 2550,   89, 3064, 3608, 1946,  838,
+    3542, 2126, 1093,  649, 1933, 2709, 3445,  607, 1732, 3314, 3726, 2181, 1669, 1441, 2027, 2327,
+    3274,  496, 2136,  688, 1844, 2278, 3997, 3277, 2982, 3609,  572, 2020, 2600, 1701,  691,  416,
+    1854, 1052,  226, 3721, 1396,  855, 2908, 1072, 2563,  548, 1244, 2813,  178, 3504, 1399, 2175,
+     285,  983, 2265, 2596, 1122,  188,  809, 2352, 3529, 2938, 1663, 4053, 1431,  364, 2264, 1257,
+    1537,  287, 3316, 2383, 4072, 1646,  986, 2109,  301, 2741, 1138,  420, 2867, 3955, 3392,  751,
+    1080, 1545, 3594, 1180, 2887, 1386,  143, 1665,  702,  955, 2819, 1405,  248, 2975, 3970, 2467,
+    3148, 2212, 3330, 2711, 2038, 3454, 4026, 2241,   96, 3140, 3699, 2366, 3022,  888, 1788, 2910,
+    1241, 1633,  750, 3555, 3865, 2113, 3269, 3965,  564, 1247, 3381, 2065, 2431,  621, 2801, 3966,
+    3142, 1752, 3779, 1346,  375, 2905, 3710, 2533, 1446, 4018, 1955,  839, 3182, 1237,  155, 1860,
+    2685, 4037,    0, 2436, 3198,  858, 2591, 3518, 1895, 2453, 4046, 2255, 3440,  843, 2077, 3664,
+    1360,  889,  341, 1728, 1209,  200,  669, 2758, 1432,  810, 1713,  409, 1548, 3924,  554, 3343
+};
+
+/**
+ * \brief Look up the blue-noise rotation of a pixel for one sample dimension
+ *
+ * The mask is tiled over the image plane; every dimension uses a different
+ * hashed toroidal offset so that the dimensions are mutually decorrelated.
+ */
+inline float blueNoiseRotation(const Point2i &pixel, uint32_t dim) {
+    constexpr uint32_t mask = BlueNoiseResolution - 1;
+    const uint32_t offset = hashValues(dim, 0xb1e5u);
+    /* wrap around in unsigned arithmetic, this also tiles negative pixel coordinates */
+    const uint32_t x = (static_cast<uint32_t>(pixel.x()) + offset) & mask;
+    const uint32_t y = (static_cast<uint32_t>(pixel.y()) + (offset >> 16)) & mask;
+    return (BlueNoiseMask[y * BlueNoiseResolution + x] + 0.5f)
+        * (1.f / (BlueNoiseResolution * BlueNoiseResolution));
+}
+
+/// Cranley-Patterson rotation of a sample value by the pixel's blue-noise value
+inline float applyBlueNoise(float value, const Point2i &pixel, uint32_t dim) {
+    const float rotated = value + blueNoiseRotation(pixel, dim);
+    return rotated < 1.f ? rotated : rotated - 1.f;
+}
+
+NORI_NAMESPACE_END
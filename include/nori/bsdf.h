@@ -27,6 +27,9 @@ struct BSDFQueryRecord {
     /// UV coordinates (for texture evaluation)
     Point2f uv;
 
+    /// Screen-space UV derivatives (texture footprint, zero if unknown)
+    Vector2f duvdx, duvdy;
+
     /// Measure associated with the sample
     EMeasure measure;
 
@@ -49,6 +49,21 @@ public:
     /// Build the BVH
     void build();
 
+    /**
+     * \brief Update the BVH after the vertex positions of the registered
+     * meshes have changed (e.g. for the next frame of an animation)
+     *
+     * The bounding boxes are refitted bottom-up in parallel while the
+     * topology is kept. Refitting degrades the tree when triangles move
+     * relative to each other, which is measured by the SAH cost of every
+     * subtree relative to the cost at the time it was built. Subtrees
+     * whose cost grew by more than \c rebuildThreshold are rebuilt, and
+     * the whole tree when the total cost grew by more than that.
+     *
+     * The number of triangles of the meshes must not change.
+     */
+    void refit(float rebuildThreshold = 1.5f);
+
     /**
      * \brief Intersect a ray against all triangle meshes registered
      * with the BVH
@@ -115,6 +130,9 @@ protected:
     /// Compute internal tree statistics
     std::pair<float, uint32_t> statistics(uint32_t index = 0) const;
 
+    /// Refit subtrees with more nodes than this in parallel
+    static constexpr uint32_t REFIT_GRAIN_SIZE = 4096;
+
     /* BVH node in 32 bytes */
     struct BVHNode {
         union {
@@ -154,11 +172,24 @@ protected:
             return leaf.start + leaf.size;
         }
     };
+    /**
+     * \brief Build a compact subtree over the triangles <tt>m_indices[start..end)</tt>
+     * (reordering them). Child indices are relative to the returned array.
+     */
+    std::vector<BVHNode> buildNodes(uint32_t start, uint32_t end, const BoundingBox3f &bbox);
+
+    /**
+     * \brief Compute the SAH costs of the subtree occupying the nodes
+     * <tt>[node_idx, end)</tt> and store them in \c costs (bottom-up).
+     * Optionally, the bounding boxes are recomputed first.
+     */
+    float updateSubtree(uint32_t node_idx, uint32_t end, bool refitBoxes, std::vector<float> &costs);
 private:
     std::vector<Mesh *> m_meshes;       ///< List of meshes registered with the BVH
     std::vector<uint32_t> m_meshOffset; ///< Index of the first triangle for each shape
     std::vector<BVHNode> m_nodes;       ///< BVH nodes
     std::vector<uint32_t> m_indices;    ///< Index references by BVH nodes
+    std::vector<float> m_nodeCost;      ///< SAH cost of each subtree when it was built
     BoundingBox3f m_bbox;               ///< Bounding box of the entire BVH
 };
 
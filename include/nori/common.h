@@ -107,10 +107,12 @@ typedef TRay<Point3f, Vector3f> Ray3f;
 /// Some more forward declarations
 class BSDF;
 class Bitmap;
+struct BitmapLayer;
 class BlockGenerator;
 class Camera;
 class ImageBlock;
 class Integrator;
+struct Intersection;
 class KDTree;
 class Emitter;
 struct EmitterQueryRecord;
@@ -120,6 +122,7 @@ class NoriObjectFactory;
 class NoriScreen;
 class PhaseFunction;
 class ReconstructionFilter;
+class RenderManager;
 class Sampler;
 class Scene;
 
@@ -182,6 +185,9 @@ enum EMeasure {
     EDiscrete
 };
 
+/// Largest float strictly smaller than one (keeps remapped samples inside [0, 1))
+static constexpr float OneMinusEpsilon = 0x1.fffffep-1f;
+
 //// Convert radians to degrees
 inline float radToDeg(float value) { return value * (180.0f / M_PI); }
 
@@ -183,4 +183,161 @@ private:
     bool m_normalized;
 };
 
+/**
+ * \brief Discrete probability distribution with constant-time sampling
+ *
+ * Implements Walker's alias method (using Vose's construction): the unit
+ * interval is split into one bucket per entry, and every bucket is shared
+ * between its own entry and at most one other entry (the alias). Sampling
+ * picks a bucket and then decides between the two entries, which requires
+ * no search in contrast to \ref DiscretePDF.
+ *
+ * \ingroup libcore
+ */
+class AliasTable {
+public:
+    /// Create an empty table
+    AliasTable() = default;
+
+    /// Build a table from the given (unnormalized) weights
+    explicit AliasTable(const std::vector<float> &weights) {
+        build(weights.data(), weights.size());
+    }
+
+    /**
+     * \brief Build the table from \c nEntries (unnormalized) weights
+     *
+     * Throws if no weight is positive, such a table couldn't be sampled.
+     *
+     * \return Sum of the weights
+     */
+    float build(const float *weights, size_t nEntries) {
+        double sum = 0.0;
+        for (size_t i = 0; i < nEntries; ++i)
+            sum += weights[i];
+        if (!(sum > 0.0))
+            throw NoriException("AliasTable: the weights must contain a positive entry!");
+
+        m_buckets.assign(nEntries, Bucket());
+        m_pdf.assign(nEntries, 0.0f);
+        m_sum = (float) sum;
+        m_normalization = (float) (1.0 / sum);
+
+        /* Scale the weights so that the average bucket is exactly full */
+        std::vector<double> scaled(nEntries);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < nEntries; ++i) {
+            m_pdf[i] = (float) (weights[i] / sum);
+            scaled[i] = weights[i] * (double) nEntries / sum;
+            (scaled[i] < 1.0 ? small : large).push_back((uint32_t) i);
+        }
+
+        /* Fill up underfull buckets with the excess of overfull ones */
+        while (!small.empty() && !large.empty()) {
+            const uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            m_buckets[s].threshold = (float) scaled[s];
+            m_buckets[s].alias = l;
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+
+        /* Remaining buckets are full up to round-off */
+        for (uint32_t i : small)
+            m_buckets[i] = Bucket{ 1.0f, i };
+        for (uint32_t i : large)
+            m_buckets[i] = Bucket{ 1.0f, i };
+
+        return m_sum;
+    }
+
+    /// Return the number of entries
+    size_t size() const {
+        return m_pdf.size();
+    }
+
+    /// Return the normalized probability of an entry
+    float operator[](size_t entry) const {
+        return m_pdf[entry];
+    }
+
+    /// Return the original (unnormalized) sum of all weights
+    float getSum() const {
+        return m_sum;
+    }
+
+    /// Return the normalization factor (i.e. the inverse of \ref getSum())
+    float getNormalization() const {
+        return m_normalization;
+    }
+
+    /**
+     * \brief %Transform a uniformly distributed sample to the stored distribution
+     *
+     * The original sample value is adjusted so that it can be "reused".
+     *
+     * \param[in, out] sampleValue
+     *     An uniformly distributed sample on [0,1]
+     * \return
+     *     The discrete index associated with the sample
+     */
+    size_t sampleReuse(float &sampleValue) const {
+        const size_t n = m_buckets.size();
+        const float scaled = sampleValue * (float) n;
+        const size_t bucket = std::min((size_t) scaled, n - 1);
+        const float offset = std::min(scaled - (float) bucket, OneMinusEpsilon);
+
+        const Bucket &b = m_buckets[bucket];
+        if (offset < b.threshold) {
+            sampleValue = offset / b.threshold;
+            return bucket;
+        }
+        sampleValue = std::min((offset - b.threshold) / (1.0f - b.threshold), OneMinusEpsilon);
+        return b.alias;
+    }
+
+    /// Like \ref sampleReuse(float &), but also return the probability of the sample
+    size_t sampleReuse(float &sampleValue, float &pdf) const {
+        size_t index = sampleReuse(sampleValue);
+        pdf = m_pdf[index];
+        return index;
+    }
+
+    /// %Transform a uniformly distributed sample to the stored distribution
+    size_t sample(float sampleValue) const {
+        return sampleReuse(sampleValue);
+    }
+
+    /// %Transform a uniformly distributed sample and return its probability
+    size_t sample(float sampleValue, float &pdf) const {
+        return sampleReuse(sampleValue, pdf);
+    }
+
+    /// Return the memory occupied by the table in bytes
+    size_t getMemoryUsage() const {
+        return m_buckets.size() * sizeof(Bucket) + m_pdf.size() * sizeof(float);
+    }
+
+    /**
+     * \brief Turn the underlying distribution into a
+     * human-readable string format
+     */
+    std::string toString() const {
+        return tfm::format("AliasTable[size=%i, sum=%f]", size(), m_sum);
+    }
+
+private:
+    struct Bucket {
+        float threshold = 1.0f;
+        uint32_t alias = 0;
+    };
+
+    std::vector<Bucket> m_buckets;
+    std::vector<float> m_pdf;
+    float m_sum = 0.0f, m_normalization = 0.0f;
+};
+
 NORI_NAMESPACE_END
@@ -0,0 +1,151 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Geometry instancing
+*/
+
+#pragma once
+
+#include <nori/bvh.h>
+#include <nori/transform.h>
+
+#include <memory>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Named collection of meshes that can be placed several times in
+ * the scene by \ref Instance objects
+ *
+ * The meshes are stored only once in a bottom-level BVH (in the local
+ * space of the group) which is shared by all instances. Shape groups
+ * don't render by themselves. Area lights are not supported inside
+ * shape groups, since emitters are sampled in world space.
+ */
+class ShapeGroup : public NoriObject {
+public:
+    ShapeGroup(const PropertyList &propList);
+
+    /// Return the name used by instances to reference this group
+    const std::string &getName() const { return m_name; }
+
+    /// Return the bottom-level BVH over the meshes of the group
+    const BVH *getBVH() const { return m_bvh.get(); }
+
+    /// Return the meshes of the group
+    const std::vector<std::unique_ptr<Mesh>> &getMeshes() const { return m_meshes; }
+
+    /// Build the BVH
+    void activate() override;
+
+    /**
+     * \brief Update the meshes to the given animation frame and refit the
+     * BVH (see \ref BVH::refit()). Returns \c true if any mesh changed.
+     */
+    bool setFrame(int frame, float rebuildThreshold);
+
+    /// Add a mesh to the group
+    void addChild(NoriObject *obj) override;
+
+    std::string toString() const override;
+
+    EClassType getClassType() const override { return EShapeGroup; }
+
+private:
+    std::string m_name;
+    std::vector<std::unique_ptr<Mesh>> m_meshes;
+    std::unique_ptr<BVH> m_bvh {new BVH{}};
+};
+
+/**
+ * \brief Placement of a \ref ShapeGroup in the scene
+ *
+ * Rays are transformed into the local space of the group at the instance
+ * boundary. The direction is not normalized, so that distances along the
+ * ray are the same in both spaces. Intersection records are transformed
+ * back into world space.
+ */
+class Instance : public NoriObject {
+public:
+    Instance(const PropertyList &propList);
+
+    /// Return the name of the referenced shape group
+    const std::string &getShapeGroupName() const { return m_groupName; }
+
+    /// Resolve the referenced shape group and compute the bounds (called by the scene)
+    void setShapeGroup(const ShapeGroup *group);
+
+    /// Return the referenced shape group
+    const ShapeGroup *getShapeGroup() const { return m_group; }
+
+    /// Return the world space bounding box of the instance
+    const BoundingBox3f &getBoundingBox() const { return m_bbox; }
+
+    /// Return the centroid of the world space bounding box
+    Point3f getCentroid() const { return m_bbox.getCenter(); }
+
+    /**
+     * \brief Intersect a world space ray against the instance
+     *
+     * Has the same semantics as \ref BVH::rayIntersect(), i.e. \c its is
+     * only filled (in world space) if \c shadowRay is \c false.
+     */
+    bool rayIntersect(const Ray3f &ray, Intersection &its, bool shadowRay) const;
+
+    std::string toString() const override;
+
+    EClassType getClassType() const override { return EInstance; }
+
+private:
+    std::string m_groupName;
+    const ShapeGroup *m_group = nullptr;
+    Transform m_toWorld, m_toLocal;
+    BoundingBox3f m_bbox;
+};
+
+/**
+ * \brief Top-level acceleration structure over instances
+ *
+ * A binary BVH over the world space bounds of the instances, split at the
+ * median centroid along the largest axis. The number of instances is
+ * usually small compared to the number of triangles in a scene, so the
+ * simple build is sufficient.
+ */
+class InstanceBVH {
+public:
+    /// Register an instance (only before \ref build())
+    void addInstance(const Instance *instance) { m_instances.push_back(instance); }
+
+    /// Build the hierarchy
+    void build();
+
+    /// Return the number of registered instances
+    size_t getInstanceCount() const { return m_instances.size(); }
+
+    /// Return a bounding box containing all instances
+    const BoundingBox3f &getBoundingBox() const { return m_bbox; }
+
+    /**
+     * \brief Intersect a ray against all instances
+     *
+     * Only intersections closer than <tt>ray.maxt</tt> are reported, which
+     * allows to continue a query of the bottom-level BVH of the scene.
+     */
+    bool rayIntersect(const Ray3f &ray, Intersection &its, bool shadowRay = false) const;
+
+private:
+    struct Node {
+        BoundingBox3f bbox;
+        uint32_t start, size;  ///< Range of instances (leaves only)
+        uint32_t rightChild;   ///< Index of the right child (inner nodes only)
+
+        bool isLeaf() const { return size > 0; }
+    };
+
+    uint32_t buildRecursive(uint32_t start, uint32_t end);
+
+    std::vector<const Instance *> m_instances;
+    std::vector<Node> m_nodes;
+    BoundingBox3f m_bbox;
+};
+
+NORI_NAMESPACE_END
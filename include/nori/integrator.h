@@ -7,9 +7,49 @@
 #pragma once
 
 #include <nori/object.h>
+#include <nori/aov.h>
+#include <nori/ray.h>
 
 NORI_NAMESPACE_BEGIN
 
+/**
+ * \brief State of a path that is traced one bounce at a time
+ *
+ * Render managers that interleave many paths per thread (see
+ * <tt>regeneration.cpp</tt>) keep one of these per path and call
+ * \ref Integrator::stepPath() until the path terminates.
+ */
+struct PathState {
+    /// Ray to be traced by the next step (the camera ray initially)
+    Ray3f ray;
+
+    /// Product of the BSDF weights (and Russian roulette factors) so far
+    Color3f throughput = Color3f(1.0f);
+
+    /// Radiance gathered by the path so far
+    Color3f radiance = Color3f(0.0f);
+
+    /**
+     * \brief Density of sampling \ref ray at the previous vertex
+     * (solid angle), or 0 for camera rays and discrete BSDF samples
+     */
+    float pdf = 0.0f;
+
+    /// Number of completed bounces
+    int bounce = 0;
+
+    /**
+     * \brief Estimated value (luminance) of the pixel, used by integrators
+     * that steer Russian roulette and splitting towards it (0 if unknown)
+     */
+    float pixelEstimate = 0.0f;
+
+    PathState() = default;
+
+    /// Start a path with the given camera ray
+    explicit PathState(const Ray3f &ray) : ray(ray) { }
+};
+
 /**
  * \brief Abstract integrator (i.e. a rendering technique)
  *
@@ -27,6 +67,32 @@ public:
     /// Perform an (optional) preprocess step
     virtual void preprocess(const Scene *scene) { }
 
+    /**
+     * \brief Does the result of \ref preprocess() depend on the camera?
+     *
+     * When rendering a batch, the preprocess step is only repeated for a
+     * different camera if this returns \c true.
+     */
+    virtual bool preprocessUsesCamera() const { return false; }
+
+    /**
+     * \brief Called by progressive render managers after \ref preprocess(),
+     * before the first pass
+     *
+     * Announces that \ref finishPass() will be called, other render managers
+     * don't render in passes.
+     */
+    virtual void beginPasses(const Scene *scene) { }
+
+    /**
+     * \brief Called by progressive render managers after every pass over
+     * the image (with the number of finished passes)
+     *
+     * Integrators that learn from the rendered samples can update their
+     * data structures here, no other thread is rendering at that time.
+     */
+    virtual void finishPass(const Scene *scene, uint32_t passes) { }
+
     /**
      * \brief Sample the incident radiance along a ray
      *
@@ -41,11 +107,58 @@ public:
      */
     virtual Color3f Li(const Scene *scene, Sampler *sampler, const Ray3f &ray) const = 0;
 
+    /**
+     * \brief Sample the incident radiance along a camera ray and record
+     * the surface AOVs of its first intersection
+     *
+     * This is only called when AOVs are requested. The default
+     * implementation intersects the camera ray a second time after
+     * calling \ref Li(). Integrators that already know the first
+     * intersection can override this to record it directly.
+     */
+    virtual Color3f LiAOV(const Scene *scene, Sampler *sampler, const Ray3f &ray, AOVRecord &aovs) const {
+        Color3f result = Li(scene, sampler, ray);
+        aovs.record(scene, sampler, ray);
+        return result;
+    }
+
+    /**
+     * \brief Trace the next segment of a path
+     *
+     * Traces \c state.ray, adds the radiance found by it to
+     * \c state.radiance and samples the ray of the next step. The first
+     * step records the AOVs of the camera ray if \c aovs is given.
+     *
+     * The default implementation computes the whole path with \ref Li()
+     * (or \ref LiAOV()) in a single step.
+     *
+     * \return
+     *    \c false if the path has terminated
+     */
+    virtual bool stepPath(const Scene *scene, Sampler *sampler, PathState &state, AOVRecord *aovs) const {
+        state.radiance = aovs ? LiAOV(scene, sampler, state.ray, *aovs) : Li(scene, sampler, state.ray);
+        return false;
+    }
+
     /**
      * \brief Return the type of object (i.e. Mesh/BSDF/etc.) 
      * provided by this instance
      * */
     EClassType getClassType() const { return EIntegrator; }
+
+protected:
+    /**
+     * \brief Trace a complete path by calling \ref stepPath() until it
+     * terminates
+     *
+     * Integrators overriding \ref stepPath() can implement \ref Li()
+     * with this.
+     */
+    Color3f tracePath(const Scene *scene, Sampler *sampler, const Ray3f &ray, AOVRecord *aovs) const {
+        PathState state(ray);
+        while (stepPath(scene, sampler, state, aovs)) { }
+        return state.radiance;
+    }
 };
 
 NORI_NAMESPACE_END
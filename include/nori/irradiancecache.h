@@ -0,0 +1,107 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Octree of cached irradiance samples
+*/
+
+#pragma once
+
+#include <nori/bbox.h>
+#include <nori/color.h>
+#include <atomic>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Irradiance at a surface point along with the information needed to
+ * extrapolate it to nearby points (Ward et al. 1988, Ward and Heckbert 1992)
+ */
+struct IrradianceRecord {
+    /// Position of the record
+    Point3f p;
+
+    /// Shading normal at the position
+    Normal3f n;
+
+    /// Irradiance (cosine-weighted incident radiance)
+    Color3f E;
+
+    /// Rotational gradient of each color channel (world space)
+    Vector3f rotGrad[3];
+
+    /// Translational gradient of each color channel (world space)
+    Vector3f transGrad[3];
+
+    /// Harmonic mean distance to the surrounding geometry (validity radius)
+    float R;
+};
+
+/**
+ * \brief Octree of irradiance records that can be filled while rendering
+ *
+ * Insertion descends into every node overlapping the region where a record
+ * is valid and stores the record at the first depth where the diagonal of
+ * the node is shorter than that of the region (or at the maximum depth).
+ * Lookups walk down the single path of nodes containing the query point and
+ * test the records of all of them. Both lookups and insertions are
+ * lock-free: nodes and record lists only grow, new entries are published
+ * with a compare-and-swap and are never modified afterwards.
+ */
+class IrradianceCache {
+public:
+    IrradianceCache() = default;
+
+    /// Release all memory
+    ~IrradianceCache();
+
+    IrradianceCache(const IrradianceCache &) = delete;
+    IrradianceCache &operator=(const IrradianceCache &) = delete;
+
+    /**
+     * \brief Remove all records and prepare for a scene with the given
+     * bounding box
+     *
+     * \param accuracy
+     *    Maximum error of the records that are used for interpolation,
+     *    a record is valid up to a distance of <tt>accuracy * R</tt>
+     */
+    void init(const BoundingBox3f &bbox, float accuracy);
+
+    /**
+     * \brief Interpolate the irradiance at \c p with normal \c n from the
+     * valid records (thread-safe)
+     *
+     * \return
+     *    \c false if there is no valid record
+     */
+    bool lookup(const Point3f &p, const Normal3f &n, Color3f &E) const;
+
+    /// Add a record (thread-safe)
+    void insert(const IrradianceRecord &record);
+
+    /// Return the number of inserted records
+    size_t getRecordCount() const { return m_recordCount.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        IrradianceRecord record;
+        Entry *next;
+    };
+
+    struct Node {
+        std::atomic<Node *> children[8] { };
+        std::atomic<Entry *> entries { nullptr };
+        ~Node();
+    };
+
+    void insert(Node *node, const BoundingBox3f &nodeBounds, const BoundingBox3f &dataBounds,
+                const IrradianceRecord &record, int depth);
+
+    static BoundingBox3f childBounds(const BoundingBox3f &bounds, int child);
+
+    Node *m_root = nullptr;
+    BoundingBox3f m_bounds;
+    float m_accuracy = 0.2f;
+    std::atomic<size_t> m_recordCount { 0 };
+};
+
+NORI_NAMESPACE_END
@@ -7,7 +7,6 @@
 #pragma once
 
 #include <optional>
-#include <random>
 
 #include <nori/object.h>
 #include <nori/frame.h>
@@ -39,6 +38,12 @@ struct Intersection {
     const Mesh *mesh = nullptr;
     /// Primitive index in the associated mesh (e.g., triangle id)
     uint32_t prim_idx;
+    /// Partial derivatives of the position w.r.t. the uv coordinates
+    Vector3f dpdu, dpdv;
+    /// Screen-space derivatives of the position (from ray differentials)
+    Vector3f dpdx, dpdy;
+    /// Screen-space derivatives of the uv coordinates (from ray differentials)
+    Vector2f duvdx, duvdy;
 
     /// Create an uninitialized intersection record
     Intersection() = default;
@@ -53,6 +58,24 @@ struct Intersection {
         return shFrame.toWorld(d);
     }
 
+    /**
+     * \brief Compute the screen-space derivatives of the position and uv
+     * coordinates by intersecting the differentials of \c ray with the
+     * tangent plane (see Igehy, "Tracing Ray Differentials", 1999)
+     */
+    void computeDifferentials(const Ray3f &ray);
+
+    /**
+     * \brief Attach differentials to a ray leaving this intersection
+     *
+     * The offset rays start at the neighboring surface points and are
+     * parallel to \c ray, i.e. the footprint of the incoming ray is kept.
+     * This is a conservative estimate for glossy and diffuse bounces, which
+     * would only widen it, and still allows coarser mip levels to be used
+     * by secondary bounces.
+     */
+    void spawnDifferentials(Ray3f &ray) const;
+
     /// Return a human-readable summary of the intersection record
     std::string toString() const;
 };
@@ -77,6 +100,14 @@ public:
     /// Initialize internal data structures (called once by the XML parser)
     virtual void activate();
 
+    /**
+     * \brief Update the geometry to the given frame of an animation
+     *
+     * Only the vertex positions (and normals) may change, the topology
+     * stays the same. Returns \c false if the mesh is not animated.
+     */
+    virtual bool setFrame(int /* frame */) { return false; }
+
     /// Return the total number of triangles in this shape
     uint32_t getTriangleCount() const { return (uint32_t) m_F.cols(); }
 
@@ -170,24 +201,26 @@ public:
      * */
     EClassType getClassType() const { return EMesh; }
 
+    /// index of the mesh in the scene's mesh list
+    uint32_t idx {-1U};
+
 protected:
     /// Create an empty mesh
     Mesh();
 
     float m_cachedArea{ 0.f };
 
-    std::random_device dev;
-    mutable std::mt19937 m_rng{ dev() };
-    mutable std::uniform_real_distribution<float> m_uniformDistribution;
-
-    // return a uniformly distributed value in the interval [0,1)
-    [[nodiscard]] float uniformRandomValue() const;
-
     // map the unit triangle (0,0)--(1,0)--(1,1) to barycentric coordinates
     [[nodiscard]] Point3f barycentric(const Point2f& p) const;
 
     [[nodiscard]] Point3f apply_barycentric(const Point3f& barycentricPos, const TripleCoord& coords) const;
 
+    /// Replace the vertex positions and normals (the vertex count must stay the same)
+    void setVertexPositions(MatrixXf &&V, MatrixXf &&N);
+
+    /// Recompute the surface area and the triangle sampling distribution
+    void updateAreaDistribution();
+
     [[nodiscard]] TriangleIndices triangleIndices(uint32_t triangleIndex) const;
     [[nodiscard]] TripleCoord triangle(uint32_t triangleIndex) const;
     [[nodiscard]] TripleCoord normals(uint32_t triangleIndex) const;
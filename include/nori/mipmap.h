@@ -0,0 +1,280 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Mip-mapped texture lookups
+*/
+
+#pragma once
+
+#include <nori/bitmap.h>
+#include <nori/texturecache.h>
+#include <array>
+#include <vector>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Image pyramid with filtered texture lookups
+ *
+ * Lookups wrap around at the borders (i.e. the texture repeats) and use
+ * the usual uv convention with the origin at the bottom left.
+ *
+ * The filter is chosen at construction time:
+ * - \c ENearest: nearest texel of the full resolution image
+ * - \c EBilinear: bilinear interpolation of the full resolution image
+ * - \c ETrilinear: bilinear interpolation between the two mip levels
+ *   matching the larger axis of the footprint
+ * - \c EEWA: elliptically weighted average with a Gaussian kernel over the
+ *   anisotropic footprint (Heckbert 1989), blended between two levels
+ *
+ * The footprint is given by the screen-space derivatives of the uv
+ * coordinates. Lookups without a footprint fall back to bilinear
+ * interpolation of the finest level (nearest for \c ENearest).
+ *
+ * The texels are provided by a storage class, see \ref TMipMap.
+ */
+class MipMap {
+public:
+    enum EFilter {
+        ENearest = 0,
+        EBilinear,
+        ETrilinear,
+        EEWA
+    };
+
+    virtual ~MipMap() = default;
+
+    /// Look up the filter type with the given name (throws on failure)
+    static EFilter filterFromString(const std::string &name);
+
+    /// Return the name of a filter type
+    static const char *filterName(EFilter filter);
+
+    /// Evaluate the texture at \c uv without footprint information
+    virtual Color3f eval(const Point2f &uv) const = 0;
+
+    /// Evaluate the texture at \c uv filtered over the given footprint
+    virtual Color3f eval(const Point2f &uv, const Vector2f &duvdx, const Vector2f &duvdy) const = 0;
+
+    /// Return a human-readable summary
+    virtual std::string toString() const = 0;
+
+protected:
+    /// Weights of the EWA filter, indexed by the squared radius in [0, 1)
+    static constexpr int EWALutSize = 128;
+    static const std::array<float, EWALutSize> EWAWeights;
+};
+
+/**
+ * \brief Mip map over a texel storage
+ *
+ * The storage provides <tt>getLevelCount()</tt>, <tt>getSize(level)</tt>,
+ * <tt>texel(level, x, y)</tt> for coordinates inside the level (with \c y
+ * counted from the top), <tt>toString()</tt> and a <tt>ReadScope</tt>
+ * type that is instantiated around every lookup.
+ */
+template <typename Storage> class TMipMap : public MipMap {
+public:
+    TMipMap(Storage &&storage, EFilter filter, float maxAnisotropy = 8.0f)
+        : m_storage(std::move(storage)), m_filter(filter),
+          m_maxAnisotropy(std::max(maxAnisotropy, 1.0f)) { }
+
+    Color3f eval(const Point2f &uv) const override {
+        typename Storage::ReadScope scope(m_storage);
+        if (m_filter == ENearest)
+            return nearest(0, uv);
+        return bilinear(0, uv);
+    }
+
+    Color3f eval(const Point2f &uv, const Vector2f &duvdx, const Vector2f &duvdy) const override {
+        typename Storage::ReadScope scope(m_storage);
+        if (m_filter == ENearest)
+            return nearest(0, uv);
+        else if (m_filter == EBilinear)
+            return bilinear(0, uv);
+
+        /* Footprint in texels of the finest level (texel rows run top-down) */
+        const Vector2i size = m_storage.getSize(0);
+        Vector2f d0(duvdx.x() * size.x(), -duvdx.y() * size.y());
+        Vector2f d1(duvdy.x() * size.x(), -duvdy.y() * size.y());
+
+        if (m_filter == ETrilinear)
+            return trilinear(uv, std::max(d0.norm(), d1.norm()));
+
+        /* EWA: clamp the eccentricity of the ellipse to bound the cost */
+        if (d0.squaredNorm() < d1.squaredNorm())
+            std::swap(d0, d1);
+        const float major = d0.norm();
+        float minor = d1.norm();
+        if (minor * m_maxAnisotropy < major && minor > 0) {
+            const float scale = major / (minor * m_maxAnisotropy);
+            d1 *= scale;
+            minor *= scale;
+        }
+        if (minor == 0)
+            return bilinear(0, uv);
+
+        /* The minor axis determines the level, blend the two closest ones */
+        const int lastLevel = m_storage.getLevelCount() - 1;
+        const float lod = std::max(0.0f, std::log2(minor));
+        const int level = std::min((int) lod, lastLevel);
+        auto levelFootprint = [&](int l, const Vector2f &d) {
+            const Vector2i s = m_storage.getSize(l);
+            return Vector2f(d.x() * s.x() / size.x(), d.y() * s.y() / size.y());
+        };
+        const Color3f result = ewa(level, uv, levelFootprint(level, d0), levelFootprint(level, d1));
+        if (level == lastLevel)
+            return result;
+
+        const float delta = lod - level;
+        return (1.0f - delta) * result + delta * ewa(level + 1, uv,
+            levelFootprint(level + 1, d0), levelFootprint(level + 1, d1));
+    }
+
+    std::string toString() const override {
+        return tfm::format("MipMap[filter=%s, storage=%s]", filterName(m_filter), m_storage.toString());
+    }
+
+private:
+    /// Fetch a texel with repeating boundary (\c y counted from the top)
+    Color3f texel(int level, int x, int y) const {
+        const Vector2i size = m_storage.getSize(level);
+        x %= size.x(); if (x < 0) x += size.x();
+        y %= size.y(); if (y < 0) y += size.y();
+        return m_storage.texel(level, x, y);
+    }
+
+    /// Convert uv to continuous texel coordinates of a level (texel centers at +0.5)
+    Point2f toTexel(int level, const Point2f &uv) const {
+        const Vector2i size = m_storage.getSize(level);
+        return Point2f(uv.x() * size.x(), (1.0f - uv.y()) * size.y());
+    }
+
+    Color3f nearest(int level, const Point2f &uv) const {
+        const Point2f st = toTexel(level, uv);
+        return texel(level, (int) std::floor(st.x()), (int) std::floor(st.y()));
+    }
+
+    Color3f bilinear(int level, const Point2f &uv) const {
+        const Point2f st = toTexel(level, uv) - Vector2f(0.5f);
+        const float fx = std::floor(st.x()), fy = std::floor(st.y());
+        const int x = (int) fx, y = (int) fy;
+        const float dx = st.x() - fx, dy = st.y() - fy;
+        return (1.0f - dx) * (1.0f - dy) * texel(level, x, y) +
+               dx * (1.0f - dy) * texel(level, x + 1, y) +
+               (1.0f - dx) * dy * texel(level, x, y + 1) +
+               dx * dy * texel(level, x + 1, y + 1);
+    }
+
+    Color3f trilinear(const Point2f &uv, float width) const {
+        const int lastLevel = m_storage.getLevelCount() - 1;
+        const float lod = std::log2(std::max(width, 1e-8f));
+        if (lod <= 0)
+            return bilinear(0, uv);
+        if (lod >= lastLevel)
+            return bilinear(lastLevel, uv);
+
+        const int level = (int) lod;
+        const float delta = lod - level;
+        return (1.0f - delta) * bilinear(level, uv) + delta * bilinear(level + 1, uv);
+    }
+
+    Color3f ewa(int level, const Point2f &uv, const Vector2f &d0, const Vector2f &d1) const {
+        const Point2f st = toTexel(level, uv) - Vector2f(0.5f);
+
+        /* Implicit ellipse A s^2 + B s t + C t^2 < 1 spanned by d0 and d1,
+           widened by one texel so that it always covers a texel center */
+        float A = d0.y() * d0.y() + d1.y() * d1.y() + 1;
+        float B = -2 * (d0.x() * d0.y() + d1.x() * d1.y());
+        float C = d0.x() * d0.x() + d1.x() * d1.x() + 1;
+        const float invF = 1 / (A * C - B * B * 0.25f);
+        A *= invF;
+        B *= invF;
+        C *= invF;
+
+        /* Bounding box of the ellipse */
+        const float det = -B * B + 4 * A * C, invDet = 1 / det;
+        const float uSqrt = std::sqrt(det * C), vSqrt = std::sqrt(A * det);
+        const int s0 = (int) std::ceil(st.x() - 2 * invDet * uSqrt);
+        const int s1 = (int) std::floor(st.x() + 2 * invDet * uSqrt);
+        const int t0 = (int) std::ceil(st.y() - 2 * invDet * vSqrt);
+        const int t1 = (int) std::floor(st.y() + 2 * invDet * vSqrt);
+
+        Color3f sum(0.0f);
+        float weightSum = 0;
+        for (int it = t0; it <= t1; ++it) {
+            const float tt = it - st.y();
+            for (int is = s0; is <= s1; ++is) {
+                const float ss = is - st.x();
+                const float r2 = A * ss * ss + B * ss * tt + C * tt * tt;
+                if (r2 < 1) {
+                    const int index = std::min((int) (r2 * EWALutSize), EWALutSize - 1);
+                    const float weight = EWAWeights[index];
+                    sum += weight * texel(level, is, it);
+                    weightSum += weight;
+                }
+            }
+        }
+
+        if (weightSum <= 0)
+            return bilinear(level, uv);
+        return sum / weightSum;
+    }
+
+    Storage m_storage;
+    EFilter m_filter;
+    float m_maxAnisotropy;
+};
+
+/**
+ * \brief In-memory image pyramid with texels stored in the format given
+ * by \c Texel
+ *
+ * The pyramid is built once from a bitmap by repeatedly averaging blocks
+ * of 2x2 texels (in linear RGB).
+ */
+template <typename Texel> class TBitmapPyramid {
+public:
+    struct ReadScope {
+        explicit ReadScope(const TBitmapPyramid &) { }
+    };
+
+    /// Build the pyramid (takes ownership of the contents of \c bitmap)
+    explicit TBitmapPyramid(TBitmap<Texel> &&bitmap, bool buildLevels = true);
+
+    int getLevelCount() const { return (int) m_levels.size(); }
+
+    Vector2i getSize(int level) const { return m_levels[level].size(); }
+
+    Color3f texel(int level, int x, int y) const { return m_levels[level].coeff(y, x); }
+
+    /// Return the memory occupied by all levels in bytes
+    size_t getMemoryUsage() const;
+
+    std::string toString() const;
+
+private:
+    std::vector<TBitmap<Texel>> m_levels;
+};
+
+/// Texel storage backed by the global \ref TextureCache
+class CachedPyramid {
+public:
+    struct ReadScope : TextureCache::ReadScope {
+        explicit ReadScope(const CachedPyramid &) { }
+    };
+
+    explicit CachedPyramid(const CachedTexture *texture) : m_texture(texture) { }
+
+    int getLevelCount() const { return m_texture->getLevelCount(); }
+
+    Vector2i getSize(int level) const { return m_texture->getSize(level); }
+
+    Color3f texel(int level, int x, int y) const { return m_texture->texel(level, x, y); }
+
+    std::string toString() const { return m_texture->toString(); }
+
+private:
+    const CachedTexture *m_texture;
+};
+
+NORI_NAMESPACE_END
@@ -14,16 +14,36 @@
 #include <nori/block.h>
 #include <nori/rfilter.h>
 #include <nori/sampler.h>
+#include <nori/dpdf.h>
+#include <nori/qmc.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <atomic>
+#include <map>
 #include <numeric>
 #include <functional>
 
 NORI_NAMESPACE_BEGIN
 
+/// Receiver of the splats of a Markov Chain
+class SplatTarget {
+public:
+    virtual ~SplatTarget() = default;
+
+    /// Record a sample with the given position and value
+    virtual void splat(const Point2f &pos, const Color3f &value) = 0;
+};
+
 /**
  * \brief Extension of the image block to be used as a histogram in MLT-style applications.
+ *
+ * A single histogram is shared by all threads: \ref splat() adds samples with
+ * atomic float additions, so the memory footprint is O(image) independent of
+ * the number of threads. The weight channel is not accumulated per sample;
+ * \ref updateResult() writes a snapshot with a uniform weight derived from the
+ * number of recorded samples into the result image.
  */
-class HistogramImage : public ImageBlock {
+class HistogramImage : public ImageBlock, public SplatTarget {
 public:
     HistogramImage(const Vector2i &size, const ReconstructionFilter *filter)
         : ImageBlock(size, filter) {
@@ -36,36 +56,95 @@ public:
 
         // normalize by filter weight and image size
         m_normalization = filterWeight/static_cast<float>(m_size.prod());
+
+        clear();
     }
 
-    // use the regular \ref ImageBlock::put(const Point2f &pos, const Color3f &value) function to add samples
+    /// Record a sample with the given position and value. This function is thread-safe.
+    void splat(const Point2f &_pos, const Color3f &value) override {
+        if (!value.isValid())
+            return;
+
+        /* Convert to pixel coordinates within the histogram */
+        const Point2f pos(
+            _pos.x() - 0.5f - (m_offset.x() - m_borderSize),
+            _pos.y() - 0.5f - (m_offset.y() - m_borderSize)
+        );
+
+        /* Compute the rectangle of pixels that will need to be updated */
+        const int minX = std::max(0, static_cast<int>(std::ceil(pos.x() - m_filterRadius)));
+        const int minY = std::max(0, static_cast<int>(std::ceil(pos.y() - m_filterRadius)));
+        const int maxX = std::min(static_cast<int>(cols()) - 1, static_cast<int>(std::floor(pos.x() + m_filterRadius)));
+        const int maxY = std::min(static_cast<int>(rows()) - 1, static_cast<int>(std::floor(pos.y() + m_filterRadius)));
+
+        /* Look up the pre-rasterized filter without shared scratch memory */
+        for (int y=minY; y<=maxY; ++y) {
+            const float weightY = m_filter[static_cast<int>(std::abs(y-pos.y()) * m_lookupFactor)];
+            for (int x=minX; x<=maxX; ++x) {
+                const float weight = weightY * m_filter[static_cast<int>(std::abs(x-pos.x()) * m_lookupFactor)];
+                Color4f &pixel = coeffRef(y, x);
+                for (int c=0; c<3; ++c)
+                    std::atomic_ref<float>(pixel[c]).fetch_add(value[c]*weight, std::memory_order_relaxed);
+            }
+        }
+    }
 
-    /// Increment the number of samples contained in the histogram
+    /// Increment the number of samples contained in the histogram. This function is thread-safe.
     void incrementSampleCount(const float numEntries) {
-        m_entries += numEntries;
+        m_entries.fetch_add(numEntries, std::memory_order_relaxed);
     }
 
-    /// Accumulate the histogram data into the \param result image
+    /// Replace the contents of the \param result image with the normalized histogram
     /// make sure that the \param mean is accurate
+    /// may be called while other threads are still splatting
     void updateResult(ImageBlock& result, const float mean=1.0f) {
-        const float weight = m_normalization*m_entries/mean;
-
-        if (weight > 0.0f)
-        {
-            for (long i=0; i<size(); ++i)
-                coeffRef(i).w() = weight;
-
-            result.put(*this);
-            clear();
+        const float weight = static_cast<float>(m_normalization*m_entries.load(std::memory_order_relaxed)/mean);
+        if (!(weight > 0.0f))
+            return;
+
+        result.lock();
+        for (long i=0; i<size(); ++i) {
+            Color4f &pixel = coeffRef(i);
+            Color4f &target = result.coeffRef(i);
+            for (int c=0; c<3; ++c)
+                target[c] = std::atomic_ref<float>(pixel[c]).load(std::memory_order_relaxed);
+            target.w() = weight;
         }
-
-        m_entries = 0.0f;
+        result.unlock();
     }
 
 private:
     /// normalization terms for filter weight and image size
     float m_normalization;
-    float m_entries {0.0f};
+    std::atomic<double> m_entries {0.0};
+};
+
+/**
+ * \brief Splats of a single Markov Chain, recorded in order
+ *
+ * Lets chains run in parallel while their splats are added to a shared
+ * histogram in a fixed order. The memory footprint is proportional to the
+ * chain length (about two splats per mutation) instead of the image size.
+ */
+class SplatList : public SplatTarget {
+public:
+    void splat(const Point2f &pos, const Color3f &value) override {
+        m_splats.push_back(Splat{pos, value});
+    }
+
+    /// Add the recorded splats to \param histogram in recording order and clear the list
+    void replay(HistogramImage &histogram) {
+        for (const Splat &splat : m_splats)
+            histogram.splat(splat.pos, splat.value);
+        m_splats.clear();
+    }
+
+private:
+    struct Splat {
+        Point2f pos;
+        Color3f value;
+    };
+    std::vector<Splat> m_splats;
 };
 
 /**
@@ -74,9 +153,20 @@ private:
  *
  * The internal state can be reset to a new random state using \ref newChain()
  * The internal state can be perturbed using \ref perturb()
+ * Each of these starts a new tentative mutation which has to be finished
+ * with \ref accept() or \ref reject().
+ *
+ * Mutations are applied lazily: every sample records the iteration in which
+ * it was last modified, and pending perturbations are only applied when a
+ * sample is actually read. The cost of a mutation is therefore proportional
+ * to the number of dimensions used by the path, not to the size of the state.
+ * Rejecting a mutation restores the backups of the samples touched by it.
  */
 class ReplaySampler : public Sampler {
 public:
+    /// Perturbation of a single sample value, drawing random numbers from the given sampler
+    using PerturbationFunction = void (*)(Sampler *, float &);
+
     ReplaySampler(Sampler* fallbackSampler)
         : Sampler(), m_fallbackSampler(fallbackSampler)
     {
@@ -92,8 +182,6 @@ public:
     /// Prepare for a new pixel
     void generate()  override {
         m_fallbackSampler->advance();
-        // precompute 8 dimensions
-        accessSample(7);
         m_dimension = 1;
     }
     /// Advance to the next path within the pixel
@@ -108,65 +196,127 @@ public:
     }
 
     /// Return the pixel sample
-    const Point2f& getPixelSample()    const { return m_samples.at(0); }
+    const Point2f& getPixelSample()    { return accessSample(0); }
     /// Return the aperture sample
-    const Point2f& getApertureSample() const { return m_samples.at(1); }
+    const Point2f& getApertureSample() { return accessSample(1); }
 
-    /// Generate a new chain
+    /// Start a new chain (large step): all samples are redrawn uniformly when read
     void newChain() {
-        // cut the chain to reduce future perturbation effort
-        m_samples.clear();
-        // prepare for the next path
-        generate();
+        startIteration(nullptr);
     }
 
-    /// Perturb the existing samples
+    /// Perturb the existing samples (small step)
     /// call like this:
     /// ReplaySampler::perturb([](Sampler* sampler, float& value) { value = sampler->next1D(); });
-    void perturb(std::function<void(Sampler*, float&)> perturbationFunction) {
-        for (Point2f& sample : m_samples)
-        {
-            perturbationFunction(m_fallbackSampler, sample.x());
-            perturbationFunction(m_fallbackSampler, sample.y());
-
-            if (sample.x() < 0.0f || sample.x() >= 1.0f) [[unlikely]]
-                throw std::runtime_error("perturbed sample x is outside the allowed [0,1) range.");
-            if (sample.y() < 0.0f || sample.y() >= 1.0f) [[unlikely]]
-                throw std::runtime_error("perturbed sample y is outside the allowed [0,1) range.");
-        }
-        // prepare for the next path
-        generate();
+    /// the perturbed value is wrapped back into [0,1)
+    void perturb(PerturbationFunction perturbationFunction) {
+        startIteration(perturbationFunction);
     }
 
-    /// Swap the samples with another ReplaySampler
-    void swapSamples(ReplaySampler& other) {
-        m_samples.swap(other.m_samples);
+    /// Accept the current mutation
+    void accept() {
+        if (m_largeStep) {
+            m_lastLargeStep = m_iteration;
+            m_history.clear();
+        }
     }
 
-    /// Copy the samples from another ReplaySampler
-    void copySamples(const ReplaySampler& other) {
-        m_samples = other.m_samples;
+    /// Reject the current mutation and restore the previous state
+    void reject() {
+        for (PrimarySample &sample : m_samples)
+            if (sample.lastModified == m_iteration)
+                sample.restore();
+        if (!m_largeStep)
+            m_history.pop_back();
+        --m_iteration;
     }
 
     /// Returns the current amount of samples (this will grow on demand)
     size_t getSize() const { return m_samples.size(); }
 
+    /// Returns the number of dimensions read by the last path (a proxy for its length)
+    uint32_t getPathDimension() const { return m_dimension; }
+
+    /// Replace the fallback sampler, e.g. after reconstructing a state from a seed
+    void setFallbackSampler(Sampler* fallbackSampler) { m_fallbackSampler = fallbackSampler; }
+
 private:
+    /// lazily mutated 2D sample with backup for rejected mutations
+    struct PrimarySample {
+        Point2f value {0.0f};
+        long lastModified {-1};
+        Point2f valueBackup {0.0f};
+        long modifiedBackup {-1};
+
+        void backup()  { valueBackup = value; modifiedBackup = lastModified; }
+        void restore() { value = valueBackup; lastModified = modifiedBackup; }
+    };
+
     /// fallback sampler to extend the current samples as needed
     Sampler* m_fallbackSampler;
     /// internal sample storage (grows on demand)
-    std::vector<Point2f> m_samples;
+    std::vector<PrimarySample> m_samples;
+    /// small step perturbations applied since the last accepted large step
+    std::vector<PerturbationFunction> m_history;
+    /// current mutation and last accepted large step
+    long m_iteration {0};
+    long m_lastLargeStep {0};
+    /// whether the current mutation is a large step
+    bool m_largeStep {true};
     /// current dimension. always starting after the aperture sample
     uint32_t m_dimension {1};
 
+    void startIteration(PerturbationFunction perturbationFunction) {
+        ++m_iteration;
+        m_largeStep = perturbationFunction == nullptr;
+        if (!m_largeStep)
+            m_history.push_back(perturbationFunction);
+        // prepare for the next path
+        generate();
+    }
+
+    /// apply the perturbations of all iterations after \param from up to the current one
+    void applyHistory(Point2f &value, long from) const {
+        for (long iteration=from+1; iteration<=m_iteration; ++iteration) {
+            const PerturbationFunction perturbation = m_history[static_cast<size_t>(iteration-m_lastLargeStep-1)];
+            perturbation(m_fallbackSampler, value.x());
+            perturbation(m_fallbackSampler, value.y());
+        }
+        for (int i=0; i<2; ++i) {
+            float &v = value[i];
+            if (v < 0.0f || v >= 1.0f) [[unlikely]] {
+                v -= std::floor(v);
+                if (v >= 1.0f)
+                    v = 0.0f;
+            }
+        }
+    }
+
+    /// bring the sample up to date with the current iteration
+    inline void update(PrimarySample &sample) {
+        if (sample.lastModified == m_iteration)
+            return;
+
+        // the sample was not read since the last accepted large step
+        if (sample.lastModified < m_lastLargeStep) {
+            sample.value = m_fallbackSampler->next2D();
+            sample.lastModified = m_lastLargeStep;
+        }
+
+        sample.backup();
+        if (m_largeStep)
+            sample.value = m_fallbackSampler->next2D();
+        else
+            applyHistory(sample.value, sample.lastModified);
+        sample.lastModified = m_iteration;
+    }
+
     /// access an existing sample or extend the samples to satisfy the request
     inline Point2f& accessSample(const size_t index) {
         if (index >= m_samples.size()) {
-            const ptrdiff_t currentSize = static_cast<ptrdiff_t>(m_samples.size());
-            // always generate 4 samples at once
+            // always add 4 samples at once
             m_sampleCount = (index/4)*4+4;
             m_samples.resize(m_sampleCount);
-            std::generate(m_samples.begin()+currentSize, m_samples.end(), [this]() -> Point2f {return m_fallbackSampler->next2D();});
 
             if (m_sampleCount == 100) {
                 // Warn at 100 samples - might still be valid usage in rare cases.
@@ -181,7 +331,9 @@ private:
                 throw NoriException("Requested the 400th sample in the ReplaySampler.\nThere is most likely an isssue in your implementation.");
             }
         }
-        return m_samples.at(index);
+        PrimarySample &sample = m_samples[index];
+        update(sample);
+        return sample.value;
     }
 };
 
@@ -199,10 +351,25 @@ public:
     PSSMLT(int chainlength, int startup, float newChain)
         : m_chainlength{chainlength}, m_startup{startup}, m_newChain{newChain} {}
 
+    /// Initial state and restrictions of a Markov Chain
+    struct ChainStart {
+        /// bootstrap seed to reconstruct the initial state from (-1: cold start with startup phase)
+        int seed {-1};
+        /// restrict the chain to paths consuming this number of dimensions (-1: unrestricted)
+        int dimension {-1};
+        /// scale applied to all splats of the chain
+        float splatScale {1.0f};
+        /// number of mutations (0: use the configured chainlength)
+        int chainlength {0};
+
+        ChainStart() noexcept {}
+    };
+
     // MCMC core loop and evaluation of contribution -- you will have to implement these
 
     /// Process the Markov Chain. Mutate for \param chainlength steps
-    void processMarkovChain(const Scene *scene, Integrator *integrator, Sampler *sampler, HistogramImage &histogram);
+    void processMarkovChain(const Scene *scene, Integrator *integrator, Sampler *sampler, SplatTarget &histogram,
+                            const ChainStart &start = ChainStart{});
     /// Compute the contribution for a specific state of the Markov Chain
     Color3f computeContribution(const Scene *scene, Integrator *integrator, ReplaySampler& state) const;
 
@@ -279,6 +446,98 @@ public:
         }
     }
 
+    /**
+     * \brief Bootstrap the seed pool for multiplexed / deterministic rendering
+     *
+     * Computes \param numSamples new chains in parallel. Chain i is seeded by its index only,
+     * so it can be reconstructed later by \ref processMarkovChain. The chains are grouped into
+     * strata by the number of dimensions their path consumed (a proxy for the path length).
+     * The mean brightness is summed in a fixed order and thus independent of the thread count.
+     *
+     * \return the mean image brightness
+     */
+    float bootstrap(const Scene *scene, Integrator *integrator, const Sampler *sampler, int numSamples) {
+        std::vector<BootstrapSample> seeds(static_cast<size_t>(numSamples));
+
+        tbb::parallel_for(tbb::blocked_range<int>(0, numSamples, 256), [&](const tbb::blocked_range<int> &range) {
+            std::unique_ptr<Sampler> seedSampler(sampler->clone());
+            for (int i=range.begin(); i<range.end(); ++i) {
+                ReplaySampler state = reconstructState(seedSampler.get(), i);
+                const Color3f contribution = computeContribution(scene, integrator, state);
+                seeds[i].brightness = contribution.isValid() ? contribution.mean() : 0.0f;
+                seeds[i].dimension = state.getPathDimension();
+            }
+        });
+
+        // group the seeds by stratum in a fixed order
+        std::map<uint32_t, std::vector<int>> strata;
+        double sumBrightness = 0.0;
+        for (int i=0; i<numSamples; ++i) {
+            sumBrightness += seeds[i].brightness;
+            if (seeds[i].brightness > 0.0f)
+                strata[seeds[i].dimension].push_back(i);
+        }
+
+        m_strata.clear();
+        float cdf = 0.0f;
+        for (auto &[dimension, indices] : strata) {
+            Stratum stratum;
+            stratum.dimension = dimension;
+            stratum.seeds = std::move(indices);
+            stratum.seedPdf.reserve(stratum.seeds.size());
+            for (int i : stratum.seeds)
+                stratum.seedPdf.append(seeds[i].brightness);
+            stratum.fraction = static_cast<float>(stratum.seedPdf.normalize()/sumBrightness);
+            stratum.cdf = cdf;
+            cdf += stratum.fraction;
+            m_strata.push_back(std::move(stratum));
+        }
+
+        m_brightnessSumAndCount.store(BrightnessEstimate(static_cast<float>(sumBrightness), numSamples));
+        return static_cast<float>(sumBrightness/numSamples);
+    }
+
+    /**
+     * \brief Return the start configuration of chain \param chainIndex out of \param numChains
+     *
+     * Every stratum receives one chain, the remaining chains are allotted to the strata in
+     * proportion to their brightness, so faint strata (typically long paths) are never
+     * skipped. The splats are rescaled by the share of the stratum per chain. The starting
+     * seed is importance sampled from the stratum. Requires a previous call to \ref bootstrap,
+     * otherwise a cold start is returned; \param numChains must be at least \ref getStratumCount().
+     */
+    ChainStart getChainStart(int chainIndex, int numChains) const {
+        ChainStart start;
+        if (m_strata.empty())
+            return start;
+
+        const int numStrata = static_cast<int>(m_strata.size());
+        if (numChains < numStrata)
+            throw NoriException("PSSMLT::getChainStart(): %i chains cannot cover %i strata!", numChains, numStrata);
+
+        // stratum s starts at chain s plus its stratified share of the remaining chains
+        const int remaining = numChains-numStrata;
+        const auto firstChain = [&](int s) {
+            if (s == numStrata)
+                return numChains;
+            return s+static_cast<int>(std::ceil(m_strata[s].cdf*static_cast<float>(remaining)-0.5f));
+        };
+        int s = 0;
+        while (s+1 < numStrata && firstChain(s+1) <= chainIndex)
+            ++s;
+        const Stratum &stratum = m_strata[s];
+        const int stratumChains = firstChain(s+1)-firstChain(s);
+
+        start.seed = stratum.seeds[stratum.seedPdf.sample(fixedToFloat(hashValues(chainIndex, 0x5eedu)))];
+        start.dimension = static_cast<int>(stratum.dimension);
+        // compensate the deviation of the chain allotment from the brightness share
+        start.splatScale = stratum.fraction*static_cast<float>(numChains)/static_cast<float>(stratumChains);
+        return start;
+    }
+
+    /// Return the number of strata found by \ref bootstrap, the minimum number of multiplexed chains
+    int getStratumCount() const { return static_cast<int>(m_strata.size()); }
+
     /// Return the number of state mutations made per Markov Chain
     int getChainlength() const { return m_chainlength; }
 
@@ -306,9 +565,10 @@ private:
 
         float getMean() const { return sumBrightness/count; }
 
+        static constexpr int RequiredSamples = 100000; // this should be sufficient in most cases
+
         bool isValid() const {
-            const int requiredSamples = 100000; // this should be sufficient in most cases
-            return count >= requiredSamples;
+            return count >= RequiredSamples;
         }
 
         BrightnessEstimate() noexcept {}
@@ -317,6 +577,33 @@ private:
     };
     std::atomic<BrightnessEstimate> m_brightnessSumAndCount;
 
+    // bootstrap seed of the seed pool
+    struct BootstrapSample {
+        float brightness {0.0f};
+        uint32_t dimension {0};
+    };
+
+    // seeds of the seed pool consuming the same number of dimensions
+    struct Stratum {
+        uint32_t dimension {0};
+        std::vector<int> seeds;
+        DiscretePDF seedPdf;
+        /// share of the image brightness and cumulative share of the previous strata
+        float fraction {0.0f};
+        float cdf {0.0f};
+    };
+    std::vector<Stratum> m_strata;
+
+    /// reconstruct the initial state of bootstrap seed \param seed, drawing from \param seedSampler
+    static ReplaySampler reconstructState(Sampler *seedSampler, int seed) {
+        ImageBlock seedBlock(Vector2i(0), nullptr);
+        seedBlock.setOffset(Point2i(seed, -1));
+        seedSampler->prepare(seedBlock);
+        ReplaySampler state(seedSampler);
+        state.newChain();
+        return state;
+    }
+
     // 2D testpattern to test the implementation without using the nested integrator
     static Color3f testpattern(const Point2f& pixelSample)
     {
@@ -32,6 +32,10 @@ public:
         ETest,
         EReconstructionFilter,
         ERenderManager,
+        EShapeGroup,
+        EInstance,
+        EJob,
+        EBatch,
         EClassTypeCount
     };
 
@@ -89,6 +93,10 @@ public:
             case EIntegrator:    return "integrator";
             case ESampler:       return "sampler";
             case ERenderManager: return "rendermanager";
+            case EShapeGroup:    return "shapegroup";
+            case EInstance:      return "instance";
+            case EJob:           return "job";
+            case EBatch:         return "batch";
             case ETest:          return "test";
             default:             return "<unknown>";
         }
@@ -135,7 +143,7 @@ public:
             const PropertyList &propList) {
         if (!m_constructors || m_constructors->find(name) == m_constructors->end())
             throw NoriException("A constructor for class \"%s\" could not be found!", name);
-        return (*m_constructors)[name](propList);
+        return m_constructors->at(name)(propList);
     }
 private:
     static std::map<std::string, Constructor> *m_constructors;
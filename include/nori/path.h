@@ -0,0 +1,110 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Path vertex state shared by the path tracing integrators
+*/
+
+#pragma once
+
+#include <nori/scene.h>
+#include <nori/emitter.h>
+#include <nori/bsdf.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Vertex of a path that is traced through the scene
+ *
+ * A vertex is created by tracing the extension ray of the previous vertex
+ * (or the camera ray). It stores the intersection along with everything
+ * that is needed to account for the emitter found by that ray: for BSDF
+ * sampled rays, the emission is weighted using the BSDF density of the
+ * previous vertex, and the same vertex then continues the path. Each
+ * bounce therefore traces exactly one extension ray.
+ *
+ * Rays that leave the scene are vertices without a surface, the emitter is
+ * the environment map in that case (if there is one).
+ */
+struct PathVertex {
+    /// Ray that led to this vertex
+    Ray3f ray;
+
+    /// Intersection with the scene (only valid if \ref hit is \c true)
+    Intersection its;
+
+    /// Did the ray hit a surface?
+    bool hit = false;
+
+    /// Direction towards the previous vertex in the local shading frame
+    Vector3f wi;
+
+    /// Trace \c ray and create the vertex at its first intersection
+    PathVertex(const Scene *scene, const Ray3f &ray) : ray(ray) {
+        hit = scene->rayIntersect(ray, its);
+        if (hit)
+            wi = its.toLocal(-ray.d).normalized();
+    }
+
+    /// Return the BSDF at the vertex (there must be a surface)
+    const BSDF *getBSDF() const { return its.mesh->getBSDF(); }
+
+    /// Return the emitter found by the ray (area light or environment map), or \c nullptr
+    const Emitter *getEmitter(const Scene *scene) const {
+        return hit ? its.mesh->getEmitter() : scene->getEnvironmentMap();
+    }
+
+    /// Return the radiance emitted towards the previous vertex
+    Color3f getEmittedRadiance(const Scene *scene) const {
+        const Emitter *emitter = getEmitter(scene);
+        if (!emitter)
+            return Color3f(0.0f);
+        /* Area lights expect the local direction, the environment map the world direction */
+        return hit ? emitter->eval(wi) : emitter->eval(-ray.d);
+    }
+
+    /**
+     * \brief Return the density of sampling the emitter of this vertex by
+     * emitter sampling from the previous vertex (in solid angle)
+     */
+    float getEmitterPdf(const Scene *scene) const {
+        const Emitter *emitter = getEmitter(scene);
+        if (!emitter)
+            return 0.0f;
+        EmitterQueryRecord eRec(ray.o);
+        eRec.ws_wi = -ray.d.normalized();
+        eRec.measure = ESolidAngle;
+        eRec.eidx = emitter->idx;
+        if (hit) {
+            eRec.ep = its.p;
+            eRec.distance = (its.p - ray.o).norm();
+            eRec.wi = wi;
+        } else {
+            eRec.ep = ray.o;
+            eRec.distance = std::numeric_limits<float>::infinity();
+            eRec.wi = eRec.ws_wi;
+        }
+        return scene->pdfEmitterDirect(eRec);
+    }
+
+    /// Create a BSDF query record for sampling the BSDF at this vertex
+    BSDFQueryRecord createBSDFRecord() const {
+        BSDFQueryRecord bRec(wi, its.uv);
+        bRec.duvdx = its.duvdx;
+        bRec.duvdy = its.duvdy;
+        return bRec;
+    }
+
+    /// Create the extension ray in the sampled direction (with differentials)
+    Ray3f spawnRay(const BSDFQueryRecord &bRec) const {
+        Ray3f result(its.p, its.toWorld(bRec.wo));
+        its.spawnDifferentials(result);
+        return result;
+    }
+};
+
+/// Balance heuristic for multiple importance sampling with two strategies
+inline float misBalance(float pdf, float otherPdf) {
+    const float sum = pdf + otherPdf;
+    return sum > 0.0f ? pdf / sum : 0.0f;
+}
+
+NORI_NAMESPACE_END
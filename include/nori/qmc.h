@@ -0,0 +1,231 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Quasi-Monte Carlo helpers: hashing, Owen scrambling and Sobol sequences
+*/
+
+#pragma once
+
+#include <nori/common.h>
+#include <pcg32.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+NORI_NAMESPACE_BEGIN
+
+/// Reverse the bit order of a 32 bit integer
+inline uint32_t reverseBits(uint32_t v) {
+    v = ((v >> 1) & 0x55555555u) | ((v & 0x55555555u) << 1);
+    v = ((v >> 2) & 0x33333333u) | ((v & 0x33333333u) << 2);
+    v = ((v >> 4) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4);
+    v = ((v >> 8) & 0x00FF00FFu) | ((v & 0x00FF00FFu) << 8);
+    return (v >> 16) | (v << 16);
+}
+
+/// 64 bit finalizer (MurmurHash3 variant) with good avalanche behavior
+inline uint64_t mixBits(uint64_t v) {
+    v ^= (v >> 31);
+    v *= 0x7fb5d329728ea185ull;
+    v ^= (v >> 27);
+    v *= 0x81dadef4bc2dd44dull;
+    v ^= (v >> 33);
+    return v;
+}
+
+/// Hash an arbitrary number of integer values into a 32 bit seed
+template <typename... Args> uint32_t hashValues(Args... args) {
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    ((h = mixBits(h ^ static_cast<uint64_t>(static_cast<uint32_t>(args)))), ...);
+    return static_cast<uint32_t>(h ^ (h >> 32));
+}
+
+/// Convert 32 fixed-point fraction bits into a float in [0, 1)
+inline float fixedToFloat(uint32_t v) {
+    return std::min(static_cast<float>(v) * 0x1p-32f, OneMinusEpsilon);
+}
+
+/**
+ * \brief Hash-based approximation of a nested uniform (Owen) scramble
+ *
+ * The permutation is hierarchical from the most significant bit on:
+ * every output bit only depends on the input bits above it. Applied to
+ * a sample index, it hence shuffles the first 2^k indices among
+ * themselves for every k (see Burley, "Practical Hash-based Owen
+ * Scrambling", JCGT 2020).
+ */
+inline uint32_t owenScramble(uint32_t v, uint32_t seed) {
+    v = reverseBits(v);
+    v ^= v * 0x3d20adeau;
+    v += seed;
+    v *= (seed >> 16) | 1u;
+    v ^= v * 0x05526c56u;
+    v ^= v * 0x53a22864u;
+    return reverseBits(v);
+}
+
+/// Number of Sobol dimensions with precomputed generator matrices
+static constexpr int SobolDimensions = 16;
+
+/**
+ * \brief Generator matrices of the first \ref SobolDimensions Sobol
+ * dimensions
+ *
+ * Each matrix is stored column-wise as 32 direction numbers, the
+ * columns are derived from the primitive polynomials and initial
+ * direction numbers of Joe and Kuo (new-joe-kuo-6.21201).
+ */
+struct SobolMatrices {
+    uint32_t columns[SobolDimensions][32];
+
+    constexpr SobolMatrices() : columns() {
+        /* degree s, polynomial coefficients a and initial numbers m */
+        constexpr uint32_t s[SobolDimensions] = { 0, 1, 2, 3, 3, 4, 4, 5, 5, 5, 5, 5, 5, 6, 6, 6 };
+        constexpr uint32_t a[SobolDimensions] = { 0, 0, 1, 1, 2, 1, 4, 2, 4, 7, 11, 13, 14, 1, 13, 16 };
+        constexpr uint32_t m[SobolDimensions][6] = {
+            { 0 }, { 1 }, { 1, 3 }, { 1, 3, 1 }, { 1, 1, 1 }, { 1, 1, 3, 3 },
+            { 1, 3, 5, 13 }, { 1, 1, 5, 5, 17 }, { 1, 1, 5, 5, 5 },
+            { 1, 1, 7, 11, 19 }, { 1, 1, 5, 1, 1 }, { 1, 1, 1, 3, 11 },
+            { 1, 3, 5, 5, 31 }, { 1, 3, 3, 9, 7, 49 }, { 1, 1, 1, 15, 21, 21 },
+            { 1, 3, 1, 13, 27, 49 }
+        };
+
+        /* the first dimension is the van der Corput sequence in base 2 */
+        for (uint32_t i = 0; i < 32; ++i)
+            columns[0][i] = 1u << (31 - i);
+
+        for (int dim = 1; dim < SobolDimensions; ++dim) {
+            uint32_t *v = columns[dim];
+            const uint32_t deg = s[dim];
+            for (uint32_t i = 0; i < deg; ++i)
+                v[i] = m[dim][i] << (31 - i);
+            for (uint32_t i = deg; i < 32; ++i) {
+                v[i] = v[i - deg] ^ (v[i - deg] >> deg);
+                for (uint32_t k = 1; k < deg; ++k)
+                    if ((a[dim] >> (deg - 1 - k)) & 1u)
+                        v[i] ^= v[i - k];
+            }
+        }
+    }
+};
+
+inline constexpr SobolMatrices SobolMatrixTable {};
+
+/// Compute the unscrambled 32 bit fraction of Sobol point \c index in dimension \c dim
+inline uint32_t sobolSampleBits(uint32_t index, int dim) {
+    const uint32_t *v = SobolMatrixTable.columns[dim];
+    uint32_t result = 0;
+    for (; index != 0; index >>= 1, ++v)
+        if (index & 1u)
+            result ^= *v;
+    return result;
+}
+
+/**
+ * \brief Table-driven (scrambled) radical inverse for Halton sequences
+ *
+ * For each of the first \ref Dimensions primes b, the digit permutation is
+ * applied to blocks of k digits at once through a lookup table with b^k
+ * entries (b^k <= 256 where possible). Evaluating a sample therefore costs
+ * one integer division per block of digits instead of one per digit.
+ * Digit permutations are either the identity or random permutations drawn
+ * once with a fixed seed; the infinite trail of permuted zero digits is
+ * accounted for in closed form.
+ */
+class RadicalInverse {
+public:
+    /// Number of supported dimensions (i.e. prime bases)
+    static constexpr int Dimensions = 128;
+
+    /// Shared instance with identity (\c permuted = false) or random digit permutations
+    static const RadicalInverse &get(bool permuted) {
+        static const RadicalInverse identity(false);
+        static const RadicalInverse scrambled(true);
+        return permuted ? scrambled : identity;
+    }
+
+    /// Return the prime base of the given dimension
+    uint32_t base(int dim) const { return m_dims[dim].base; }
+
+    /// Evaluate the radical inverse of \c index in dimension \c dim
+    float operator()(int dim, uint64_t index) const {
+        const Dimension &d = m_dims[dim];
+        const uint16_t *table = m_table.data() + d.offset;
+
+        uint64_t reversed = 0;
+        float invBaseN = 1.f;
+        while (index != 0) {
+            const uint64_t next = index / d.blockBase;
+            reversed = reversed * d.blockBase + table[index - next * d.blockBase];
+            invBaseN *= d.invBlockBase;
+            index = next;
+        }
+        return std::min((static_cast<float>(reversed) + d.tail) * invBaseN, OneMinusEpsilon);
+    }
+
+private:
+    struct Dimension {
+        uint32_t base;
+        uint32_t blockBase;     ///< base^digits
+        float invBlockBase;
+        float tail;             ///< value of the trailing zero digits
+        size_t offset;          ///< table offset
+    };
+
+    explicit RadicalInverse(bool permuted) {
+        /* first primes by trial division */
+        std::vector<uint32_t> primes;
+        for (uint32_t n = 2; primes.size() < static_cast<size_t>(Dimensions); ++n) {
+            bool isPrime = true;
+            for (uint32_t p : primes) {
+                if (p * p > n)
+                    break;
+                if (n % p == 0) {
+                    isPrime = false;
+                    break;
+                }
+            }
+            if (isPrime)
+                primes.push_back(n);
+        }
+
+        pcg32 rng;
+        std::vector<uint32_t> perm;
+        m_dims.reserve(primes.size());
+        for (uint32_t b : primes) {
+            perm.resize(b);
+            for (uint32_t i = 0; i < b; ++i)
+                perm[i] = i;
+            if (permuted) {
+                for (uint32_t i = b - 1; i > 0; --i)
+                    std::swap(perm[i], perm[rng.nextUInt(i + 1)]);
+            }
+
+            uint32_t digits = 1, blockBase = b;
+            while (blockBase * b <= 256) {
+                blockBase *= b;
+                ++digits;
+            }
+
+            Dimension d;
+            d.base = b;
+            d.blockBase = blockBase;
+            d.invBlockBase = 1.f / static_cast<float>(blockBase);
+            d.tail = static_cast<float>(perm[0]) / static_cast<float>(b - 1);
+            d.offset = m_table.size();
+            m_dims.push_back(d);
+
+            /* entry c holds the permuted digits of c in reversed order */
+            for (uint32_t c = 0; c < blockBase; ++c) {
+                uint32_t value = 0;
+                for (uint32_t i = 0, rest = c; i < digits; ++i, rest /= b)
+                    value = value * b + perm[rest % b];
+                m_table.push_back(static_cast<uint16_t>(value));
+            }
+        }
+    }
+
+    std::vector<Dimension> m_dims;
+    std::vector<uint16_t> m_table;
+};
+
+NORI_NAMESPACE_END
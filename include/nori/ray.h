@@ -33,6 +33,15 @@ template <typename _PointType, typename _VectorType> struct TRay {
     Scalar mint;     ///< Minimum position on the ray segment
     Scalar maxt;     ///< Maximum position on the ray segment
 
+    /**
+     * Optional ray differentials: two auxiliary rays offset by one pixel
+     * in x and y, which are used to estimate the footprint of the ray
+     * on surfaces (e.g. to select a texture mip level)
+     */
+    bool hasDifferentials = false;
+    PointType rxOrigin, ryOrigin;
+    VectorType rxDirection, ryDirection;
+
     /// Construct a new ray
     TRay() : mint(Epsilon),
         maxt(std::numeric_limits<Scalar>::infinity()) { }
@@ -54,13 +63,27 @@ template <typename _PointType, typename _VectorType> struct TRay {
 
     /// Copy a ray, but change the covered segment of the copy
     TRay(const TRay &ray, Scalar mint, Scalar maxt)
-     : o(ray.o), d(ray.d), dRcp(ray.dRcp), mint(mint), maxt(maxt) { }
+     : o(ray.o), d(ray.d), dRcp(ray.dRcp), mint(mint), maxt(maxt),
+       hasDifferentials(ray.hasDifferentials),
+       rxOrigin(ray.rxOrigin), ryOrigin(ray.ryOrigin),
+       rxDirection(ray.rxDirection), ryDirection(ray.ryDirection) { }
 
     /// Update the reciprocal ray directions after changing 'd'
     void update() {
         dRcp = d.cwiseInverse();
     }
 
+    /**
+     * \brief Scale the offset of the differentials to the main ray, e.g.
+     * by <tt>1/sqrt(spp)</tt> when taking several samples per pixel
+     */
+    void scaleDifferentials(Scalar s) {
+        rxOrigin = o + (rxOrigin - o) * s;
+        ryOrigin = o + (ryOrigin - o) * s;
+        rxDirection = d + (rxDirection - d) * s;
+        ryDirection = d + (ryDirection - d) * s;
+    }
+
     /// Return the position of a point along the ray
     PointType operator() (Scalar t) const { return o + t * d; }
 
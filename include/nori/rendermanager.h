@@ -9,6 +9,7 @@
 #pragma once
 
 #include <nori/object.h>
+#include <nori/aov.h>
 #include <thread>
 
 NORI_NAMESPACE_BEGIN
@@ -23,8 +24,19 @@ public:
     // set the output filename of the image (needed for EMCA Interface)
     virtual void setOutputFileName(const std::string& /* unused */) {}
 
+    /**
+     * \brief Does the render manager write the output file itself?
+     *
+     * In that case, the result block passed to \ref start_render() is not
+     * used and doesn't need to cover the full frame.
+     */
+    virtual bool writesOutput() const { return false; }
+
 protected:
     std::thread render_thread;
+
+    /// AOVs to be rendered alongside the radiance (given by the "aovs" property)
+    std::vector<EAOVType> m_aovs;
 };
 
 NORI_NAMESPACE_END
@@ -36,7 +36,9 @@ class ImageBlock;
  * \ref advance() needs to be invoked. This repeats until all pixel samples have
  * been exhausted.  While computing a pixel sample, the rendering
  * algorithm requests (pseudo-) random numbers using the \ref next1D() and
- * \ref next2D() functions.
+ * \ref next2D() functions. Render managers that visit pixel samples out of
+ * order (e.g. progressive rendering) instead call \ref startPixelSample(),
+ * which directly seeks to the requested sample of a pixel.
  *
  * Conceptually, the right way of thinking of this goes as follows:
  * For each sample in a pixel, a sample generator produces a (hypothetical)
@@ -76,12 +78,42 @@ public:
     /// Advance to the next sample
     virtual void advance() = 0;
 
+    /**
+     * \brief Seek to a specific sample of a specific pixel
+     *
+     * Equivalent to calling \ref generate() followed by \c sampleIndex
+     * calls to \ref advance(). Samplers with random access to their
+     * sample sequence should override this to run in constant time.
+     */
+    virtual void startPixelSample(const Point2i &pixel, uint32_t sampleIndex) {
+        generate();
+        for (uint32_t i = 0; i < sampleIndex; ++i)
+            advance();
+    }
+
     /// Retrieve the next component value from the current sample
     virtual float next1D() = 0;
 
     /// Retrieve the next two component values from the current sample
     virtual Point2f next2D() = 0;
 
+    /**
+     * \brief Retrieve the next \c count component values at once
+     *
+     * Equivalent to \c count calls of \ref next1D(), but only dispatched
+     * once. Samplers should override this with a batched implementation.
+     */
+    virtual void fill1D(float *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = next1D();
+    }
+
+    /// Retrieve the next \c count 2D component values at once, see \ref fill1D()
+    virtual void fill2D(Point2f *values, size_t count) {
+        for (size_t i = 0; i < count; ++i)
+            values[i] = next2D();
+    }
+
     /// Return the number of configured pixel samples
     virtual size_t getSampleCount() const { return m_sampleCount; }
 
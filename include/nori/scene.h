@@ -7,6 +7,7 @@
 #pragma once
 
 #include <nori/bvh.h>
+#include <nori/instance.h>
 #include <nori/dpdf.h>
 #include <nori/rendermanager.h>
 
@@ -49,6 +50,9 @@ public:
     /// Return a reference to an array containing all meshes
     const std::vector<std::unique_ptr<Mesh>> &getMeshes() const { return m_meshes; }
 
+    /// Return a reference to an array containing all instances
+    const std::vector<std::unique_ptr<Instance>> &getInstances() const { return m_instances; }
+
     /// Return a pointer to the used render manager
     RenderManager *getRenderManager() { return m_rendermanager.get(); }
 
@@ -72,7 +76,8 @@ public:
 
     /**
      * \brief Intersect a ray against all triangles stored in the scene
-     * and return detailed intersection information
+     * (including instanced geometry) and return detailed intersection
+     * information
      *
      * \param ray
      *    A 3-dimensional ray data structure with minimum/maximum
@@ -85,7 +90,12 @@ public:
      * \return \c true if an intersection was found
      */
     bool rayIntersect(const Ray3f &ray, Intersection &its) const {
-        return m_bvh->rayIntersect(ray, its, false);
+        bool found = m_bvh->rayIntersect(ray, its, false);
+        if (m_instanceBVH.getInstanceCount() == 0)
+            return found;
+
+        /* Continue with the instances, but only closer than the hit so far */
+        return m_instanceBVH.rayIntersect(found ? Ray3f(ray, ray.mint, its.t) : ray, its, false) || found;
     }
 
     /**
@@ -105,14 +115,44 @@ public:
      */
     bool rayIntersect(const Ray3f &ray) const {
         Intersection its; /* Unused */
-        return m_bvh->rayIntersect(ray, its, true);
+        return m_bvh->rayIntersect(ray, its, true) ||
+               m_instanceBVH.rayIntersect(ray, its, true);
     }
 
     /// \brief Return an axis-aligned box that bounds the scene
     const BoundingBox3f &getBoundingBox() const {
-        return m_bvh->getBoundingBox();
+        return m_bbox;
     }
 
+    /**
+     * \brief Run the preprocess step of the integrator
+     *
+     * This is skipped if the results of the last call are still valid,
+     * i.e. neither the integrator nor the geometry have changed since
+     * (see \ref swapObjects() and \ref setFrame()).
+     */
+    void preprocess();
+
+    /**
+     * \brief Exchange the camera, integrator, sampler and render manager
+     * with the given ones (empty pointers keep the current object)
+     *
+     * This is used to render several variations of a scene in a batch,
+     * see \ref RenderJob. Calling it a second time with the same
+     * arguments restores the original objects.
+     */
+    void swapObjects(std::unique_ptr<Camera> &camera, std::unique_ptr<Integrator> &integrator,
+                     std::unique_ptr<const Sampler> &sampler, std::unique_ptr<RenderManager> &rendermanager);
+
+    /**
+     * \brief Update animated meshes to the given frame
+     *
+     * The meshes load their vertex positions in parallel, then the BVHs
+     * are refitted (see \ref BVH::refit()) and the bounds of the
+     * instances are updated. Returns \c true if any geometry changed.
+     */
+    bool setFrame(int frame);
+
     /**
      * \brief Inherited from \ref NoriObject::activate()
      *
@@ -134,6 +174,12 @@ private:
     std::unique_ptr<const Sampler> m_sampler;
     std::unique_ptr<Camera> m_camera;
     std::unique_ptr<BVH> m_bvh {new BVH{}};
+    std::vector<std::unique_ptr<ShapeGroup>> m_shapeGroups;
+    std::vector<std::unique_ptr<Instance>> m_instances;
+    InstanceBVH m_instanceBVH;
+    BoundingBox3f m_bbox;
+    float m_rebuildThreshold;
+    bool m_preprocessed = false;
     std::vector<std::unique_ptr<Emitter>> m_emitters;
     std::vector<std::unique_ptr<const BSDF>> m_bsdfs;
     Emitter *m_envmap = nullptr;
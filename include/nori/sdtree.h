@@ -0,0 +1,145 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Spatial-directional tree for path guiding
+*/
+
+#pragma once
+
+#include <nori/bbox.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Quadtree approximating the incident radiance at a point as a
+ * function of the direction
+ *
+ * Directions are mapped to the unit square using cylindrical coordinates
+ * <tt>((cos(theta) + 1) / 2, phi / (2 pi))</tt>, which preserves areas.
+ * Every node stores the energy of each of its four quadrants. Recording
+ * is lock-free and can be done by several threads at the same time,
+ * sampling and density evaluation are proportional to the energies.
+ */
+class DTree {
+public:
+    /// Create a tree with a single node
+    DTree();
+
+    /// Map a direction (world space) to the unit square
+    static Point2f toCanonical(const Vector3f &d);
+
+    /// Map a point of the unit square to a direction (world space)
+    static Vector3f fromCanonical(const Point2f &p);
+
+    /// Add energy to the leaf containing \c p (thread-safe)
+    void record(const Point2f &p, float value);
+
+    /// Sample a point of the unit square proportional to the energies
+    Point2f sample(const Point2f &sample) const;
+
+    /// Return the density of \ref sample() on the unit square
+    float pdf(const Point2f &p) const;
+
+    /// Return the total recorded energy
+    float getTotal() const;
+
+    /// Return the number of nodes
+    size_t getNodeCount() const { return m_nodes.size(); }
+
+    /**
+     * \brief Replace the tree by an empty tree adapted to the energies
+     * of another one
+     *
+     * Quadrants holding more than \c threshold of the total energy of
+     * \c energy are subdivided (up to \c maxDepth levels), quadrants
+     * holding less are merged.
+     */
+    void refine(const DTree &energy, int maxDepth, float threshold);
+
+private:
+    struct Node {
+        /// Energy of the quadrants (x + 2 y)
+        float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        /// Index of the child node of the quadrants, 0 for leaves
+        uint32_t child[4] = { 0, 0, 0, 0 };
+    };
+
+    std::vector<Node> m_nodes;
+};
+
+/**
+ * \brief Directional distributions of one spatial leaf of an \ref SDTree
+ *
+ * Radiance samples of the current training iteration are recorded in the
+ * building tree, while directions are sampled from the tree built in the
+ * previous iteration.
+ */
+struct DTreeWrapper {
+    DTree building;
+    DTree sampling;
+
+    /// Number of samples recorded in the building tree
+    uint32_t sampleCount = 0;
+
+    /// Record the incident radiance divided by the sampling density in direction \c d (thread-safe)
+    void record(const Vector3f &d, float value);
+
+    /// Sample a direction (world space) from the sampling tree
+    Vector3f sample(const Point2f &sample) const;
+
+    /// Return the density of \ref sample() in solid angle
+    float pdf(const Vector3f &d) const;
+
+    /// Sample from the recorded samples and start recording into a refined tree
+    void build(int maxDepth, float threshold);
+};
+
+/**
+ * \brief Spatial-directional tree (SD-tree) for path guiding
+ *
+ * Binary tree over a cube enclosing the scene that is split in the middle
+ * along alternating axes. Every leaf holds the directional distributions of
+ * the incident radiance (see Mueller et al. 2017, "Practical Path Guiding
+ * for Efficient Light-Transport Simulation").
+ */
+class SDTree {
+public:
+    /// Create a tree with a single leaf covering the cube around \c bbox
+    void init(const BoundingBox3f &bbox);
+
+    /// Return the directional distributions at \c p
+    DTreeWrapper *lookup(const Point3f &p);
+
+    /// Return the directional distributions at \c p
+    const DTreeWrapper *lookup(const Point3f &p) const;
+
+    /**
+     * \brief Finish a training iteration
+     *
+     * Leaves with more than \c sampleThreshold recorded samples are split
+     * until their share of the samples falls below the threshold. Afterwards,
+     * the directional distributions of all leaves are built
+     * (see \ref DTreeWrapper::build()).
+     */
+    void refine(uint32_t sampleThreshold, int maxDepth, float threshold);
+
+    /// Return the number of leaves
+    size_t getLeafCount() const { return m_leaves.size(); }
+
+private:
+    struct Node {
+        /// Index of the child nodes (lower and upper half), 0 for leaves
+        uint32_t child[2] = { 0, 0 };
+        /// Index of the directional distributions of leaves
+        uint32_t leaf = 0;
+        /// Split axis
+        int axis = 0;
+    };
+
+    uint32_t lookupLeaf(const Point3f &p) const;
+
+    BoundingBox3f m_bbox;
+    std::vector<Node> m_nodes;
+    std::vector<DTreeWrapper> m_leaves;
+};
+
+NORI_NAMESPACE_END
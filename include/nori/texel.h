@@ -0,0 +1,175 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Texel storage formats
+*/
+
+#pragma once
+
+#include <nori/color.h>
+#include <nori/vector.h>
+#include <half.h>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+NORI_NAMESPACE_BEGIN
+
+/// Storage formats of texture texels
+enum ETexelFormat {
+    ETexelRGB32F = 0, ///< linear RGB, single precision (12 bytes)
+    ETexelRGBA16F,    ///< linear RGB, half precision, padded to 8 bytes
+    ETexelSRGB8       ///< sRGB encoded, 8 bits per channel (3 bytes)
+};
+
+/// Look up the texel format with the given name ("float", "half" or "srgb8")
+inline ETexelFormat texelFormatFromString(const std::string &name) {
+    const std::string value = toLower(name);
+    if (value == "float" || value == "rgb32f")
+        return ETexelRGB32F;
+    else if (value == "half" || value == "rgba16f")
+        return ETexelRGBA16F;
+    else if (value == "srgb8" || value == "srgb")
+        return ETexelSRGB8;
+    throw NoriException("Unknown texel format \"%s\" (expected float, half or srgb8)", name);
+}
+
+/// Return the name of a texel format
+inline const char *texelFormatName(ETexelFormat format) {
+    static const char *names[] = { "float", "half", "srgb8" };
+    return names[format];
+}
+
+/// Linearization table for 8 bit sRGB values
+inline const std::array<float, 256> &sRGBToLinearTable() {
+    static const std::array<float, 256> table = [] {
+        std::array<float, 256> result{};
+        for (int i = 0; i < 256; ++i)
+            result[i] = Color3f(i / 255.0f).toLinearRGB().x();
+        return result;
+    }();
+    return table;
+}
+
+/// Linear RGB texel in single precision
+struct TexelRGB32F {
+    static constexpr ETexelFormat Format = ETexelRGB32F;
+    float rgb[3];
+
+    TexelRGB32F() = default;
+    explicit TexelRGB32F(const Color3f &c) : rgb{ c.r(), c.g(), c.b() } { }
+    Color3f toColor() const { return Color3f(rgb[0], rgb[1], rgb[2]); }
+};
+
+/// Linear RGB texel in half precision (the alpha channel is padding)
+struct TexelRGBA16F {
+    static constexpr ETexelFormat Format = ETexelRGBA16F;
+    half rgba[4];
+
+    TexelRGBA16F() = default;
+    explicit TexelRGBA16F(const Color3f &c) : rgba{ half(c.r()), half(c.g()), half(c.b()), half(1.0f) } { }
+    Color3f toColor() const { return Color3f(rgba[0], rgba[1], rgba[2]); }
+};
+
+/// sRGB encoded texel with 8 bits per channel
+struct TexelSRGB8 {
+    static constexpr ETexelFormat Format = ETexelSRGB8;
+    uint8_t rgb[3];
+
+    TexelSRGB8() = default;
+    explicit TexelSRGB8(const Color3f &c) {
+        const Color3f s = c.toSRGB();
+        for (int i = 0; i < 3; ++i)
+            rgb[i] = (uint8_t) std::min(255.0f, std::max(0.0f, s[i] * 255.0f + 0.5f));
+    }
+    Color3f toColor() const {
+        const std::array<float, 256> &lut = sRGBToLinearTable();
+        return Color3f(lut[rgb[0]], lut[rgb[1]], lut[rgb[2]]);
+    }
+};
+
+static_assert(sizeof(TexelRGB32F) == 12 && sizeof(TexelRGBA16F) == 8 && sizeof(TexelSRGB8) == 3,
+              "Texel formats must be tightly packed");
+
+/**
+ * \brief Bitmap with texels stored in the format given by \c Texel
+ *
+ * Texels are stored in row-major order starting at the top left, just
+ * like in \ref Bitmap, and are converted to linear RGB on access.
+ */
+template <typename Texel> class TBitmap {
+public:
+    typedef Texel TexelType;
+
+    /// Allocate a new bitmap of the specified size (contents are undefined)
+    explicit TBitmap(const Vector2i &size = Vector2i(0, 0))
+        : m_size(size), m_data((size_t) size.x() * size.y()) { }
+
+    /// Convert a high dynamic-range bitmap (any Eigen array of Color3f)
+    template <typename Derived> explicit TBitmap(const Eigen::ArrayBase<Derived> &bitmap)
+        : TBitmap(Vector2i((int) bitmap.cols(), (int) bitmap.rows())) {
+        for (int y = 0; y < rows(); ++y)
+            for (int x = 0; x < cols(); ++x)
+                m_data[(size_t) y * cols() + x] = Texel(bitmap.coeff(y, x));
+    }
+
+    /// Convert a bitmap with a different texel format
+    template <typename Other> explicit TBitmap(const TBitmap<Other> &bitmap)
+        : TBitmap(bitmap.size()) {
+        for (int y = 0; y < rows(); ++y)
+            for (int x = 0; x < cols(); ++x)
+                m_data[(size_t) y * cols() + x] = Texel(bitmap.coeff(y, x));
+    }
+
+    int cols() const { return m_size.x(); }
+    int rows() const { return m_size.y(); }
+    const Vector2i &size() const { return m_size; }
+
+    /// Return the texel in row \c y and column \c x as linear RGB
+    Color3f coeff(int y, int x) const { return m_data[(size_t) y * m_size.x() + x].toColor(); }
+
+    /// Set the texel in row \c y and column \c x
+    void set(int y, int x, const Color3f &value) { m_data[(size_t) y * m_size.x() + x] = Texel(value); }
+
+    Texel *data() { return m_data.data(); }
+    const Texel *data() const { return m_data.data(); }
+
+    /// Return the memory occupied by the texels in bytes
+    size_t getMemoryUsage() const { return m_data.size() * sizeof(Texel); }
+
+private:
+    Vector2i m_size;
+    std::vector<Texel> m_data;
+};
+
+typedef TBitmap<TexelRGB32F>  BitmapRGB32F;
+typedef TBitmap<TexelRGBA16F> BitmapRGBA16F;
+typedef TBitmap<TexelSRGB8>   BitmapSRGB8;
+
+/// Return the size of a texel in bytes
+inline size_t texelSize(ETexelFormat format) {
+    switch (format) {
+        case ETexelRGBA16F: return sizeof(TexelRGBA16F);
+        case ETexelSRGB8: return sizeof(TexelSRGB8);
+        default: return sizeof(TexelRGB32F);
+    }
+}
+
+/// Decode the \c index-th texel of an untyped array in the given format
+inline Color3f decodeTexel(ETexelFormat format, const uint8_t *data, size_t index) {
+    switch (format) {
+        case ETexelRGBA16F: return reinterpret_cast<const TexelRGBA16F *>(data)[index].toColor();
+        case ETexelSRGB8: return reinterpret_cast<const TexelSRGB8 *>(data)[index].toColor();
+        default: return reinterpret_cast<const TexelRGB32F *>(data)[index].toColor();
+    }
+}
+
+/// Encode a color as the \c index-th texel of an untyped array in the given format
+inline void encodeTexel(ETexelFormat format, uint8_t *data, size_t index, const Color3f &value) {
+    switch (format) {
+        case ETexelRGBA16F: reinterpret_cast<TexelRGBA16F *>(data)[index] = TexelRGBA16F(value); break;
+        case ETexelSRGB8: reinterpret_cast<TexelSRGB8 *>(data)[index] = TexelSRGB8(value); break;
+        default: reinterpret_cast<TexelRGB32F *>(data)[index] = TexelRGB32F(value); break;
+    }
+}
+
+NORI_NAMESPACE_END
@@ -17,6 +17,17 @@ public:
 
     virtual Color3f eval(const Point2f &uv) const = 0;
 
+    /**
+     * \brief Evaluate the texture filtered over a footprint given by the
+     * screen-space derivatives of the uv coordinates
+     *
+     * The default implementation ignores the footprint.
+     */
+    virtual Color3f eval(const Point2f &uv, const Vector2f &duvdx, const Vector2f &duvdy) const {
+        (void) duvdx; (void) duvdy;
+        return eval(uv);
+    }
+
     EClassType getClassType() const { return ETexture; }
 
 protected:
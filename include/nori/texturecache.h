@@ -0,0 +1,175 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Tiled texture cache with a memory budget
+*/
+
+#pragma once
+
+#include <nori/texel.h>
+#include <nori/vector.h>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+NORI_NAMESPACE_BEGIN
+
+class TextureCache;
+
+/**
+ * \brief Texture whose texels are paged in tile by tile through the
+ * global \ref TextureCache
+ *
+ * Levels stored in the file (e.g. the mip levels of a tiled OpenEXR
+ * file) are read on demand, all coarser levels are computed on demand
+ * by a 2x2 box filter of the next finer level.
+ */
+class CachedTexture {
+public:
+    ~CachedTexture();
+
+    /// Return the number of levels
+    int getLevelCount() const { return (int) m_levels.size(); }
+
+    /// Return the resolution of a level
+    Vector2i getSize(int level) const { return m_levels[level].size; }
+
+    /// Return the texel format of the cached tiles
+    ETexelFormat getFormat() const { return m_format; }
+
+    /// Return the file name
+    const std::string &getFilename() const { return m_filename; }
+
+    /**
+     * \brief Fetch a texel (coordinates must be inside the level, \c y is
+     * counted from the top)
+     *
+     * Must be called inside a \ref TextureCache::ReadScope. Resident tiles
+     * are accessed without taking any lock.
+     */
+    Color3f texel(int level, int x, int y) const;
+
+    /// Return a human-readable summary
+    std::string toString() const;
+
+private:
+    friend class TextureCache;
+    struct Tile;
+    struct File;
+
+    struct Level {
+        Vector2i size;
+        Vector2i tiles;
+        bool inFile = false;
+        std::unique_ptr<std::atomic<Tile *>[]> slots;
+    };
+
+    CachedTexture(TextureCache &cache, const std::string &filename, ETexelFormat format);
+
+    const Tile *fetchTile(int level, int tx, int ty) const;
+
+    TextureCache &m_cache;
+    std::string m_filename;
+    ETexelFormat m_format;
+    Vector2i m_tileSize;
+    std::vector<Level> m_levels;
+    std::unique_ptr<File> m_file;
+};
+
+/**
+ * \brief Process-wide cache of texture tiles with a memory budget
+ *
+ * Tiles are loaded on first access and kept until the budget is exceeded,
+ * at which point the least recently used tiles are evicted (approximated
+ * by the CLOCK algorithm: every access sets a reference bit, the eviction
+ * sweep clears it and evicts tiles whose bit is already clear).
+ *
+ * Render threads access resident tiles without locking. To be able to
+ * release evicted tiles safely, all accesses happen inside a
+ * \ref ReadScope, which publishes the current epoch of the thread; an
+ * evicted tile is freed once no thread is still inside a scope that
+ * started before its eviction.
+ */
+class TextureCache {
+public:
+    /// Return the global instance
+    static TextureCache &instance();
+
+    /// Set the memory budget in bytes
+    void setMemoryBudget(size_t bytes) { m_budget = bytes; }
+
+    /// Return the memory budget in bytes
+    size_t getMemoryBudget() const { return m_budget; }
+
+    /// Return the memory currently occupied by resident tiles in bytes
+    size_t getMemoryUsage() const { return m_usage; }
+
+    /**
+     * \brief Register an OpenEXR texture with the cache
+     *
+     * Only the header is read here. The returned texture stays valid
+     * for the lifetime of the cache.
+     */
+    const CachedTexture *open(const std::string &filename, ETexelFormat format);
+
+private:
+    struct ThreadSlot;
+
+public:
+    /// Marks a region in which the calling thread accesses cached tiles (may be nested)
+    class ReadScope {
+    public:
+        explicit ReadScope(TextureCache &cache = TextureCache::instance());
+        ~ReadScope();
+        ReadScope(const ReadScope &) = delete;
+        ReadScope &operator=(const ReadScope &) = delete;
+    private:
+        TextureCache &m_cache;
+        ThreadSlot &m_slot;
+    };
+
+    ~TextureCache();
+
+private:
+    friend class CachedTexture;
+
+    struct alignas(64) ThreadSlot {
+        std::atomic<uint64_t> epoch{ 0 };
+        int depth = 0;
+    };
+
+    struct Retired {
+        CachedTexture::Tile *tile;
+        uint64_t epoch;
+    };
+
+    TextureCache() = default;
+
+    /// Return the epoch slot of the calling thread
+    ThreadSlot &threadSlot();
+
+    /// Account for a newly published tile and evict tiles if necessary
+    void insert(CachedTexture::Tile *tile);
+
+    /// CLOCK sweep until the usage is below the target (requires m_mutex)
+    void evict(size_t target);
+
+    /// Free retired tiles that can no longer be referenced (requires m_mutex)
+    void reclaim();
+
+    std::atomic<size_t> m_budget{ (size_t) 1 << 30 };
+    std::atomic<size_t> m_usage{ 0 };
+    std::atomic<uint64_t> m_epoch{ 1 };
+
+    std::mutex m_mutex;
+    std::deque<std::unique_ptr<CachedTexture>> m_textures;
+    std::vector<CachedTexture::Tile *> m_resident;
+    size_t m_clockHand = 0;
+    std::vector<Retired> m_retired;
+
+    std::mutex m_threadMutex;
+    std::deque<ThreadSlot> m_threads;
+};
+
+NORI_NAMESPACE_END
@@ -0,0 +1,71 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Arbitrary output variables
+*/
+
+#include <nori/aov.h>
+#include <nori/scene.h>
+#include <nori/mesh.h>
+#include <nori/bsdf.h>
+#include <nori/sampler.h>
+
+NORI_NAMESPACE_BEGIN
+
+EAOVType aovTypeFromString(const std::string &name) {
+    const std::string value = toLower(name);
+    for (int i = 0; i < EAOVTypeCount; ++i) {
+        if (value == toLower(aovTypeName((EAOVType) i)))
+            return (EAOVType) i;
+    }
+    throw NoriException("Unknown AOV \"%s\" (expected depth, normal, albedo, "
+                        "primId, sampleCount or variance)", name);
+}
+
+const char *aovTypeName(EAOVType type) {
+    static const char *names[] = { "depth", "normal", "albedo", "primId", "sampleCount", "variance" };
+    return names[type];
+}
+
+std::vector<EAOVType> parseAOVList(const std::string &list) {
+    std::vector<EAOVType> result;
+    for (const std::string &token : tokenize(list, ", ")) {
+        const EAOVType type = aovTypeFromString(token);
+        if (std::find(result.begin(), result.end(), type) != result.end())
+            throw NoriException("AOV \"%s\" was specified more than once!", token);
+        result.push_back(type);
+    }
+    return result;
+}
+
+std::string aovListString(const std::vector<EAOVType> &aovs) {
+    std::string result;
+    for (size_t i = 0; i < aovs.size(); ++i) {
+        if (i > 0)
+            result += ", ";
+        result += aovTypeName(aovs[i]);
+    }
+    return result;
+}
+
+void AOVRecord::record(const Scene *scene, Sampler *sampler, const Ray3f &ray) {
+    Intersection its;
+    if (scene->rayIntersect(ray, its))
+        record(its, sampler, ray);
+}
+
+void AOVRecord::record(const Intersection &its, Sampler *sampler, const Ray3f &ray) {
+    depth = its.t;
+    normal = its.shFrame.n;
+    meshIndex = (int) its.mesh->idx;
+    primIndex = (int) its.prim_idx;
+
+    /* The BSDF sampling weight is an unbiased estimate of the albedo */
+    BSDFQueryRecord bRec(its.toLocal(-ray.d), its.uv);
+    bRec.duvdx = its.duvdx;
+    bRec.duvdy = its.duvdy;
+    albedo = its.mesh->getBSDF()->sample(bRec, sampler->next2D());
+    if (!albedo.isValid())
+        albedo = Color3f(0.0f);
+}
+
+NORI_NAMESPACE_END
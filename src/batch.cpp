@@ -0,0 +1,109 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Batch rendering of several jobs with the same scene
+*/
+
+#include <nori/batch.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/integrator.h>
+#include <nori/sampler.h>
+#include <set>
+
+NORI_NAMESPACE_BEGIN
+
+RenderJob::RenderJob(const PropertyList &propList) {
+    /* suffix of the output file */
+    m_name = propList.getString("name");
+    /* animation frame to render (-1 keeps the geometry of the previous job) */
+    m_frame = propList.getInteger("frame", -1);
+}
+
+RenderJob::~RenderJob() = default;
+
+void RenderJob::swap(Scene *scene) {
+    scene->swapObjects(m_camera, m_integrator, m_sampler, m_rendermanager);
+}
+
+void RenderJob::addChild(NoriObject *obj) {
+    switch (obj->getClassType()) {
+        case ECamera:
+            if (m_camera)
+                throw NoriException("There can only be one camera per job!");
+            m_camera.reset(static_cast<Camera *>(obj));
+            break;
+
+        case EIntegrator:
+            if (m_integrator)
+                throw NoriException("There can only be one integrator per job!");
+            m_integrator.reset(static_cast<Integrator *>(obj));
+            break;
+
+        case ESampler:
+            if (m_sampler)
+                throw NoriException("There can only be one sampler per job!");
+            m_sampler.reset(static_cast<Sampler *>(obj));
+            break;
+
+        case ERenderManager:
+            if (m_rendermanager)
+                throw NoriException("There can only be one render manager per job!");
+            m_rendermanager.reset(static_cast<RenderManager *>(obj));
+            break;
+
+        default:
+            throw NoriException("RenderJob::addChild(<%s>) is not supported!",
+                classTypeName(obj->getClassType()));
+    }
+}
+
+std::string RenderJob::toString() const {
+    return tfm::format(
+        "RenderJob[\n"
+        "  name = \"%s\",\n"
+        "  frame = %i,\n"
+        "  camera = %s,\n"
+        "  integrator = %s,\n"
+        "  sampler = %s,\n"
+        "  rendermanager = %s\n"
+        "]",
+        m_name, m_frame,
+        indent(m_camera ? m_camera->toString() : std::string("(scene)")),
+        indent(m_integrator ? m_integrator->toString() : std::string("(scene)")),
+        indent(m_sampler ? m_sampler->toString() : std::string("(scene)")),
+        indent(m_rendermanager ? m_rendermanager->toString() : std::string("(scene)"))
+    );
+}
+
+void RenderBatch::addChild(NoriObject *obj) {
+    if (obj->getClassType() != EJob)
+        throw NoriException("RenderBatch::addChild(<%s>) is not supported!",
+            classTypeName(obj->getClassType()));
+    m_jobs.emplace_back(static_cast<RenderJob *>(obj));
+}
+
+void RenderBatch::activate() {
+    if (m_jobs.empty())
+        throw NoriException("The batch does not contain any jobs!");
+
+    std::set<std::string> names;
+    for (const auto &job : m_jobs) {
+        if (!names.insert(job->getName()).second)
+            throw NoriException("There are multiple jobs named \"%s\"!", job->getName());
+    }
+}
+
+std::string RenderBatch::toString() const {
+    std::string jobs;
+    for (size_t i=0; i<m_jobs.size(); ++i) {
+        jobs += std::string("  ") + indent(m_jobs[i]->toString(), 2);
+        if (i + 1 < m_jobs.size())
+            jobs += ",";
+        jobs += "\n";
+    }
+    return tfm::format("RenderBatch[\n%s]", jobs);
+}
+
+NORI_REGISTER_CLASS(RenderJob, "job");
+NORI_REGISTER_CLASS(RenderBatch, "batch");
+NORI_NAMESPACE_END
@@ -7,14 +7,26 @@
 #include <nori/bitmap.h>
 #include <ImfInputFile.h>
 #include <ImfOutputFile.h>
+#include <ImfTiledOutputFile.h>
 #include <ImfChannelList.h>
 #include <ImfStringAttribute.h>
 #include <ImfVersion.h>
 #include <ImfIO.h>
+#include <ImfThreading.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <exception>
+#include <thread>
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
 
+/* stb_image is bundled with NanoVG, keep the functions local to this file
+   so that they don't clash with the copy compiled into NanoGUI */
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
 NORI_NAMESPACE_BEGIN
 
 Bitmap::Bitmap(const std::string &filename) {
@@ -66,59 +78,300 @@ Bitmap::Bitmap(const std::string &filename) {
     file.readPixels(dw.min.y, dw.max.y);
 }
 
-void Bitmap::saveEXR(const std::string &filename) {
+static EXROptions exrOptions;
+
+EXROptions::ECompression EXROptions::compressionFromString(const std::string &name) {
+    const std::string value = toLower(name);
+    if (value == "none")
+        return ENone;
+    else if (value == "zip")
+        return EZip;
+    else if (value == "piz")
+        return EPiz;
+    else if (value == "dwaa")
+        return EDWAA;
+    throw NoriException("Unknown EXR compression \"%s\" (expected none, zip, piz or dwaa)", name);
+}
+
+const char *EXROptions::compressionName(ECompression compression) {
+    static const char *names[] = { "none", "zip", "piz", "dwaa" };
+    return names[compression];
+}
+
+std::string EXROptions::toString() const {
+    return tfm::format("EXROptions[compression=%s, half=%s]",
+        compressionName(compression), half ? "true" : "false");
+}
+
+void Bitmap::setEXROptions(const EXROptions &options) {
+    exrOptions = options;
+}
+
+const EXROptions &Bitmap::getEXROptions() {
+    return exrOptions;
+}
+
+void Bitmap::setIOThreadCount(int count) {
+    Imf::setGlobalThreadCount(std::max(count, 0));
+}
+
+static Imf::Compression toImfCompression(EXROptions::ECompression compression) {
+    static const Imf::Compression table[] = {
+        Imf::NO_COMPRESSION, Imf::ZIP_COMPRESSION, Imf::PIZ_COMPRESSION, Imf::DWAA_COMPRESSION
+    };
+    return table[compression];
+}
+
+void Bitmap::saveEXR(const std::string &filename) const {
+    saveEXR(filename, exrOptions, {});
+}
+
+void Bitmap::saveEXR(const std::string &filename, const EXROptions &options,
+                     const std::vector<BitmapLayer> &layers) const {
     std::string path = filename + ".exr";
 
     cout << "Writing a " << cols() << "x" << rows()
-         << " OpenEXR file to \"" << path << "\"" << endl;
+         << " OpenEXR file to \"" << path << "\"";
+    if (!layers.empty())
+        cout << " (" << layers.size() << " additional layers)";
+    cout << endl;
 
     Imf::Header header((int) cols(), (int) rows());
     header.insert("comments", Imf::StringAttribute("Generated by Nori"));
+    header.compression() = toImfCompression(options.compression);
 
-    Imf::ChannelList &channels = header.channels();
-    channels.insert("R", Imf::Channel(Imf::FLOAT));
-    channels.insert("G", Imf::Channel(Imf::FLOAT));
-    channels.insert("B", Imf::Channel(Imf::FLOAT));
+    /* Collect the channels as (name, bitmap, component) */
+    struct Channel {
+        std::string name;
+        const Bitmap *bitmap;
+        int component;
+        bool integer;
+    };
+    std::vector<Channel> channels = { { "R", this, 0, false }, { "G", this, 1, false }, { "B", this, 2, false } };
+    for (const BitmapLayer &layer : layers) {
+        if (layer.bitmap.cols() != cols() || layer.bitmap.rows() != rows())
+            throw NoriException("Bitmap::saveEXR(): layer \"%s\" has invalid dimensions!", layer.name);
+        if (layer.channels.size() > 3)
+            throw NoriException("Bitmap::saveEXR(): layer \"%s\" has too many channels!", layer.name);
+        for (size_t i = 0; i < layer.channels.size(); ++i)
+            channels.push_back({ layer.name + "." + layer.channels[i], &layer.bitmap, (int) i, layer.integer });
+    }
 
-    Imf::FrameBuffer frameBuffer;
-    size_t compStride = sizeof(float),
-           pixelStride = 3 * compStride,
-           rowStride = pixelStride * cols();
+    /* Integer channels (ids) are never stored as half, which is exact only up to 2048 */
+    const auto pixelType = [&](const Channel &channel) {
+        return channel.integer ? Imf::UINT : (options.half ? Imf::HALF : Imf::FLOAT);
+    };
+    for (const Channel &channel : channels)
+        header.channels().insert(channel.name.c_str(), Imf::Channel(pixelType(channel)));
 
-    char *ptr = reinterpret_cast<char *>(data());
-    frameBuffer.insert("R", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
-    frameBuffer.insert("G", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride)); ptr += compStride;
-    frameBuffer.insert("B", Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+    /* Convert to half precision or integers up front (one plane per channel),
+       OpenEXR would do it per scanline */
+    std::vector<half> halfData;
+    std::vector<uint32_t> uintData;
+    if (options.half)
+        halfData.resize(channels.size() * (size_t) size());
+    if (std::any_of(channels.begin(), channels.end(), [](const Channel &channel) { return channel.integer; }))
+        uintData.resize(channels.size() * (size_t) size());
+    if (!halfData.empty() || !uintData.empty()) {
+        tbb::parallel_for(tbb::blocked_range<int>(0, (int) rows()),
+            [&](const tbb::blocked_range<int> &range) {
+                for (size_t c = 0; c < channels.size(); ++c) {
+                    const Channel &channel = channels[c];
+                    for (int y = range.begin(); y != range.end(); ++y) {
+                        const size_t offset = c * (size_t) size() + (size_t) y * cols();
+                        for (int x = 0; x < cols(); ++x) {
+                            const float value = channel.bitmap->coeff(y, x)[channel.component];
+                            if (channel.integer)
+                                uintData[offset + x] = value < 0.0f ? 0xFFFFFFFFu : (uint32_t) value;
+                            else if (options.half)
+                                halfData[offset + x] = half(value);
+                        }
+                    }
+                }
+            }
+        );
+    }
 
+    Imf::FrameBuffer frameBuffer;
+    for (size_t c = 0; c < channels.size(); ++c) {
+        const Channel &channel = channels[c];
+        if (channel.integer) {
+            char *ptr = reinterpret_cast<char *>(&uintData[c * (size_t) size()]);
+            frameBuffer.insert(channel.name.c_str(), Imf::Slice(Imf::UINT, ptr,
+                sizeof(uint32_t), sizeof(uint32_t) * cols()));
+        } else if (options.half) {
+            char *ptr = reinterpret_cast<char *>(&halfData[c * (size_t) size()]);
+            frameBuffer.insert(channel.name.c_str(), Imf::Slice(Imf::HALF, ptr,
+                sizeof(half), sizeof(half) * cols()));
+        } else {
+            char *ptr = reinterpret_cast<char *>(const_cast<Color3f *>(channel.bitmap->data()))
+                + channel.component * sizeof(float);
+            frameBuffer.insert(channel.name.c_str(), Imf::Slice(Imf::FLOAT, ptr,
+                sizeof(Color3f), sizeof(Color3f) * cols()));
+        }
+    }
+
+    /* Blocks of scanlines are compressed by OpenEXR's global thread pool */
     Imf::OutputFile file(path.c_str(), header);
     file.setFrameBuffer(frameBuffer);
     file.writePixels((int) rows());
 }
 
-void Bitmap::savePNG(const std::string &filename) {
+/**
+ * \brief Convert a linear value to 8 bit sRGB (truncating, like 255 * toSRGB())
+ *
+ * Entry \c i of \c thresholds is the linearized value of i/255 (see
+ * \ref sRGBToLinearTable()), i.e. the smallest linear value mapped to code
+ * \c i, so the conversion is a binary search instead of a \c pow call.
+ */
+static inline uint8_t toSRGB8(const std::array<float, 256> &thresholds, float value) {
+    if (!(value > 0.0f))
+        return 0;
+    int code = 0;
+    for (int step = 128; step > 0; step >>= 1) {
+        if (thresholds[code + step] <= value)
+            code += step;
+    }
+    return (uint8_t) code;
+}
+
+void Bitmap::savePNG(const std::string &filename) const {
     std::string path = filename + ".png";
 
     cout << "Writing a " << cols() << "x" << rows()
          << " PNG file to \"" << path << "\"" << endl;
 
-    uint8_t *rgb8 = new uint8_t[3 * cols() * rows()];
-    uint8_t *dst = rgb8;
-    for (int i = 0; i < rows(); ++i) {
-        for (int j = 0; j < cols(); ++j) {
-            Color3f tonemapped = coeffRef(i, j).toSRGB();
-            dst[0] = (uint8_t) clamp(255.f * tonemapped[0], 0.f, 255.f);
-            dst[1] = (uint8_t) clamp(255.f * tonemapped[1], 0.f, 255.f);
-            dst[2] = (uint8_t) clamp(255.f * tonemapped[2], 0.f, 255.f);
-            dst += 3;
+    const std::array<float, 256> &thresholds = sRGBToLinearTable();
+    std::vector<uint8_t> rgb8(3 * (size_t) size());
+    tbb::parallel_for(tbb::blocked_range<int>(0, (int) rows()),
+        [&](const tbb::blocked_range<int> &range) {
+            for (int i = range.begin(); i != range.end(); ++i) {
+                uint8_t *dst = &rgb8[3 * (size_t) i * cols()];
+                for (int j = 0; j < cols(); ++j) {
+                    const Color3f &value = coeff(i, j);
+                    dst[0] = toSRGB8(thresholds, value[0]);
+                    dst[1] = toSRGB8(thresholds, value[1]);
+                    dst[2] = toSRGB8(thresholds, value[2]);
+                    dst += 3;
+                }
+            }
         }
-    }
+    );
 
-    int ret = stbi_write_png(path.c_str(), (int) cols(), (int) rows(), 3, rgb8, 3 * (int) cols());
+    int ret = stbi_write_png(path.c_str(), (int) cols(), (int) rows(), 3, rgb8.data(), 3 * (int) cols());
     if (ret == 0) {
         cout << "Bitmap::savePNG(): Could not save PNG file \"" << path << "%s\"" << endl;
     }
+}
+
+void Bitmap::save(const std::string &filename, const std::vector<BitmapLayer> &layers) const {
+    /* Both writers only read the bitmap */
+    std::exception_ptr exrError;
+    std::thread exrThread([&] {
+        try {
+            saveEXR(filename, exrOptions, layers);
+        } catch (...) {
+            exrError = std::current_exception();
+        }
+    });
+    try {
+        savePNG(filename);
+    } catch (...) {
+        exrThread.join();
+        throw;
+    }
+    exrThread.join();
+    if (exrError)
+        std::rethrow_exception(exrError);
+}
+
+struct TiledEXRWriter::File {
+    Imf::TiledOutputFile file;
+
+    File(const char *path, const Imf::Header &header) : file(path, header) { }
+};
+
+TiledEXRWriter::TiledEXRWriter(const std::string &filename, const Vector2i &size, int tileSize,
+                               const EXROptions &options)
+        : m_size(size), m_tileSize(tileSize), m_half(options.half) {
+    std::string path = filename + ".exr";
+
+    cout << "Streaming a " << size.x() << "x" << size.y()
+         << " OpenEXR file to \"" << path << "\"" << endl;
+
+    Imf::Header header(size.x(), size.y());
+    header.insert("comments", Imf::StringAttribute("Generated by Nori"));
+    header.compression() = toImfCompression(options.compression);
+    header.lineOrder() = Imf::RANDOM_Y;
+    header.setTileDescription(Imf::TileDescription(tileSize, tileSize, Imf::ONE_LEVEL));
+
+    const Imf::PixelType pixelType = m_half ? Imf::HALF : Imf::FLOAT;
+    header.channels().insert("R", Imf::Channel(pixelType));
+    header.channels().insert("G", Imf::Channel(pixelType));
+    header.channels().insert("B", Imf::Channel(pixelType));
+
+    m_file = std::make_unique<File>(path.c_str(), header);
+}
+
+TiledEXRWriter::~TiledEXRWriter() = default;
+
+Vector2i TiledEXRWriter::getTileCount() const {
+    return (m_size + Vector2i::Constant(m_tileSize - 1)) / m_tileSize;
+}
+
+void TiledEXRWriter::writeTile(int tx, int ty, const Bitmap &tile) {
+    const int x0 = tx * m_tileSize, y0 = ty * m_tileSize;
+    if (tile.cols() != std::min(m_tileSize, m_size.x() - x0) ||
+        tile.rows() != std::min(m_tileSize, m_size.y() - y0))
+        throw NoriException("TiledEXRWriter::writeTile(): invalid tile dimensions!");
+
+    std::vector<half> halfData;
+    const Imf::PixelType pixelType = m_half ? Imf::HALF : Imf::FLOAT;
+    size_t compStride = m_half ? sizeof(half) : sizeof(float),
+           pixelStride = 3 * compStride,
+           rowStride = pixelStride * tile.cols();
+
+    char *ptr;
+    if (m_half) {
+        halfData.resize(3 * (size_t) tile.size());
+        for (Eigen::Index i = 0; i < tile.size(); ++i)
+            for (int k = 0; k < 3; ++k)
+                halfData[3 * i + k] = half(tile.data()[i][k]);
+        ptr = reinterpret_cast<char *>(halfData.data());
+    } else {
+        ptr = reinterpret_cast<char *>(const_cast<Color3f *>(tile.data()));
+    }
+
+    /* The frame buffer is addressed in image coordinates */
+    ptr -= x0 * pixelStride + y0 * rowStride;
+
+    Imf::FrameBuffer frameBuffer;
+    frameBuffer.insert("R", Imf::Slice(pixelType, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("G", Imf::Slice(pixelType, ptr, pixelStride, rowStride)); ptr += compStride;
+    frameBuffer.insert("B", Imf::Slice(pixelType, ptr, pixelStride, rowStride));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_file->file.setFrameBuffer(frameBuffer);
+    m_file->file.writeTile(tx, ty);
+}
+
+BitmapSRGB8 loadLDRBitmap(const std::string &filename) {
+    int width = 0, height = 0, channels = 0;
+    uint8_t *rgb8 = stbi_load(filename.c_str(), &width, &height, &channels, 3);
+    if (!rgb8)
+        throw NoriException("Could not load image \"%s\": %s", filename, stbi_failure_reason());
+
+    cout << "Reading a " << width << "x" << height << " image from \""
+         << filename << "\"" << endl;
+
+    BitmapSRGB8 bitmap(Vector2i(width, height));
+    memcpy(bitmap.data(), rgb8, (size_t) width * height * 3);
+    stbi_image_free(rgb8);
+    return bitmap;
+}
 
-    delete[] rgb8;
+bool isOpenEXRFile(const std::string &filename) {
+    return endsWith(toLower(filename), ".exr");
 }
 
 NORI_NAMESPACE_END
@@ -1,5 +1,6 @@
 #include <nori/texture.h>
-#include <nori/bitmap.h>
+#include <nori/mipmap.h>
+#include <memory>
 
 #include <filesystem/resolver.h>
 
@@ -16,37 +17,65 @@ public:
 
         m_filename = filename.str();
 
-        m_bitmap = new Bitmap(m_filename);
-        m_res = Point2i(m_bitmap->cols(), m_bitmap->rows());
+        // texture filter: nearest, bilinear, trilinear or ewa
+        MipMap::EFilter filter = MipMap::filterFromString(propList.getString("filter", "trilinear"));
+        float maxAnisotropy = propList.getFloat("maxAnisotropy", 8.0f);
+
+        // texel format: float, half or srgb8 (default: float for OpenEXR files, srgb8 otherwise)
+        const bool isEXR = isOpenEXRFile(m_filename);
+        ETexelFormat format = texelFormatFromString(propList.getString("format", isEXR ? "float" : "srgb8"));
+
+        // page the texture in tile by tile through the global texture cache
+        m_cached = propList.getBoolean("cache", false);
+
+        if (m_cached) {
+            if (!isEXR)
+                throw NoriException("BitmapTexture: the texture cache only supports OpenEXR files (\"%s\")", m_filename);
+            const CachedTexture *texture = TextureCache::instance().open(m_filename, format);
+            m_mipmap = std::make_unique<TMipMap<CachedPyramid>>(CachedPyramid(texture), filter, maxAnisotropy);
+        } else {
+            switch (format) {
+                case ETexelRGBA16F: m_mipmap = createMipMap<TexelRGBA16F>(isEXR, filter, maxAnisotropy); break;
+                case ETexelSRGB8: m_mipmap = createMipMap<TexelSRGB8>(isEXR, filter, maxAnisotropy); break;
+                default: m_mipmap = createMipMap<TexelRGB32F>(isEXR, filter, maxAnisotropy); break;
+            }
+        }
     }
 
-    Color3f eval(const Point2f &uv) const {
-        const Point2f finalUV = applyUVScaleAndOffset(uv);
-
-        // compute pixel coordinates
-        int x = ((int(finalUV[0]*m_res[0]) % m_res[0]) + m_res[0]) % m_res[0];
-        int y = ((int(finalUV[1]*m_res[1]) % m_res[1]) + m_res[1]) % m_res[1];
-
-        //flip y coordinate because uv starts at bottom left
-        //and xy starts at top left
-        y = m_res[1]-(y+1);
+    Color3f eval(const Point2f &uv) const override {
+        return m_mipmap->eval(applyUVScaleAndOffset(uv))*m_scale;
+    }
 
-        //the bitmap is stored in row-major format
-        return m_bitmap->coeff(y, x)*m_scale;
+    Color3f eval(const Point2f &uv, const Vector2f &duvdx, const Vector2f &duvdy) const override {
+        // the footprint is scaled along with the uv coordinates
+        return m_mipmap->eval(applyUVScaleAndOffset(uv),
+            duvdx.cwiseProduct(m_uvscale), duvdy.cwiseProduct(m_uvscale))*m_scale;
     }
 
-    std::string toString() const {
+    std::string toString() const override {
         std::ostringstream oss;
         oss << "BitmapTexture[" << endl
             << " filename = " << m_filename << endl
+            << " cached = " << (m_cached ? "true" : "false") << endl
+            << " mipmap = " << m_mipmap->toString() << endl
             << "]";
         return oss.str();
     }
 
 private:
+    /// Load the texture into an in-memory pyramid with the given texel format
+    template <typename Texel>
+    std::unique_ptr<MipMap> createMipMap(bool isEXR, MipMap::EFilter filter, float maxAnisotropy) const {
+        TBitmap<Texel> bitmap = isEXR ? TBitmap<Texel>(Bitmap(m_filename))
+                                      : TBitmap<Texel>(loadLDRBitmap(m_filename));
+        bool buildLevels = filter == MipMap::ETrilinear || filter == MipMap::EEWA;
+        return std::make_unique<TMipMap<TBitmapPyramid<Texel>>>(
+            TBitmapPyramid<Texel>(std::move(bitmap), buildLevels), filter, maxAnisotropy);
+    }
+
     std::string m_filename;
-    Bitmap *m_bitmap;
-    Point2i m_res;
+    std::unique_ptr<MipMap> m_mipmap;
+    bool m_cached;
     Color3f m_scale;
 
 };
@@ -89,6 +89,66 @@ void ImageBlock::put(const Point2f &_pos, const Color3f &value) {
             coeffRef(y, x) += Color4f(value) * m_weightsX[xr] * m_weightsY[yr];
 }
 
+/// Number of floats stored per pixel for an AOV
+static int aovSize(EAOVType type) {
+    switch (type) {
+        case EAOVDepth: return 1;
+        case EAOVNormal: return 3;
+        case EAOVAlbedo: return 3;
+        case EAOVPrimitiveId: return 2;
+        case EAOVVariance: return 6;
+        default: return 0;
+    }
+}
+
+void ImageBlock::put(const Point2f &pos, const Color3f &value, const AOVRecord &aovs) {
+    put(pos, value);
+    if (!value.isValid() || m_aovTypes.empty())
+        return;
+
+    /* AOVs are box filtered: find the pixel containing the sample */
+    const int x = (int) std::floor(pos.x()) - m_offset.x() + m_borderSize;
+    const int y = (int) std::floor(pos.y()) - m_offset.y() + m_borderSize;
+    if (x < 0 || y < 0 || x >= cols() || y >= rows())
+        return;
+
+    float *pixel = &m_aovData[((size_t) y * cols() + x) * m_aovStride];
+    const bool firstSample = pixel[0] == 0.0f;
+    pixel[0] += 1.0f;
+
+    for (size_t i = 0; i < m_aovTypes.size(); ++i) {
+        float *dst = pixel + m_aovOffsets[i];
+        switch (m_aovTypes[i]) {
+            case EAOVDepth:
+                dst[0] += aovs.depth;
+                break;
+            case EAOVNormal:
+                for (int k = 0; k < 3; ++k)
+                    dst[k] += aovs.normal[k];
+                break;
+            case EAOVAlbedo:
+                for (int k = 0; k < 3; ++k)
+                    dst[k] += aovs.albedo[k];
+                break;
+            case EAOVPrimitiveId:
+                /* ids can't be averaged, keep the first sample */
+                if (firstSample) {
+                    dst[0] = (float) aovs.meshIndex;
+                    dst[1] = (float) aovs.primIndex;
+                }
+                break;
+            case EAOVVariance:
+                for (int k = 0; k < 3; ++k) {
+                    dst[k] += value[k];
+                    dst[k + 3] += value[k] * value[k];
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
 void ImageBlock::put(ImageBlock &b) {
     Vector2i offset = b.getOffset() - m_offset +
         Vector2i::Constant(m_borderSize - b.getBorderSize());
@@ -98,6 +158,105 @@ void ImageBlock::put(ImageBlock &b) {
 
     block(offset.y(), offset.x(), size.y(), size.x())
         += b.topLeftCorner(size.y(), size.x());
+
+    if (m_aovTypes.empty())
+        return;
+    if (b.m_aovTypes != m_aovTypes)
+        throw NoriException("ImageBlock::put(): cannot merge blocks with different AOVs!");
+
+    for (int y = 0; y < size.y(); ++y) {
+        for (int x = 0; x < size.x(); ++x) {
+            const float *src = &b.m_aovData[((size_t) y * b.cols() + x) * m_aovStride];
+            float *dst = &m_aovData[((size_t) (y + offset.y()) * cols() + x + offset.x()) * m_aovStride];
+            if (src[0] == 0.0f)
+                continue;
+            const bool firstSample = dst[0] == 0.0f;
+            dst[0] += src[0];
+
+            for (size_t i = 0; i < m_aovTypes.size(); ++i) {
+                const int o = m_aovOffsets[i], n = aovSize(m_aovTypes[i]);
+                if (m_aovTypes[i] == EAOVPrimitiveId) {
+                    /* ids are taken over instead of summed */
+                    if (firstSample)
+                        std::copy(src + o, src + o + n, dst + o);
+                } else {
+                    for (int k = 0; k < n; ++k)
+                        dst[o + k] += src[o + k];
+                }
+            }
+        }
+    }
+}
+
+void ImageBlock::setAOVs(const std::vector<EAOVType> &aovs) {
+    m_aovTypes = aovs;
+    m_aovOffsets.clear();
+    m_aovStride = 0;
+    m_aovData.clear();
+    if (aovs.empty())
+        return;
+
+    m_aovStride = 1;
+    for (EAOVType type : aovs) {
+        m_aovOffsets.push_back(m_aovStride);
+        m_aovStride += aovSize(type);
+    }
+    m_aovData.assign((size_t) rows() * cols() * m_aovStride, 0.0f);
+}
+
+std::vector<BitmapLayer> ImageBlock::toAOVLayers() const {
+    std::vector<BitmapLayer> layers;
+    for (size_t i = 0; i < m_aovTypes.size(); ++i) {
+        const EAOVType type = m_aovTypes[i];
+        BitmapLayer layer;
+        layer.name = aovTypeName(type);
+        switch (type) {
+            case EAOVDepth: layer.channels = { "Z" }; break;
+            case EAOVNormal: layer.channels = { "X", "Y", "Z" }; break;
+            case EAOVPrimitiveId: layer.channels = { "mesh", "prim" }; layer.integer = true; break;
+            case EAOVSampleCount: layer.channels = { "Y" }; break;
+            default: layer.channels = { "R", "G", "B" }; break;
+        }
+        layer.bitmap = Bitmap(m_size);
+
+        for (int y=0; y<m_size.y(); ++y) {
+            for (int x=0; x<m_size.x(); ++x) {
+                const float *pixel = &m_aovData[((size_t) (y + m_borderSize) * cols() +
+                                                 x + m_borderSize) * m_aovStride];
+                const float *src = pixel + m_aovOffsets[i];
+                const float count = pixel[0], invCount = count > 0 ? 1.0f / count : 0.0f;
+
+                Color3f &dst = layer.bitmap.coeffRef(y, x);
+                dst = Color3f(0.0f);
+                switch (type) {
+                    case EAOVDepth:
+                        dst[0] = src[0] * invCount;
+                        break;
+                    case EAOVNormal:
+                    case EAOVAlbedo:
+                        dst = Color3f(src[0], src[1], src[2]) * invCount;
+                        break;
+                    case EAOVPrimitiveId:
+                        dst = count > 0 ? Color3f(src[0], src[1], 0.0f) : Color3f(-1.0f, -1.0f, 0.0f);
+                        break;
+                    case EAOVSampleCount:
+                        dst[0] = count;
+                        break;
+                    case EAOVVariance:
+                        /* unbiased sample variance */
+                        if (count > 1) {
+                            for (int k = 0; k < 3; ++k)
+                                dst[k] = std::max(0.0f, (src[k + 3] - src[k] * src[k] * invCount) / (count - 1));
+                        }
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+        layers.push_back(std::move(layer));
+    }
+    return layers;
 }
 
 std::string ImageBlock::toString() const {
@@ -131,11 +290,18 @@ void BlockGenerator::setBlockCount(const Vector2i &size, int blockSize) {
 }
 
 bool BlockGenerator::next(ImageBlock &block) {
+    int index;
+    return next(block, index);
+}
+
+bool BlockGenerator::next(ImageBlock &block, int &index) {
     std::lock_guard<std::mutex> lock{m_mutex};
 
     if (m_blocksLeft == 0)
         return false;
 
+    index = m_numBlocks.x() * m_numBlocks.y() - m_blocksLeft;
+
     Point2i pos = m_block * m_blockSize;
     block.setOffset(pos);
     block.setSize((m_size - pos).cwiseMin(Vector2i::Constant(m_blockSize)));
@@ -163,4 +329,21 @@ bool BlockGenerator::next(ImageBlock &block) {
     return true;
 }
 
+void OrderedBlockMerger::put(int index, std::unique_ptr<ImageBlock> block) {
+    std::lock_guard<std::mutex> lock{m_mutex};
+
+    m_pending.emplace(index, std::move(block));
+
+    /* merge the contiguous prefix of finished blocks */
+    for (auto it = m_pending.begin(); it != m_pending.end() && it->first == m_next;
+         it = m_pending.erase(it), ++m_next)
+        m_target.put(*it->second);
+}
+
+void OrderedBlockMerger::reset() {
+    std::lock_guard<std::mutex> lock{m_mutex};
+    m_pending.clear();
+    m_next = 0;
+}
+
 NORI_NAMESPACE_END
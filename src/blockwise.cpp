@@ -25,17 +25,25 @@ NORI_NAMESPACE_BEGIN
 class BlockWiseRenderManager : public RenderManager {
 public:
     BlockWiseRenderManager() = default;
-    BlockWiseRenderManager(const PropertyList &propList) { }
+    BlockWiseRenderManager(const PropertyList &propList) {
+        /* merge blocks in a fixed order for bit-identical results */
+        m_deterministic = propList.getBoolean("deterministic", false);
+
+        /* comma-separated list of AOVs to render in the same pass */
+        m_aovs = parseAOVList(propList.getString("aovs", ""));
+    }
 
     void start_render(Scene *scene, ImageBlock& result) override {
         /* Do the following in parallel and asynchronously */
-        render_thread = std::thread([scene, &result] {
+        render_thread = std::thread([scene, &result, deterministic = m_deterministic, aovs = m_aovs] {
             const Camera *camera = scene->getCamera();
             Vector2i outputSize = camera->getOutputSize();
-            scene->getIntegrator()->preprocess(scene);
+            scene->preprocess();
+            result.setAOVs(aovs);
 
             /* Create a block generator (i.e. a work scheduler) */
             BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+            OrderedBlockMerger merger(result);
 
             cout << "Rendering .. ";
             cout.flush();
@@ -46,25 +54,34 @@ public:
             auto map = [&](const tbb::blocked_range<int> &range) {
                 /* Allocate memory for a small image block to be rendered
                    by the current thread */
-                ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
+                auto block = std::make_unique<ImageBlock>(Vector2i(NORI_BLOCK_SIZE),
                         camera->getReconstructionFilter());
+                block->setAOVs(aovs);
 
                 /* Create a clone of the sampler for the current thread */
                 std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
 
                 for (int i=range.begin(); i<range.end(); ++i) {
                     /* Request an image block from the block generator */
-                    blockGenerator.next(block);
+                    int blockIndex;
+                    blockGenerator.next(*block, blockIndex);
 
                     /* Inform the sampler about the block to be rendered */
-                    sampler->prepare(block);
+                    sampler->prepare(*block);
 
                     /* Render all contained pixels */
-                    renderBlock(scene, sampler.get(), block);
+                    renderBlock(scene, sampler.get(), *block);
 
                     /* The image block has been processed. Now add it to
                        the "big" block that represents the entire image */
-                    result.put(block);
+                    if (deterministic) {
+                        merger.put(blockIndex, std::move(block));
+                        block = std::make_unique<ImageBlock>(Vector2i(NORI_BLOCK_SIZE),
+                                camera->getReconstructionFilter());
+                        block->setAOVs(aovs);
+                    } else {
+                        result.put(*block);
+                    }
                 }
             };
 
@@ -80,7 +97,8 @@ public:
 
     std::string toString() const override {
         return tfm::format(
-            "BlockWiseRenderManager[]"
+            "BlockWiseRenderManager[deterministic=%s, aovs={%s}]",
+            m_deterministic ? "true" : "false", aovListString(m_aovs)
         );
     }
 
@@ -96,27 +114,42 @@ private:
         /* Clear the block contents */
         block.clear();
 
+        const float diffScale = 1.0f / std::sqrt((float) std::max<size_t>(sampler->getSampleCount(), 1));
+
         /* For each pixel and pixel sample sample */
         for (int y=0; y<size.y(); ++y) {
             for (int x=0; x<size.x(); ++x) {
 
+                const Point2i pixel(x + offset.x(), y + offset.y());
+
                 /* call before pixel gets sampled */
-                sampler->generate();
+                sampler->startPixelSample(pixel, 0);
 
                 for (uint32_t i=0; i < sampler->getSampleCount(); ++i) {
 
-                    Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
-                    Point2f apertureSample = sampler->next2D();
+                    /* fetch the pixel and aperture sample at once */
+                    Point2f cameraSamples[2];
+                    sampler->fill2D(cameraSamples, 2);
+
+                    Point2f pixelSample = Point2f((float) pixel.x(), (float) pixel.y()) + cameraSamples[0];
+                    const Point2f &apertureSample = cameraSamples[1];
 
                     /* Sample a ray from the camera */
                     Ray3f ray;
                     Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
 
-                    /* Compute the incident radiance */
-                    value *= integrator->Li(scene, sampler, ray);
+                    /* Shrink the footprint to the area covered by one sample */
+                    ray.scaleDifferentials(diffScale);
 
-                    /* Store in the image block */
-                    block.put(pixelSample, value);
+                    /* Compute the incident radiance (and the AOVs) and store it in the image block */
+                    if (block.hasAOVs()) {
+                        AOVRecord aovs;
+                        value *= integrator->LiAOV(scene, sampler, ray, aovs);
+                        block.put(pixelSample, value, aovs);
+                    } else {
+                        value *= integrator->Li(scene, sampler, ray);
+                        block.put(pixelSample, value);
+                    }
 
                     /* advance to next sample */
                     sampler->advance();
@@ -125,6 +158,7 @@ private:
         }
     }
 
+    bool m_deterministic = false;
 };
 
 
@@ -8,10 +8,12 @@
 #include <nori/timer.h>
 #include <tbb/blocked_range.h>
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
 #include <tbb/parallel_reduce.h>
 #include <tbb/task.h>
 #include <Eigen/Geometry>
 #include <atomic>
+#include <functional>
 
 /*
  * =======================================================================
@@ -45,6 +47,7 @@ struct Bins {
 class BVHBuildTask : public tbb::task {
 private:
     BVH &bvh;
+    std::vector<BVH::BVHNode> &nodes;
     uint32_t node_idx;
     uint32_t *start, *end, *temp;
 
@@ -69,6 +72,10 @@ public:
      * \param bvh
      *    Reference to the underlying BVH
      *
+     * \param nodes
+     *    Node array that is filled (either the nodes of the BVH or a
+     *    separate array when a subtree is rebuilt)
+     *
      * \param node_idx
      *    Index of the BVH node that should be built
      *
@@ -83,16 +90,17 @@ public:
      *    construction purposes. The usable length is <tt>end-start</tt>
      *    unsigned integers.
      */
-    BVHBuildTask(BVH &bvh, uint32_t node_idx, uint32_t *start, uint32_t *end, uint32_t *temp)
-        : bvh(bvh), node_idx(node_idx), start(start), end(end), temp(temp) { }
+    BVHBuildTask(BVH &bvh, std::vector<BVH::BVHNode> &nodes, uint32_t node_idx,
+                 uint32_t *start, uint32_t *end, uint32_t *temp)
+        : bvh(bvh), nodes(nodes), node_idx(node_idx), start(start), end(end), temp(temp) { }
 
     task *execute() {
         uint32_t size = (uint32_t) (end-start);
-        BVH::BVHNode &node = bvh.m_nodes[node_idx];
+        BVH::BVHNode &node = nodes[node_idx];
 
         /* Switch to a serial build when less than SERIAL_THRESHOLD triangles are left */
         if (size < SERIAL_THRESHOLD) {
-            execute_serially(bvh, node_idx, start, end, temp);
+            execute_serially(bvh, nodes, node_idx, start, end, temp);
             return nullptr;
         }
 
@@ -160,7 +168,7 @@ public:
         if (best_index == -1) {
             /* Could not find a good split plane -- retry with
                more careful serial code just to be sure.. */
-            execute_serially(bvh, node_idx, start, end, temp);
+            execute_serially(bvh, nodes, node_idx, start, end, temp);
             return nullptr;
         }
 
@@ -168,8 +176,8 @@ public:
         int node_idx_left = node_idx+1;
         int node_idx_right = node_idx+2*left_count;
 
-        bvh.m_nodes[node_idx_left ].bbox = bbox_left[best_index];
-        bvh.m_nodes[node_idx_right].bbox = best_bbox_right;
+        nodes[node_idx_left ].bbox = bbox_left[best_index];
+        nodes[node_idx_right].bbox = best_bbox_right;
         node.inner.rightChild = node_idx_right;
         node.inner.axis = axis;
         node.inner.flag = 0;
@@ -209,7 +217,7 @@ public:
 
         /* Post right subtree to scheduler */
         BVHBuildTask &b = *new (c.allocate_child())
-            BVHBuildTask(bvh, node_idx_right, start + left_count,
+            BVHBuildTask(bvh, nodes, node_idx_right, start + left_count,
                          end, temp + left_count);
         spawn(b);
 
@@ -222,8 +230,9 @@ public:
     }
 
     /// Single-threaded build function
-    static void execute_serially(BVH &bvh, uint32_t node_idx, uint32_t *start, uint32_t *end, uint32_t *temp) {
-        BVH::BVHNode &node = bvh.m_nodes[node_idx];
+    static void execute_serially(BVH &bvh, std::vector<BVH::BVHNode> &nodes, uint32_t node_idx,
+                                 uint32_t *start, uint32_t *end, uint32_t *temp) {
+        BVH::BVHNode &node = nodes[node_idx];
         uint32_t size = (uint32_t) (end - start);
         float best_cost = (float) INTERSECTION_COST * size;
         int64_t best_index = -1, best_axis = -1;
@@ -289,8 +298,8 @@ public:
         node.inner.axis = best_axis;
         node.inner.flag = 0;
 
-        execute_serially(bvh, node_idx_left, start, start + left_count, temp);
-        execute_serially(bvh, node_idx_right, start+left_count, end, temp + left_count);
+        execute_serially(bvh, nodes, node_idx_left, start, start + left_count, temp);
+        execute_serially(bvh, nodes, node_idx_right, start+left_count, end, temp + left_count);
     }
 };
 
@@ -305,6 +314,7 @@ void BVH::clear() {
     m_meshOffset.clear();
     m_meshOffset.push_back(0u);
     m_nodes.clear();
+    m_nodeCost.clear();
     m_indices.clear();
     m_bbox.reset();
     m_nodes.shrink_to_fit();
@@ -323,34 +333,50 @@ void BVH::build() {
     cout.flush();
     Timer timer;
 
-    /* Conservative estimate for the total number of nodes */
-    m_nodes.resize(2*size);
-    std::fill(m_nodes.begin(), m_nodes.end(), BVHNode{});
-    m_nodes[0].bbox = m_bbox;
-    m_indices.resize(size);
-
     static_assert(sizeof(BVHNode) == 32, "BVH Node is not packed! Investigate compiler settings.");
 
+    m_indices.resize(size);
     for (uint32_t i = 0; i < size; ++i)
         m_indices[i] = i;
 
-    uint32_t *indices = m_indices.data(), *temp = new uint32_t[size];
+    m_nodes = buildNodes(0u, size, m_bbox);
+
+    /* Remember the cost of every subtree to detect degradation when refitting */
+    m_nodeCost.resize(m_nodes.size());
+    float cost = updateSubtree(0u, (uint32_t) m_nodes.size(), false, m_nodeCost);
+
+    cout << "done (took " << timer.elapsedString() << " and "
+        << memString(sizeof(BVHNode) * m_nodes.size() + sizeof(uint32_t)*m_indices.size())
+        << ", SAH cost = " << cost
+        << ")." << endl;
+}
+
+std::vector<BVH::BVHNode> BVH::buildNodes(uint32_t start, uint32_t end, const BoundingBox3f &bbox) {
+    uint32_t size = end - start;
+
+    /* Conservative estimate for the total number of nodes */
+    std::vector<BVHNode> nodes(2*size);
+    std::fill(nodes.begin(), nodes.end(), BVHNode{});
+    nodes[0].bbox = bbox;
+
+    uint32_t *indices = m_indices.data() + start, *temp = new uint32_t[size];
     BVHBuildTask& task = *new(tbb::task::allocate_root())
-        BVHBuildTask(*this, 0u, indices, indices + size , temp);
+        BVHBuildTask(*this, nodes, 0u, indices, indices + size , temp);
     tbb::task::spawn_root_and_wait(task);
     delete[] temp;
-    std::pair<float, uint32_t> stats = statistics();
 
     /* The node array was allocated conservatively and now contains
        many unused entries -- do a compactification pass. */
-    std::vector<BVHNode> compactified(stats.second);
-    std::vector<uint32_t> skipped_accum(m_nodes.size());
+    int64_t used = std::count_if(nodes.begin(), nodes.end(),
+        [](const BVHNode &node) { return !node.isUnused(); });
+    std::vector<BVHNode> compactified(used);
+    std::vector<uint32_t> skipped_accum(nodes.size());
 
-    for (int64_t i = stats.second-1, j = m_nodes.size(), skipped = 0; i >= 0; --i) {
-        while (m_nodes[--j].isUnused())
+    for (int64_t i = used-1, j = nodes.size(), skipped = 0; i >= 0; --i) {
+        while (nodes[--j].isUnused())
             skipped++;
         BVHNode &new_node = compactified[i];
-        new_node = m_nodes[j];
+        new_node = nodes[j];
         skipped_accum[j] = (uint32_t) skipped;
 
         if (new_node.isInner()) {
@@ -359,12 +385,124 @@ void BVH::build() {
                 (skipped - skipped_accum[new_node.inner.rightChild]));
         }
     }
-    cout << "done (took " << timer.elapsedString() << " and "
-        << memString(sizeof(BVHNode) * m_nodes.size() + sizeof(uint32_t)*m_indices.size())
-        << ", SAH cost = " << stats.first
-        << ")." << endl;
 
-    m_nodes = std::move(compactified);
+    return compactified;
+}
+
+float BVH::updateSubtree(uint32_t node_idx, uint32_t end, bool refitBoxes, std::vector<float> &costs) {
+    BVHNode &node = m_nodes[node_idx];
+
+    if (node.isLeaf()) {
+        if (refitBoxes) {
+            node.bbox.reset();
+            for (uint32_t i = node.start(); i < node.end(); ++i)
+                node.bbox.expandBy(getBoundingBox(m_indices[i]));
+        }
+        return costs[node_idx] = (float) BVHBuildTask::INTERSECTION_COST * node.leaf.size;
+    }
+
+    /* The left subtree occupies [node_idx+1, rightChild), the right one [rightChild, end) */
+    uint32_t left = node_idx + 1u, right = node.inner.rightChild;
+    float costLeft, costRight;
+    if (end - node_idx > REFIT_GRAIN_SIZE) {
+        tbb::parallel_invoke(
+            [&] { costLeft = updateSubtree(left, right, refitBoxes, costs); },
+            [&] { costRight = updateSubtree(right, end, refitBoxes, costs); }
+        );
+    } else {
+        costLeft = updateSubtree(left, right, refitBoxes, costs);
+        costRight = updateSubtree(right, end, refitBoxes, costs);
+    }
+
+    if (refitBoxes)
+        node.bbox = BoundingBox3f::merge(m_nodes[left].bbox, m_nodes[right].bbox);
+
+    float saCur = node.bbox.getSurfaceArea();
+    float sahCost = 2 * BVHBuildTask::TRAVERSAL_COST;
+    if (saCur > 0)
+        sahCost += (m_nodes[left].bbox.getSurfaceArea() * costLeft +
+                    m_nodes[right].bbox.getSurfaceArea() * costRight) / saCur;
+    else
+        sahCost += costLeft + costRight;
+    return costs[node_idx] = sahCost;
+}
+
+void BVH::refit(float rebuildThreshold) {
+    if (m_nodes.empty())
+        return;
+    if (m_indices.size() != getTriangleCount())
+        throw NoriException("BVH::refit(): the number of triangles has changed, a full build is required!");
+
+    cout << "Refitting the BVH (" << getTriangleCount() << " triangles) .. ";
+    cout.flush();
+    Timer timer;
+
+    /* Update all bounding boxes bottom-up, keeping the topology */
+    std::vector<float> costs(m_nodes.size());
+    float cost = updateSubtree(0u, (uint32_t) m_nodes.size(), true, costs);
+    m_bbox = m_nodes[0].bbox;
+
+    if (cost > rebuildThreshold * m_nodeCost[0]) {
+        cout << "SAH cost increased from " << m_nodeCost[0] << " to " << cost
+             << ", rebuilding." << endl;
+        build();
+        return;
+    }
+
+    /* Find the largest subtrees whose cost degraded too much (top-down) */
+    struct Subtree { uint32_t node, end; std::vector<BVHNode> nodes; };
+    std::vector<Subtree> degraded;
+    std::function<void(uint32_t, uint32_t)> findDegraded = [&](uint32_t node_idx, uint32_t end) {
+        const BVHNode &node = m_nodes[node_idx];
+        if (node.isLeaf())
+            return;
+        if (costs[node_idx] > rebuildThreshold * m_nodeCost[node_idx]) {
+            degraded.push_back(Subtree{ node_idx, end, {} });
+            return;
+        }
+        findDegraded(node_idx + 1u, node.inner.rightChild);
+        findDegraded(node.inner.rightChild, end);
+    };
+    findDegraded(0u, (uint32_t) m_nodes.size());
+
+    /* The triangles of a subtree are stored contiguously, so the subtrees
+       can be rebuilt independently */
+    tbb::parallel_for(size_t(0), degraded.size(), [&](size_t i) {
+        Subtree &subtree = degraded[i];
+        uint32_t first = subtree.node, last = subtree.node;
+        while (m_nodes[first].isInner())
+            first++;
+        while (m_nodes[last].isInner())
+            last = m_nodes[last].inner.rightChild;
+        subtree.nodes = buildNodes(m_nodes[first].start(), m_nodes[last].end(), m_nodes[subtree.node].bbox);
+    });
+
+    /* Splice the new subtrees into the node array, back to front so that
+       the node indices of the remaining subtrees stay valid */
+    for (auto it = degraded.rbegin(); it != degraded.rend(); ++it) {
+        const int64_t delta = (int64_t) it->nodes.size() - (int64_t) (it->end - it->node);
+        for (uint32_t i = 0; i < m_nodes.size(); ++i) {
+            if (m_nodes[i].isInner() && m_nodes[i].inner.rightChild >= it->end)
+                m_nodes[i].inner.rightChild = (uint32_t) (m_nodes[i].inner.rightChild + delta);
+        }
+        for (BVHNode &node : it->nodes) {
+            if (node.isInner())
+                node.inner.rightChild += it->node;
+        }
+        m_nodes.erase(m_nodes.begin() + it->node, m_nodes.begin() + it->end);
+        m_nodes.insert(m_nodes.begin() + it->node, it->nodes.begin(), it->nodes.end());
+        m_nodeCost.erase(m_nodeCost.begin() + it->node, m_nodeCost.begin() + it->end);
+        m_nodeCost.insert(m_nodeCost.begin() + it->node, it->nodes.size(), 0.0f);
+        updateSubtree(it->node, it->node + (uint32_t) it->nodes.size(), false, m_nodeCost);
+    }
+
+    if (!degraded.empty()) {
+        costs.resize(m_nodes.size());
+        cost = updateSubtree(0u, (uint32_t) m_nodes.size(), false, costs);
+    }
+
+    cout << "done (took " << timer.elapsedString() << ", rebuilt " << degraded.size()
+         << " subtrees, SAH cost = " << cost << ")." << endl;
 }
 
 std::pair<float, uint32_t> BVH::statistics(uint32_t node_idx) const {
@@ -484,10 +622,21 @@ bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) con
         its.p = bary.x() * p0 + bary.y() * p1 + bary.z() * p2;
 
         /* Compute proper texture coordinates if provided by the mesh */
-        if (UV.size() > 0)
-            its.uv = bary.x() * UV.col(idx0) +
-                bary.y() * UV.col(idx1) +
-                bary.z() * UV.col(idx2);
+        its.dpdu = its.dpdv = Vector3f(0.0f);
+        if (UV.size() > 0) {
+            const Point2f uv0 = UV.col(idx0), uv1 = UV.col(idx1), uv2 = UV.col(idx2);
+            its.uv = bary.x() * uv0 + bary.y() * uv1 + bary.z() * uv2;
+
+            /* Position derivatives w.r.t. the texture parameterization */
+            const Vector2f duv02 = uv0 - uv2, duv12 = uv1 - uv2;
+            const float det = duv02.x() * duv12.y() - duv02.y() * duv12.x();
+            if (std::abs(det) > 1e-12f) {
+                const float invDet = 1.0f / det;
+                const Vector3f dp02 = p0 - p2, dp12 = p1 - p2;
+                its.dpdu = ( duv12.y() * dp02 - duv02.y() * dp12) * invDet;
+                its.dpdv = (-duv12.x() * dp02 + duv02.x() * dp12) * invDet;
+            }
+        }
 
         /* Compute the geometry frame */
         its.geoFrame = Frame((p1-p0).cross(p2-p0).normalized());
@@ -508,6 +657,8 @@ bool BVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) con
         } else {
             its.shFrame = its.geoFrame;
         }
+
+        its.computeDifferentials(_ray);
     }
 
     return foundIntersection;
@@ -10,6 +10,8 @@ public:
         m_color1 = propList.getColor("color1",Color3f(1.0f));
     }
 
+    using Texture2D::eval;
+
     Color3f eval(const Point2f &uv) const override {
         const Point2f warpedUV = applyUVScaleAndOffset(uv);
         const int x = warpedUV.x()*2.0f;
@@ -128,11 +128,8 @@ public:
                 a properly normalized bitmap */
             std::unique_ptr<Bitmap> bitmap(resultImage->toBitmap());
 
-            /* Save using the OpenEXR format */
-            bitmap->saveEXR(output_filename);
-
-            /* Save tonemapped (sRGB) output using the PNG format */
-            bitmap->savePNG(output_filename);
+            /* Save using the OpenEXR format and tonemapped (sRGB) using the PNG format */
+            bitmap->save(output_filename);
         }
     }
 
@@ -0,0 +1,185 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Geometry instancing
+*/
+
+#include <nori/instance.h>
+#include <algorithm>
+
+NORI_NAMESPACE_BEGIN
+
+ShapeGroup::ShapeGroup(const PropertyList &propList) {
+    /* name by which instances refer to this group */
+    m_name = propList.getString("name");
+}
+
+void ShapeGroup::addChild(NoriObject *obj) {
+    switch (obj->getClassType()) {
+        case EMesh: {
+                Mesh *mesh = static_cast<Mesh *>(obj);
+                if (mesh->isEmitter())
+                    throw NoriException("ShapeGroup \"%s\": meshes inside shape groups cannot be emitters!", m_name);
+                m_bvh->addMesh(mesh);
+                m_meshes.emplace_back(mesh);
+            }
+            break;
+
+        default:
+            throw NoriException("ShapeGroup::addChild(<%s>) is not supported!",
+                classTypeName(obj->getClassType()));
+    }
+}
+
+void ShapeGroup::activate() {
+    if (m_meshes.empty())
+        throw NoriException("ShapeGroup \"%s\" does not contain any meshes!", m_name);
+    m_bvh->build();
+}
+
+bool ShapeGroup::setFrame(int frame, float rebuildThreshold) {
+    bool changed = false;
+    for (const auto &mesh : m_meshes)
+        changed |= mesh->setFrame(frame);
+    if (changed)
+        m_bvh->refit(rebuildThreshold);
+    return changed;
+}
+
+std::string ShapeGroup::toString() const {
+    return tfm::format(
+        "ShapeGroup[name=\"%s\", meshes=%i, triangles=%i]",
+        m_name, m_bvh->getMeshCount(), m_bvh->getTriangleCount()
+    );
+}
+
+Instance::Instance(const PropertyList &propList) {
+    /* name of the referenced shape group */
+    m_groupName = propList.getString("shapegroup");
+    /* object to world transformation */
+    m_toWorld = propList.getTransform("toWorld", Transform());
+    m_toLocal = m_toWorld.inverse();
+}
+
+void Instance::setShapeGroup(const ShapeGroup *group) {
+    m_group = group;
+
+    /* Bound the transformed corners of the local bounding box */
+    const BoundingBox3f &local = group->getBVH()->getBoundingBox();
+    m_bbox = BoundingBox3f();
+    for (int i = 0; i < 8; ++i)
+        m_bbox.expandBy(m_toWorld * local.getCorner(i));
+}
+
+bool Instance::rayIntersect(const Ray3f &ray, Intersection &its, bool shadowRay) const {
+    /* The direction is not normalized, the ray parameter stays the same */
+    const Ray3f localRay = m_toLocal * ray;
+    if (!m_group->getBVH()->rayIntersect(localRay, its, shadowRay))
+        return false;
+    if (shadowRay)
+        return true;
+
+    its.p = m_toWorld * its.p;
+    its.dpdu = m_toWorld * its.dpdu;
+    its.dpdv = m_toWorld * its.dpdv;
+    its.geoFrame = Frame((m_toWorld * Normal3f(its.geoFrame.n)).normalized());
+    its.shFrame = Frame((m_toWorld * Normal3f(its.shFrame.n)).normalized());
+    its.computeDifferentials(ray);
+    return true;
+}
+
+std::string Instance::toString() const {
+    return tfm::format(
+        "Instance[\n"
+        "  shapegroup = \"%s\",\n"
+        "  toWorld = %s\n"
+        "]",
+        m_groupName,
+        indent(m_toWorld.toString(), 12)
+    );
+}
+
+void InstanceBVH::build() {
+    m_nodes.clear();
+    m_bbox = BoundingBox3f();
+    if (m_instances.empty())
+        return;
+    m_nodes.reserve(2 * m_instances.size());
+    buildRecursive(0, (uint32_t) m_instances.size());
+    m_bbox = m_nodes[0].bbox;
+}
+
+uint32_t InstanceBVH::buildRecursive(uint32_t start, uint32_t end) {
+    const uint32_t index = (uint32_t) m_nodes.size();
+    m_nodes.emplace_back();
+
+    BoundingBox3f bbox, centroids;
+    for (uint32_t i = start; i < end; ++i) {
+        bbox.expandBy(m_instances[i]->getBoundingBox());
+        centroids.expandBy(m_instances[i]->getCentroid());
+    }
+    m_nodes[index].bbox = bbox;
+
+    if (end - start <= 2) {
+        m_nodes[index].start = start;
+        m_nodes[index].size = end - start;
+        return index;
+    }
+
+    /* Median split along the largest extent of the centroids */
+    const int axis = centroids.getMajorAxis();
+    const uint32_t mid = start + (end - start) / 2;
+    std::nth_element(m_instances.begin() + start, m_instances.begin() + mid, m_instances.begin() + end,
+        [axis](const Instance *a, const Instance *b) {
+            return a->getCentroid()[axis] < b->getCentroid()[axis];
+        });
+
+    m_nodes[index].size = 0;
+    buildRecursive(start, mid);
+    const uint32_t right = buildRecursive(mid, end);
+    m_nodes[index].rightChild = right;
+    return index;
+}
+
+bool InstanceBVH::rayIntersect(const Ray3f &_ray, Intersection &its, bool shadowRay) const {
+    if (m_nodes.empty())
+        return false;
+
+    Ray3f ray(_ray);
+    uint32_t node_idx = 0, stack_idx = 0, stack[64];
+    bool foundIntersection = false;
+
+    while (true) {
+        const Node &node = m_nodes[node_idx];
+
+        if (node.bbox.rayIntersect(ray)) {
+            if (!node.isLeaf()) {
+                stack[stack_idx++] = node.rightChild;
+                node_idx++;
+                assert(stack_idx < 64);
+                continue;
+            }
+
+            for (uint32_t i = node.start; i < node.start + node.size; ++i) {
+                /* Misses must not clobber an earlier hit */
+                Intersection tmp;
+                if (m_instances[i]->rayIntersect(ray, tmp, shadowRay)) {
+                    if (shadowRay)
+                        return true;
+                    foundIntersection = true;
+                    ray.maxt = tmp.t;
+                    its = tmp;
+                }
+            }
+        }
+
+        if (stack_idx == 0)
+            break;
+        node_idx = stack[--stack_idx];
+    }
+
+    return foundIntersection;
+}
+
+NORI_REGISTER_CLASS(ShapeGroup, "shapegroup");
+NORI_REGISTER_CLASS(Instance, "instance");
+NORI_NAMESPACE_END
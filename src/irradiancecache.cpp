@@ -0,0 +1,130 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Octree of cached irradiance samples
+*/
+
+#include <nori/irradiancecache.h>
+#include <Eigen/Geometry>
+
+NORI_NAMESPACE_BEGIN
+
+/// Maximum depth of the octree
+static constexpr int MaxDepth = 16;
+
+IrradianceCache::Node::~Node() {
+    for (auto &child : children)
+        delete child.load(std::memory_order_relaxed);
+    for (Entry *entry = entries.load(std::memory_order_relaxed); entry; ) {
+        Entry *next = entry->next;
+        delete entry;
+        entry = next;
+    }
+}
+
+IrradianceCache::~IrradianceCache() {
+    delete m_root;
+}
+
+void IrradianceCache::init(const BoundingBox3f &bbox, float accuracy) {
+    delete m_root;
+    m_root = new Node();
+    m_recordCount = 0;
+    m_accuracy = accuracy;
+
+    /* Cubic root node, slightly enlarged to contain points on the boundary */
+    const float size = std::max(bbox.getExtents().maxCoeff(), Epsilon) * (1.0f + Epsilon);
+    const Point3f center = bbox.getCenter();
+    m_bounds = BoundingBox3f(center - Vector3f::Constant(0.5f * size),
+                             center + Vector3f::Constant(0.5f * size));
+}
+
+BoundingBox3f IrradianceCache::childBounds(const BoundingBox3f &bounds, int child) {
+    const Point3f center = bounds.getCenter();
+    BoundingBox3f result;
+    for (int i = 0; i < 3; ++i) {
+        const bool upper = (child >> i) & 1;
+        result.min[i] = upper ? center[i] : bounds.min[i];
+        result.max[i] = upper ? bounds.max[i] : center[i];
+    }
+    return result;
+}
+
+bool IrradianceCache::lookup(const Point3f &p, const Normal3f &n, Color3f &E) const {
+    Color3f sumE(0.0f);
+    float sumWeight = 0.0f;
+
+    const Node *node = m_root;
+    BoundingBox3f bounds = m_bounds;
+    while (node) {
+        for (const Entry *entry = node->entries.load(std::memory_order_acquire); entry; entry = entry->next) {
+            const IrradianceRecord &record = entry->record;
+            const Vector3f d = p - record.p;
+
+            /* Ward's error estimate of extrapolating the record */
+            const float error = d.norm() / record.R
+                + std::sqrt(std::max(0.0f, 1.0f - n.dot(record.n)));
+            if (error >= m_accuracy)
+                continue;
+
+            /* Skip records in front of the point */
+            if (d.dot(n + record.n) * 0.5f < -0.05f * record.R)
+                continue;
+
+            const Vector3f rotation = record.n.cross(n);
+            Color3f value = record.E;
+            for (int c = 0; c < 3; ++c)
+                value[c] += rotation.dot(record.rotGrad[c]) + d.dot(record.transGrad[c]);
+
+            const float weight = 1.0f / std::max(error, 1e-6f);
+            sumE += weight * value.cwiseMax(0.0f);
+            sumWeight += weight;
+        }
+
+        /* Continue with the child containing p */
+        const Point3f center = bounds.getCenter();
+        const int child = (p.x() > center.x() ? 1 : 0) | (p.y() > center.y() ? 2 : 0) | (p.z() > center.z() ? 4 : 0);
+        node = node->children[child].load(std::memory_order_acquire);
+        bounds = childBounds(bounds, child);
+    }
+
+    if (sumWeight == 0.0f)
+        return false;
+    E = sumE / sumWeight;
+    return true;
+}
+
+void IrradianceCache::insert(const IrradianceRecord &record) {
+    const Vector3f radius = Vector3f::Constant(m_accuracy * record.R);
+    insert(m_root, m_bounds, BoundingBox3f(record.p - radius, record.p + radius), record, 0);
+    m_recordCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void IrradianceCache::insert(Node *node, const BoundingBox3f &nodeBounds, const BoundingBox3f &dataBounds,
+                             const IrradianceRecord &record, int depth) {
+    /* Store the record in nodes that are about the size of its validity region */
+    if (depth == MaxDepth || nodeBounds.getExtents().squaredNorm() < dataBounds.getExtents().squaredNorm()) {
+        Entry *entry = new Entry { record, node->entries.load(std::memory_order_relaxed) };
+        while (!node->entries.compare_exchange_weak(entry->next, entry,
+                std::memory_order_release, std::memory_order_relaxed)) { }
+        return;
+    }
+
+    for (int i = 0; i < 8; ++i) {
+        const BoundingBox3f bounds = childBounds(nodeBounds, i);
+        if (!bounds.overlaps(dataBounds))
+            continue;
+
+        Node *child = node->children[i].load(std::memory_order_acquire);
+        if (!child) {
+            Node *created = new Node();
+            if (node->children[i].compare_exchange_strong(child, created,
+                    std::memory_order_acq_rel, std::memory_order_acquire))
+                child = created;
+            else
+                delete created;
+        }
+        insert(child, bounds, dataBounds, record, depth + 1);
+    }
+}
+
+NORI_NAMESPACE_END
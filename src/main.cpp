@@ -13,6 +13,8 @@
 #include <nori/sampler.h>
 #include <nori/integrator.h>
 #include <nori/gui.h>
+#include <nori/texturecache.h>
+#include <nori/batch.h>
 #include <tbb/task_scheduler_init.h>
 #include <filesystem/resolver.h>
 #include <thread>
@@ -21,13 +23,24 @@ using namespace nori;
 
 static int threadCount = -1;
 static bool gui = true;
+/* Range of animation frames to render (none if firstFrame > lastFrame) */
+static int firstFrame = 0, lastFrame = -1;
+/* Batch file with variations of the scene to render */
+static std::string batchName;
 
-static void render(Scene *scene, const std::string &filename) {
+static void render(Scene *scene, const std::string &outputName) {
     const Camera *camera = scene->getCamera();
     Vector2i outputSize = camera->getOutputSize();
 
+    /* Render managers that stream the output to disk don't need a full frame */
+    const bool streaming = scene->getRenderManager()->writesOutput();
+    if (streaming && gui) {
+        cout << "The render manager writes its output directly, continuing without GUI." << endl;
+        gui = false;
+    }
+
     /* Allocate memory for the entire output image and clear it */
-    ImageBlock result(outputSize, camera->getReconstructionFilter());
+    ImageBlock result(streaming ? Vector2i(0) : outputSize, camera->getReconstructionFilter());
     result.clear();
 
     /* Create a window that visualizes the partially rendered result */
@@ -47,16 +60,12 @@ static void render(Scene *scene, const std::string &filename) {
     std::thread render_thread([&] {
         tbb::task_scheduler_init init(threadCount);
 
-        /* Determine the filename of the output bitmap */
-        std::string outputName = filename;
-        size_t lastdot = outputName.find_last_of(".");
-        if (lastdot != std::string::npos)
-            outputName.erase(lastdot, std::string::npos);
-
         /* Get RenderManager progressive (default) or blockwise for rendering the scene */
         RenderManager* renderManager = scene->getRenderManager();
-        /* Provide additional information to the render manager (for EMCA) */
-        renderManager->setOutputFileName(filesystem::path::getcwd().str()+"/"+outputName);
+        /* Provide additional information to the render manager: managers writing the
+           output save to the same file as below, EMCA expects an absolute path */
+        renderManager->setOutputFileName(streaming ? outputName
+            : filesystem::path::getcwd().str()+"/"+outputName);
         /* Start rendering the scene */
         renderManager->start_render(scene, result);
 
@@ -70,15 +79,15 @@ static void render(Scene *scene, const std::string &filename) {
         /* Wait for the render thread to finish */
         renderManager->join();
 
-        /* Now turn the rendered image block into
-            a properly normalized bitmap */
-        std::unique_ptr<Bitmap> bitmap(result.toBitmap());
+        if (!streaming) {
+            /* Now turn the rendered image block into
+                a properly normalized bitmap */
+            std::unique_ptr<Bitmap> bitmap(result.toBitmap());
 
-        /* Save using the OpenEXR format */
-        bitmap->saveEXR(outputName);
-
-        /* Save tonemapped (sRGB) output using the PNG format */
-        bitmap->savePNG(outputName);
+            /* Save using the OpenEXR format (along with the AOVs)
+               and tonemapped (sRGB) using the PNG format */
+            bitmap->save(outputName, result.toAOVLayers());
+        }
 
 #ifndef __APPLE__
         // change the window title to show that rendering has finished
@@ -103,7 +112,7 @@ static void render(Scene *scene, const std::string &filename) {
 
 int main(int argc, char **argv) {
     // if (argc < 3) {
-    //     cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N]" <<  endl;
+    //     cerr << "Syntax: " << argv[0] << " <scene.xml> [--no-gui] [--threads N] [--texture-cache MiB] [--exr-compression none|zip|piz|dwaa] [--exr-half] [--frames N|A:B] [--batch jobs.xml]" <<  endl;
     //     return -1;
     // }
 
@@ -156,6 +165,71 @@ int main(int argc, char **argv) {
 
             continue;
         }
+        else if (token == "--texture-cache") {
+            if (i+1 >= argc || atoi(argv[i+1]) <= 0) {
+                cerr << "\"--texture-cache\" argument expects a positive memory budget in MiB following it." << endl;
+                return -1;
+            }
+            TextureCache::instance().setMemoryBudget((size_t) atoi(argv[i+1]) << 20);
+            i++;
+
+            continue;
+        }
+        else if (token == "--exr-compression") {
+            if (i+1 >= argc) {
+                cerr << "\"--exr-compression\" argument expects none, zip, piz or dwaa following it." << endl;
+                return -1;
+            }
+            EXROptions options = Bitmap::getEXROptions();
+            try {
+                options.compression = EXROptions::compressionFromString(argv[i+1]);
+            } catch (const std::exception &e) {
+                cerr << e.what() << endl;
+                return -1;
+            }
+            Bitmap::setEXROptions(options);
+            i++;
+
+            continue;
+        }
+        else if (token == "--exr-half") {
+            EXROptions options = Bitmap::getEXROptions();
+            options.half = true;
+            Bitmap::setEXROptions(options);
+            continue;
+        }
+        else if (token == "--frames") {
+            /* Either a frame count N (frames 0..N-1) or an inclusive range A:B */
+            const std::vector<std::string> range = i+1 < argc ? tokenize(argv[i+1], ":") : std::vector<std::string>();
+            try {
+                if (range.size() == 1) {
+                    firstFrame = 0;
+                    lastFrame = toInt(range[0]) - 1;
+                } else if (range.size() == 2) {
+                    firstFrame = toInt(range[0]);
+                    lastFrame = toInt(range[1]);
+                }
+            } catch (const std::exception &) {
+                lastFrame = -1;
+            }
+            if (range.empty() || range.size() > 2 || firstFrame > lastFrame) {
+                cerr << "\"--frames\" argument expects a frame count N or a range A:B following it." << endl;
+                return -1;
+            }
+            i++;
+
+            continue;
+        }
+        else if (token == "--batch") {
+            if (i+1 >= argc) {
+                cerr << "\"--batch\" argument expects a batch file (.xml) following it." << endl;
+                return -1;
+            }
+            batchName = argv[i+1];
+            i++;
+
+            continue;
+        }
         else if (token == "--no-gui") {
             gui = false;
             continue;
@@ -218,11 +292,52 @@ int main(int argc, char **argv) {
         if (threadCount < 0) {
             threadCount = tbb::task_scheduler_init::automatic;
         }
+        /* Let OpenEXR compress the output with as many threads as are rendering */
+        Bitmap::setIOThreadCount(threadCount > 0 ? threadCount : (int) std::thread::hardware_concurrency());
         try {
             std::unique_ptr<NoriObject> root(loadFromXML(sceneName));
+
+            /* Determine the filename of the output bitmap */
+            std::string outputName = sceneName;
+            size_t lastdot = outputName.find_last_of(".");
+            if (lastdot != std::string::npos)
+                outputName.erase(lastdot, std::string::npos);
+
             /* When the XML root object is a scene, start rendering it .. */
-            if (root->getClassType() == NoriObject::EScene)
-                render(static_cast<Scene *>(root.get()), sceneName);
+            if (root->getClassType() == NoriObject::EScene) {
+                Scene *scene = static_cast<Scene *>(root.get());
+                if (!batchName.empty()) {
+                    std::unique_ptr<NoriObject> batch(loadFromXML(batchName));
+                    if (batch->getClassType() != NoriObject::EBatch)
+                        throw NoriException("The root element of the batch file \"%s\" must be <batch>!", batchName);
+
+                    /* Render the jobs back to back with the loaded scene, the
+                       preprocess step is only repeated when necessary */
+                    gui = false;
+                    const auto &jobs = static_cast<RenderBatch *>(batch.get())->getJobs();
+                    for (size_t i = 0; i < jobs.size(); ++i) {
+                        RenderJob *job = jobs[i].get();
+                        cout << "Job \"" << job->getName() << "\" (" << i + 1 << " of " << jobs.size() << ")" << endl;
+                        if (job->getFrame() >= 0)
+                            scene->setFrame(job->getFrame());
+                        job->swap(scene);
+                        render(scene, outputName + "_" + job->getName());
+                        job->swap(scene);
+                    }
+                } else if (firstFrame > lastFrame) {
+                    render(scene, outputName);
+                } else {
+                    /* Render an animation: the scene is loaded once, the
+                       animated meshes are updated between frames */
+                    gui = false;
+                    for (int frame = firstFrame; frame <= lastFrame; ++frame) {
+                        cout << "Frame " << frame << " (" << frame - firstFrame + 1 << " of "
+                             << lastFrame - firstFrame + 1 << ")" << endl;
+                        scene->setFrame(frame);
+                        render(scene, tfm::format("%s_%04i", outputName, frame));
+                    }
+                }
+            }
         } catch (const std::exception &e) {
             cerr << e.what() << endl;
             return -1;
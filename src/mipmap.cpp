@@ -0,0 +1,124 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Mip-mapped texture lookups
+*/
+
+#include <nori/mipmap.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+NORI_NAMESPACE_BEGIN
+
+/* Gaussian falloff exp(-alpha r^2), shifted to reach zero at r = 1 */
+const std::array<float, MipMap::EWALutSize> MipMap::EWAWeights = [] {
+    constexpr float alpha = 2.0f;
+    std::array<float, EWALutSize> table{};
+    for (int i = 0; i < EWALutSize; ++i) {
+        const float r2 = (float) i / (float) (EWALutSize - 1);
+        table[i] = std::exp(-alpha * r2) - std::exp(-alpha);
+    }
+    return table;
+}();
+
+MipMap::EFilter MipMap::filterFromString(const std::string &name) {
+    const std::string value = toLower(name);
+    if (value == "nearest")
+        return ENearest;
+    else if (value == "bilinear")
+        return EBilinear;
+    else if (value == "trilinear")
+        return ETrilinear;
+    else if (value == "ewa")
+        return EEWA;
+    throw NoriException("MipMap: unknown filter \"%s\" (expected nearest, "
+                        "bilinear, trilinear or ewa)", name);
+}
+
+const char *MipMap::filterName(EFilter filter) {
+    static const char *names[] = { "nearest", "bilinear", "trilinear", "ewa" };
+    return names[filter];
+}
+
+/**
+ * Texels and weights of the box filter producing texel \c x of a level with
+ * \c next texels from one with \c size texels. For odd sizes, the 3 texel
+ * box of texel x covers the source interval [x, x + 1] * size / next.
+ */
+static void downsampleTaps(int size, int next, int x, int index[3], float weight[3]) {
+    if (size == 1) {
+        index[0] = index[1] = index[2] = 0;
+        weight[0] = 1.0f;
+        weight[1] = weight[2] = 0.0f;
+    } else if (size % 2 == 0) {
+        index[0] = 2 * x;
+        index[1] = index[2] = 2 * x + 1;
+        weight[0] = weight[1] = 0.5f;
+        weight[2] = 0.0f;
+    } else {
+        const float scale = 1.0f / (float) size;
+        index[0] = 2 * x;
+        index[1] = 2 * x + 1;
+        index[2] = 2 * x + 2;
+        weight[0] = (float) (next - x) * scale;
+        weight[1] = (float) next * scale;
+        weight[2] = (float) (x + 1) * scale;
+    }
+}
+
+template <typename Texel>
+TBitmapPyramid<Texel>::TBitmapPyramid(TBitmap<Texel> &&bitmap, bool buildLevels) {
+    if (bitmap.cols() == 0 || bitmap.rows() == 0)
+        throw NoriException("TBitmapPyramid: cannot create a pyramid of an empty bitmap!");
+
+    m_levels.push_back(std::move(bitmap));
+    if (!buildLevels)
+        return;
+
+    while (m_levels.back().cols() > 1 || m_levels.back().rows() > 1) {
+        const TBitmap<Texel> &prev = m_levels.back();
+        const int w = prev.cols(), h = prev.rows();
+        TBitmap<Texel> next(Vector2i(std::max(1, w / 2), std::max(1, h / 2)));
+
+        /* Box filter over 2 texels; odd sizes use a 3 texel box with
+           weights that keep the energy and alignment of every level */
+        tbb::parallel_for(tbb::blocked_range<int>(0, next.rows()),
+            [&](const tbb::blocked_range<int> &range) {
+                int xi[3], yi[3];
+                float xw[3], yw[3];
+                for (int y = range.begin(); y != range.end(); ++y) {
+                    downsampleTaps(h, next.rows(), y, yi, yw);
+                    for (int x = 0; x < next.cols(); ++x) {
+                        downsampleTaps(w, next.cols(), x, xi, xw);
+                        Color3f value(0.0f);
+                        for (int j = 0; j < 3; ++j)
+                            for (int i = 0; i < 3; ++i)
+                                if (yw[j] * xw[i] > 0.0f)
+                                    value += (yw[j] * xw[i]) * prev.coeff(yi[j], xi[i]);
+                        next.set(y, x, value);
+                    }
+                }
+            }
+        );
+
+        m_levels.push_back(std::move(next));
+    }
+}
+
+template <typename Texel> size_t TBitmapPyramid<Texel>::getMemoryUsage() const {
+    size_t bytes = 0;
+    for (const TBitmap<Texel> &level : m_levels)
+        bytes += level.getMemoryUsage();
+    return bytes;
+}
+
+template <typename Texel> std::string TBitmapPyramid<Texel>::toString() const {
+    return tfm::format("BitmapPyramid[size=%s, levels=%i, format=%s, memory=%s]",
+        getSize(0).toString(), getLevelCount(), texelFormatName(Texel::Format),
+        memString(getMemoryUsage()));
+}
+
+template class TBitmapPyramid<TexelRGB32F>;
+template class TBitmapPyramid<TexelRGBA16F>;
+template class TBitmapPyramid<TexelSRGB8>;
+
+NORI_NAMESPACE_END
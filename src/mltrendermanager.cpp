@@ -19,6 +19,8 @@
 #include <nori/mlt.h>
 #include <tbb/parallel_for.h>
 #include <tbb/blocked_range.h>
+#include <tbb/task_arena.h>
+#include <tbb/enumerable_thread_specific.h>
 #include <thread>
 
 NORI_NAMESPACE_BEGIN
@@ -31,6 +33,16 @@ public:
               propList.getInteger("chainlength", 10000),
               propList.getInteger("startup", 1000),
               propList.getFloat("newChain", 0.1f)} {
+        /* seed chains by index and merge histograms in a fixed order for bit-identical results */
+        m_deterministic = propList.getBoolean("deterministic", false);
+        /* number of chains rendered in parallel in deterministic mode, each one buffers its splats
+           (about 40 bytes per mutation) until they are added to the image in chain order */
+        m_batchSize = propList.getInteger("batchSize", 32);
+        if (m_batchSize <= 0)
+            throw NoriException("MLTRenderManager: the batch size must be positive!");
+        /* start chains from a bootstrapped seed pool, stratified by path length */
+        m_multiplexed = propList.getBoolean("multiplexed", false);
+        m_bootstrapSamples = propList.getInteger("bootstrap", 100000);
     }
 
     void start_render(Scene *scene, ImageBlock& result) override {
@@ -39,7 +51,7 @@ public:
             const Camera *camera = scene->getCamera();
             const Vector2i& outputSize = camera->getOutputSize();
             Integrator *integrator = scene->getIntegrator();
-            integrator->preprocess(scene);
+            scene->preprocess();
 
             cout << "Rendering .. ";
             cout.flush();
@@ -47,16 +59,50 @@ public:
 
             // try to match the given number of samples per pixel, overshoot by completing the last iteration
             const int chainlength = m_pssmlt.getChainlength();
-            const int numIterations = static_cast<int>((outputSize.prod()*static_cast<long>(scene->getSampler()->getSampleCount())+chainlength-1)/chainlength);
+            int numIterations = static_cast<int>((outputSize.prod()*static_cast<long>(scene->getSampler()->getSampleCount())+chainlength-1)/chainlength);
+
+            if (m_deterministic) {
+                renderDeterministic(scene, integrator, result, numIterations);
+                cout << "done. (took " << timer.elapsedString() << ")" << endl;
+                return;
+            }
+
+            // multiplexed chains start from the seed pool, which also provides the mean brightness
+            int chainlengthPerIteration = chainlength;
+            float bootstrapBrightness {0.0f};
+            if (m_multiplexed) {
+                bootstrapBrightness = m_pssmlt.bootstrap(scene, integrator, scene->getSampler(), m_bootstrapSamples);
+
+                // without a startup phase, shorter chains are cheap - use at least one chain per core and stratum
+                const int minChains = std::max(tbb::this_task_arena::max_concurrency(), m_pssmlt.getStratumCount());
+                if (numIterations < minChains) {
+                    chainlengthPerIteration = static_cast<int>((static_cast<long>(numIterations)*chainlength+minChains-1)/minChains);
+                    numIterations = minChains;
+                }
+            }
             const tbb::blocked_range<int> range(0, numIterations);
 
+            /// Histogram of accepted states, shared by all threads
+            HistogramImage histogram(outputSize, camera->getReconstructionFilter());
+
+            /// Publish the histogram to the result image after every this many completed chains
+            const int updateInterval = std::max(1, numIterations/64);
+            std::atomic<int> completedChains {0};
+
+            const auto currentMeanBrightness = [&]() -> std::pair<float, bool> {
+                if (m_multiplexed)
+                    return {bootstrapBrightness, true};
+                return m_pssmlt.getMeanBrightness();
+            };
+
+            /// Clones of the scene's sampler, one per thread and render
+            tbb::enumerable_thread_specific<std::unique_ptr<Sampler>> samplers;
+
             auto map = [&](const tbb::blocked_range<int> &range)
             {
-                /// Clone of the scene's sampler for the current thread
-                thread_local std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
-
-                /// Histogram of accepted states
-                thread_local HistogramImage histogram(outputSize, camera->getReconstructionFilter());
+                std::unique_ptr<Sampler> &sampler = samplers.local();
+                if (!sampler)
+                    sampler = scene->getSampler()->clone();
 
                 // iterate over individual Markov Chains
                 // update the result image at the end of each iteration
@@ -65,28 +111,28 @@ public:
                     // Initialize the sampler with a different state per thread and iteration
                     {
                         ImageBlock temp(Vector2i(0), nullptr);
-                        temp.setOffset(Point2i(range.end(), iteration));
+                        temp.setOffset(Point2i(iteration, 0));
                         sampler->prepare(temp);
                         sampler->generate();
                     }
 
                     // hand control over to delegate function
-                    m_pssmlt.processMarkovChain(scene, integrator, sampler.get(), histogram);
+                    PSSMLT::ChainStart start;
+                    if (m_multiplexed)
+                        start = m_pssmlt.getChainStart(iteration, numIterations);
+                    start.chainlength = chainlengthPerIteration;
+                    m_pssmlt.processMarkovChain(scene, integrator, sampler.get(), histogram, start);
 
                     // inform the histogram about the number of samples
-                    histogram.incrementSampleCount(chainlength);
-
-                    // update the result image immediately if there are enough samples for the mean brightness
-                    float meanBrightness {0.0f};
-                    bool meanBrightnessValid {false};
-                    std::tie(meanBrightness, meanBrightnessValid) = m_pssmlt.getMeanBrightness();
-                    if (meanBrightnessValid)
-                        histogram.updateResult(result, meanBrightness);
-                }
+                    histogram.incrementSampleCount(chainlengthPerIteration);
 
-                // final update in the assigned sub-range - in case the previous updates could not be performed
-                // this may compute additional samples to estimate the mean brightness
-                histogram.updateResult(result, m_pssmlt.estimateMeanBrightness(scene, integrator, sampler.get()));
+                    // update the result image periodically if there are enough samples for the mean brightness
+                    if ((completedChains.fetch_add(1, std::memory_order_relaxed)+1) % updateInterval == 0) {
+                        const auto [meanBrightness, meanBrightnessValid] = currentMeanBrightness();
+                        if (meanBrightnessValid)
+                            histogram.updateResult(result, meanBrightness);
+                    }
+                }
             };
 
             /// Uncomment the following line for single threaded rendering
@@ -95,18 +141,84 @@ public:
             /// Default: parallel rendering
             tbb::parallel_for(range, map);
 
+            // final update - this may compute additional samples to estimate the mean brightness
+            {
+                std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+                histogram.updateResult(result, m_multiplexed ? bootstrapBrightness
+                                                             : m_pssmlt.estimateMeanBrightness(scene, integrator, sampler.get()));
+            }
+
             cout << "done. (took " << timer.elapsedString() << ")" << endl;
         });
     }
 
     std::string toString() const override {
         return tfm::format(
-            "MLTRenderManager[]"
+            "MLTRenderManager[deterministic=%s, batchSize=%i, multiplexed=%s, bootstrap=%i]",
+            m_deterministic ? "true" : "false",
+            m_batchSize,
+            m_multiplexed ? "true" : "false",
+            m_bootstrapSamples
         );
     }
 
 private:
+    /**
+     * Render the Markov Chains in batches of \c batchSize chains, independent of the number
+     * of threads. Every chain of a batch records its splats; they are added to the histogram
+     * in chain order, since the order of the atomic additions into a shared histogram
+     * would depend on scheduling.
+     * The mean brightness is estimated upfront by the bootstrap, which sums in a fixed order.
+     */
+    void renderDeterministic(Scene *scene, Integrator *integrator, ImageBlock &result, int numIterations) {
+        const Camera *camera = scene->getCamera();
+        int chainlength = m_pssmlt.getChainlength();
+        const float meanBrightness = m_pssmlt.bootstrap(scene, integrator, scene->getSampler(), m_bootstrapSamples);
+
+        // multiplexed rendering needs a chain per stratum - distribute the samples over shorter chains
+        const int numStrata = m_pssmlt.getStratumCount();
+        if (m_multiplexed && numIterations < numStrata) {
+            chainlength = static_cast<int>((static_cast<long>(numIterations)*chainlength+numStrata-1)/numStrata);
+            numIterations = numStrata;
+        }
+
+        const int batchSize = m_batchSize;
+        HistogramImage film(camera->getOutputSize(), camera->getReconstructionFilter());
+        std::vector<SplatList> splats(static_cast<size_t>(std::min(batchSize, numIterations)));
+        std::vector<std::unique_ptr<Sampler>> samplers;
+        for (int i=0; i<std::min(batchSize, numIterations); ++i)
+            samplers.emplace_back(scene->getSampler()->clone());
+
+        for (int first=0; first<numIterations; first+=batchSize) {
+            const int count = std::min(batchSize, numIterations-first);
+
+            tbb::parallel_for(0, count, [&](int i) {
+                Sampler *sampler = samplers[i].get();
+                ImageBlock temp(Vector2i(0), nullptr);
+                temp.setOffset(Point2i(first+i, 0));
+                sampler->prepare(temp);
+                sampler->generate();
+
+                PSSMLT::ChainStart start;
+                if (m_multiplexed)
+                    start = m_pssmlt.getChainStart(first+i, numIterations);
+                start.chainlength = chainlength;
+                m_pssmlt.processMarkovChain(scene, integrator, sampler, splats[i], start);
+            });
+
+            for (int i=0; i<count; ++i) {
+                splats[i].replay(film);
+                film.incrementSampleCount(chainlength);
+            }
+            film.updateResult(result, meanBrightness);
+        }
+    }
+
     PSSMLT m_pssmlt;
+    bool m_deterministic = false;
+    int m_batchSize = 32;
+    bool m_multiplexed = false;
+    int m_bootstrapSamples = 100000;
 };
 
 NORI_REGISTER_CLASS(MLTRenderManager, "mlt");
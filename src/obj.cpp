@@ -27,6 +27,11 @@ public:
         if (is.fail())
             throw NoriException("Unable to open OBJ file \"%s\"!", filename);
         Transform trafo = propList.getTransform("toWorld", Transform());
+        m_toWorld = trafo;
+
+        /* printf-style pattern of the files containing the vertex positions
+           of animation frames, e.g. "anim/cloth_%04i.obj" (optional) */
+        m_sequence = propList.getString("sequence", "");
 
         cout << "Loading \"" << filename << "\" .. ";
         cout.flush();
@@ -111,6 +116,13 @@ public:
                 m_UV.col(i) = texcoords.at(vertices[i].uv-1);
         }
 
+        if (!m_sequence.empty()) {
+            /* Keep the references into the position and normal lists */
+            m_positionCount = (uint32_t) positions.size();
+            m_normalCount = (uint32_t) normals.size();
+            m_vertices = std::move(vertices);
+        }
+
         m_name = filename.str();
         cout << "done. (V=" << m_V.cols() << ", F=" << m_F.cols() << ", took "
              << timer.elapsedString() << " and "
@@ -119,6 +131,60 @@ public:
              << ")" << endl;
     }
 
+    bool setFrame(int frame) override {
+        if (m_sequence.empty())
+            return false;
+
+        filesystem::path filename =
+            getFileResolver()->resolve(tfm::format(m_sequence.c_str(), frame));
+
+        std::ifstream is(filename.str());
+        if (is.fail())
+            throw NoriException("Unable to open OBJ file \"%s\"!", filename);
+
+        /* Only the vertex positions and normals are read, the faces and
+           texture coordinates of the first file are kept */
+        std::vector<Vector3f> positions, normals;
+        positions.reserve(m_positionCount);
+        normals.reserve(m_normalCount);
+
+        std::string line_str;
+        while (std::getline(is, line_str)) {
+            std::istringstream line(line_str);
+
+            std::string prefix;
+            line >> prefix;
+
+            if (prefix == "v") {
+                Point3f p;
+                line >> p.x() >> p.y() >> p.z();
+                positions.push_back(m_toWorld * p);
+            } else if (prefix == "vn") {
+                Normal3f n;
+                line >> n.x() >> n.y() >> n.z();
+                normals.push_back((m_toWorld * n).normalized());
+            }
+        }
+
+        if (positions.size() != m_positionCount || normals.size() != m_normalCount)
+            throw NoriException("OBJ file \"%s\" has %i positions and %i normals, expected %i and %i "
+                                "(the topology must not change between frames)", filename,
+                                positions.size(), normals.size(), m_positionCount, m_normalCount);
+
+        MatrixXf V(3, m_vertices.size()), N;
+        for (uint32_t i=0; i<m_vertices.size(); ++i)
+            V.col(i) = positions.at(m_vertices[i].p-1);
+
+        if (!normals.empty()) {
+            N.resize(3, m_vertices.size());
+            for (uint32_t i=0; i<m_vertices.size(); ++i)
+                N.col(i) = normals.at(m_vertices[i].n-1);
+        }
+
+        setVertexPositions(std::move(V), std::move(N));
+        return true;
+    }
+
 protected:
     /// Vertex indices used by the OBJ format
     struct OBJVertex {
@@ -157,6 +223,12 @@ protected:
             return hash;
         }
     };
+
+    Transform m_toWorld;                 ///< Object to world transformation
+    std::string m_sequence;              ///< Filename pattern of animation frames
+    std::vector<OBJVertex> m_vertices;   ///< OBJ indices of the vertices (animated meshes only)
+    uint32_t m_positionCount = 0;        ///< Number of positions in an OBJ file of the sequence
+    uint32_t m_normalCount = 0;          ///< Number of normals in an OBJ file of the sequence
 };
 
 NORI_REGISTER_CLASS(WavefrontOBJ, "obj");
@@ -8,7 +8,9 @@
 #include <nori/proplist.h>
 #include <Eigen/Geometry>
 #include <pugixml.hpp>
+#include <tbb/parallel_for.h>
 #include <fstream>
+#include <memory>
 #include <set>
 
 NORI_NAMESPACE_BEGIN
@@ -57,6 +59,10 @@ NoriObject *loadFromXML(const std::string &filename) {
         ETest                 = NoriObject::ETest,
         EReconstructionFilter = NoriObject::EReconstructionFilter,
         ERenderManager          = NoriObject::ERenderManager,
+        EShapeGroup           = NoriObject::EShapeGroup,
+        EInstance             = NoriObject::EInstance,
+        EJob                  = NoriObject::EJob,
+        EBatch                = NoriObject::EBatch,
 
         /* Properties */
         EBoolean = NoriObject::EClassTypeCount,
@@ -87,6 +93,10 @@ NoriObject *loadFromXML(const std::string &filename) {
     tags["medium"]     = EMedium;
     tags["phase"]      = EPhaseFunction;
     tags["rendermanager"] = ERenderManager;
+    tags["shapegroup"] = EShapeGroup;
+    tags["instance"]   = EInstance;
+    tags["job"]        = EJob;
+    tags["batch"]      = EBatch;
     tags["integrator"] = EIntegrator;
     tags["sampler"]    = ESampler;
     tags["rfilter"]    = EReconstructionFilter;
@@ -121,9 +131,22 @@ NoriObject *loadFromXML(const std::string &filename) {
 
     Eigen::Affine3f transform;
 
+    /* Loading happens in two phases: the XML tree is first parsed into a
+       tree of object descriptions (serially, since transform operations
+       accumulate into shared state), then the objects are instantiated
+       bottom-up. Siblings don't depend on each other, so they are created
+       and activated in parallel (e.g. all meshes of a scene). */
+    struct ObjectNode {
+        std::string type;
+        int tag;
+        PropertyList propList;
+        std::vector<std::unique_ptr<ObjectNode>> children;
+        ptrdiff_t offset;
+    };
+
     /* Helper function to parse a Nori XML node (recursive) */
-    std::function<NoriObject *(pugi::xml_node &, PropertyList &, int)> parseTag = [&](
-        pugi::xml_node &node, PropertyList &list, int parentTag) -> NoriObject * {
+    std::function<std::unique_ptr<ObjectNode>(pugi::xml_node &, PropertyList &, int)> parseTag = [&](
+        pugi::xml_node &node, PropertyList &list, int parentTag) -> std::unique_ptr<ObjectNode> {
         /* Skip over comments */
         if (node.type() == pugi::node_comment || node.type() == pugi::node_declaration)
             return nullptr;
@@ -162,45 +185,37 @@ NoriObject *loadFromXML(const std::string &filename) {
 
         if (tag == EScene)
             node.append_attribute("type") = "scene";
+        else if (tag == EShapeGroup)
+            node.append_attribute("type") = "shapegroup";
+        else if (tag == EInstance)
+            node.append_attribute("type") = "instance";
+        else if (tag == EJob)
+            node.append_attribute("type") = "job";
+        else if (tag == EBatch)
+            node.append_attribute("type") = "batch";
         else if (tag == ETransform)
             transform.setIdentity();
 
         PropertyList propList;
-        std::vector<NoriObject *> children;
+        std::vector<std::unique_ptr<ObjectNode>> children;
         for (pugi::xml_node &ch: node.children()) {
-            NoriObject *child = parseTag(ch, propList, tag);
+            std::unique_ptr<ObjectNode> child = parseTag(ch, propList, tag);
             if (child)
-                children.push_back(child);
+                children.push_back(std::move(child));
         }
 
-        NoriObject *result = nullptr;
+        std::unique_ptr<ObjectNode> result;
         try {
             if (currentIsObject) {
                 check_attributes(node, { "type" });
 
-                /* This is an object, first instantiate it */
-                result = NoriObjectFactory::createInstance(
-                    node.attribute("type").value(),
-                    propList
-                );
-
-                if (result->getClassType() != (int) tag) {
-                    throw NoriException(
-                        "Unexpectedly constructed an object "
-                        "of type <%s> (expected type <%s>): %s",
-                        NoriObject::classTypeName(result->getClassType()),
-                        NoriObject::classTypeName((NoriObject::EClassType) tag),
-                        result->toString());
-                }
-
-                /* Add all children */
-                for (auto ch: children) {
-                    result->addChild(ch);
-                    ch->setParent(result);
-                }
-
-                /* Activate / configure the object */
-                result->activate();
+                /* This is an object, it is instantiated later on */
+                result = std::make_unique<ObjectNode>();
+                result->type = node.attribute("type").value();
+                result->tag = tag;
+                result->propList = std::move(propList);
+                result->children = std::move(children);
+                result->offset = node.offset_debug();
             } else {
                 /* This is a property */
                 switch (tag) {
@@ -304,8 +319,46 @@ NoriObject *loadFromXML(const std::string &filename) {
         return result;
     };
 
+    /* Helper function to instantiate a parsed object and its children (recursive) */
+    std::function<NoriObject *(const ObjectNode &)> instantiate = [&](const ObjectNode &node) -> NoriObject * {
+        std::vector<NoriObject *> children(node.children.size());
+        tbb::parallel_for(size_t(0), node.children.size(), [&](size_t i) {
+            children[i] = instantiate(*node.children[i]);
+        });
+
+        NoriObject *result = nullptr;
+        try {
+            /* First instantiate the object */
+            result = NoriObjectFactory::createInstance(node.type, node.propList);
+
+            if (result->getClassType() != node.tag) {
+                throw NoriException(
+                    "Unexpectedly constructed an object "
+                    "of type <%s> (expected type <%s>): %s",
+                    NoriObject::classTypeName(result->getClassType()),
+                    NoriObject::classTypeName((NoriObject::EClassType) node.tag),
+                    result->toString());
+            }
+
+            /* Add all children (in the order of the XML file) */
+            for (auto ch: children) {
+                result->addChild(ch);
+                ch->setParent(result);
+            }
+
+            /* Activate / configure the object */
+            result->activate();
+        } catch (const NoriException &e) {
+            throw NoriException("Error while parsing \"%s\": %s (at %s)", filename,
+                                e.what(), offset(node.offset));
+        }
+
+        return result;
+    };
+
     PropertyList list;
-    return parseTag(*doc.begin(), list, EInvalid);
+    std::unique_ptr<ObjectNode> root = parseTag(*doc.begin(), list, EInvalid);
+    return root ? instantiate(*root) : nullptr;
 }
 
 NORI_NAMESPACE_END
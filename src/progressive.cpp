@@ -25,17 +25,26 @@ NORI_NAMESPACE_BEGIN
 class ProgressiveRenderManager : public RenderManager {
 public:
     ProgressiveRenderManager() = default;
-    ProgressiveRenderManager(const PropertyList &propList) { }
+    ProgressiveRenderManager(const PropertyList &propList) {
+        /* merge blocks in a fixed order for bit-identical results */
+        m_deterministic = propList.getBoolean("deterministic", false);
+
+        /* comma-separated list of AOVs to render in the same pass */
+        m_aovs = parseAOVList(propList.getString("aovs", ""));
+    }
 
     void start_render(Scene *scene, ImageBlock& result) override {
         /* Do the following in parallel and asynchronously */
-        render_thread = std::thread([scene, &result] {
+        render_thread = std::thread([scene, &result, deterministic = m_deterministic, aovs = m_aovs] {
             const Camera *camera = scene->getCamera();
             Vector2i outputSize = camera->getOutputSize();
-            scene->getIntegrator()->preprocess(scene);
+            scene->preprocess();
+            scene->getIntegrator()->beginPasses(scene);
+            result.setAOVs(aovs);
 
             /* Create a block generator (i.e. a work scheduler) */
             BlockGenerator blockGenerator(outputSize, NORI_BLOCK_SIZE);
+            OrderedBlockMerger merger(result);
 
             cout << "Rendering .. ";
             cout.flush();
@@ -48,32 +57,41 @@ public:
             auto map = [&](const tbb::blocked_range<int> &range) {
                 /* Allocate memory for a small image block to be rendered
                    by the current thread */
-                ImageBlock block(Vector2i(NORI_BLOCK_SIZE),
+                auto block = std::make_unique<ImageBlock>(Vector2i(NORI_BLOCK_SIZE),
                         camera->getReconstructionFilter());
+                block->setAOVs(aovs);
 
                 /* Create a clone of the sampler for the current thread */
                 std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
 
                 for (int i=range.begin(); i<range.end(); ++i) {
                     /* Request an image block from the block generator */
-                    blockGenerator.next(block);
+                    int blockIndex;
+                    blockGenerator.next(*block, blockIndex);
 
                     /* Manipulate the block offset to achieve different initialization for each sample */
-                    const Point2i offset = block.getOffset();
-                    block.setOffset(Point2i(offset.x()+offset.y()*result.cols(), processedSPP));
+                    const Point2i offset = block->getOffset();
+                    block->setOffset(Point2i(offset.x()+offset.y()*result.cols(), processedSPP));
 
                     /* Inform the sampler about the block to be rendered */
-                    sampler->prepare(block);
+                    sampler->prepare(*block);
 
                     /* Restore correct block offset */
-                    block.setOffset(offset);
+                    block->setOffset(offset);
 
                     /* Render all contained pixels */
-                    renderBlock(scene, sampler.get(), block, processedSPP);
+                    renderBlock(scene, sampler.get(), *block, processedSPP);
 
                     /* The image block has been processed. Now add it to
                        the "big" block that represents the entire image */
-                    result.put(block);
+                    if (deterministic) {
+                        merger.put(blockIndex, std::move(block));
+                        block = std::make_unique<ImageBlock>(Vector2i(NORI_BLOCK_SIZE),
+                                camera->getReconstructionFilter());
+                        block->setAOVs(aovs);
+                    } else {
+                        result.put(*block);
+                    }
                 }
             };
 
@@ -84,8 +102,12 @@ public:
                 /// Default: parallel rendering
                 tbb::parallel_for(range, map);
 
+                /// let learning integrators update between passes
+                scene->getIntegrator()->finishPass(scene, processedSPP + 1);
+
                 /// reset block generator
                 blockGenerator.setBlockCount(outputSize, NORI_BLOCK_SIZE);
+                merger.reset();
 
                 std::cout << "rendered sample " << processedSPP << "\n";
             }
@@ -96,7 +118,8 @@ public:
 
     std::string toString() const override {
         return tfm::format(
-            "ProgressiveRenderManager[]"
+            "ProgressiveRenderManager[deterministic=%s, aovs={%s}]",
+            m_deterministic ? "true" : "false", aovListString(m_aovs)
         );
     }
 
@@ -112,33 +135,45 @@ private:
         /* Clear the block contents */
         block.clear();
 
+        const float diffScale = 1.0f / std::sqrt((float) std::max<size_t>(sampler->getSampleCount(), 1));
+
         /* For each pixel and pixel sample sample */
         for (int y=0; y<size.y(); ++y) {
             for (int x=0; x<size.x(); ++x) {
 
-                /* call before pixel gets sampled */
-                sampler->generate();
+                const Point2i pixel(x + offset.x(), y + offset.y());
 
-                /* advance over previous samples */
-                for (uint32_t i=0; i<sampleCount; ++i)
-                    sampler->advance();
+                /* seek directly to the current sample of this pixel */
+                sampler->startPixelSample(pixel, sampleCount);
 
-                Point2f pixelSample = Point2f((float) (x + offset.x()), (float) (y + offset.y())) + sampler->next2D();
-                Point2f apertureSample = sampler->next2D();
+                /* fetch the pixel and aperture sample at once */
+                Point2f cameraSamples[2];
+                sampler->fill2D(cameraSamples, 2);
+
+                Point2f pixelSample = Point2f((float) pixel.x(), (float) pixel.y()) + cameraSamples[0];
+                const Point2f &apertureSample = cameraSamples[1];
 
                 /* Sample a ray from the camera */
                 Ray3f ray;
                 Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
 
-                /* Compute the incident radiance */
-                value *= integrator->Li(scene, sampler, ray);
-
-                /* Store in the image block */
-                block.put(pixelSample, value);
+                /* Shrink the footprint to the area covered by one sample */
+                ray.scaleDifferentials(diffScale);
+
+                /* Compute the incident radiance (and the AOVs) and store it in the image block */
+                if (block.hasAOVs()) {
+                    AOVRecord aovs;
+                    value *= integrator->LiAOV(scene, sampler, ray, aovs);
+                    block.put(pixelSample, value, aovs);
+                } else {
+                    value *= integrator->Li(scene, sampler, ray);
+                    block.put(pixelSample, value);
+                }
             }
         }
     }
 
+    bool m_deterministic = false;
 };
 
 
@@ -0,0 +1,229 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Rendermanager with path regeneration
+*/
+
+#include <nori/rendermanager.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/block.h>
+#include <nori/timer.h>
+#include <nori/sampler.h>
+#include <nori/integrator.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <atomic>
+#include <thread>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Renders with a fixed number of paths in flight per thread
+ *
+ * Every thread owns \c pathSlots paths and advances all of them by one
+ * bounce (\ref Integrator::stepPath()) per round. As soon as a path
+ * terminates, its contribution is accumulated and the next camera path is
+ * started in the same slot, so the amount of work per round stays constant
+ * regardless of the path lengths. Integrators that don't trace paths
+ * step by step compute a whole path per step.
+ *
+ * Camera paths are handed out per image block and pixel sample (all blocks
+ * of the first sample, then of the second sample, ...). A block is merged
+ * into the image once all of its paths have terminated.
+ */
+class RegenerationRenderManager : public RenderManager {
+public:
+    RegenerationRenderManager(const PropertyList &propList) {
+        /* number of paths traced simultaneously by each thread */
+        m_pathSlots = propList.getInteger("pathSlots", 64);
+        if (m_pathSlots <= 0)
+            throw NoriException("RegenerationRenderManager: the number of path slots must be positive!");
+
+        /* comma-separated list of AOVs to render in the same pass */
+        m_aovs = parseAOVList(propList.getString("aovs", ""));
+    }
+
+    void start_render(Scene *scene, ImageBlock& result) override {
+        render_thread = std::thread([this, scene, &result] {
+            const Camera *camera = scene->getCamera();
+            const Integrator *integrator = scene->getIntegrator();
+            const Vector2i outputSize = camera->getOutputSize();
+            scene->preprocess();
+            result.setAOVs(m_aovs);
+
+            const Vector2i blockCount = (outputSize + Vector2i::Constant(NORI_BLOCK_SIZE - 1)) / NORI_BLOCK_SIZE;
+            const int numBlocks = blockCount.x() * blockCount.y();
+            const int numChunks = numBlocks * (int) scene->getSampler()->getSampleCount();
+            const float diffScale = 1.0f / std::sqrt((float) std::max<size_t>(scene->getSampler()->getSampleCount(), 1));
+
+            cout << "Rendering .. ";
+            cout.flush();
+            Timer timer;
+
+            std::atomic<int> nextChunk{ 0 };
+            std::atomic<uint64_t> totalPaths{ 0 }, totalSteps{ 0 };
+            const int numWorkers = tbb::this_task_arena::max_concurrency();
+
+            tbb::parallel_for(0, numWorkers, [&](int) {
+                /* Block that receives the paths of one chunk (one pixel
+                   sample of every pixel of an image block) */
+                struct PendingBlock {
+                    std::unique_ptr<ImageBlock> block;
+                    int chunk = -1;
+                    uint32_t sampleIndex = 0;
+                    int remaining = 0;
+                };
+
+                struct Slot {
+                    std::unique_ptr<Sampler> sampler;
+                    PendingBlock *pending = nullptr;
+                    int preparedChunk = -1;
+                    PathState state;
+                    AOVRecord aovs;
+                    Point2f pixelSample;
+                    Color3f cameraWeight;
+                };
+
+                /* Blocks of this thread and those that can be reused */
+                std::vector<std::unique_ptr<PendingBlock>> blocks;
+                std::vector<PendingBlock *> freeBlocks;
+                PendingBlock *current = nullptr;
+                int nextPixel = 0;
+                uint64_t paths = 0, steps = 0;
+
+                auto acquireBlock = [&]() -> PendingBlock * {
+                    if (freeBlocks.empty()) {
+                        blocks.push_back(std::make_unique<PendingBlock>());
+                        blocks.back()->block = std::make_unique<ImageBlock>(Vector2i(NORI_BLOCK_SIZE),
+                                camera->getReconstructionFilter());
+                        blocks.back()->block->setAOVs(m_aovs);
+                        return blocks.back().get();
+                    }
+                    PendingBlock *pending = freeBlocks.back();
+                    freeBlocks.pop_back();
+                    return pending;
+                };
+
+                /* Start the next camera path in the slot, returns false once all paths have been started */
+                auto regenerate = [&](Slot &slot) -> bool {
+                    if (!current || nextPixel == current->block->getSize().prod()) {
+                        const int chunk = nextChunk++;
+                        if (chunk >= numChunks)
+                            return false;
+
+                        const int blockIndex = chunk % numBlocks;
+                        const Point2i offset = Point2i(blockIndex % blockCount.x(), blockIndex / blockCount.x()) * NORI_BLOCK_SIZE;
+
+                        current = acquireBlock();
+                        current->block->setOffset(offset);
+                        current->block->setSize((outputSize - offset).cwiseMin(Vector2i::Constant(NORI_BLOCK_SIZE)));
+                        current->block->clear();
+                        current->chunk = chunk;
+                        current->sampleIndex = (uint32_t) (chunk / numBlocks);
+                        current->remaining = current->block->getSize().prod();
+                        nextPixel = 0;
+                    }
+
+                    const ImageBlock &block = *current->block;
+                    slot.pending = current;
+                    if (slot.preparedChunk != current->chunk) {
+                        /* Inform the sampler about the block to be rendered */
+                        slot.preparedChunk = current->chunk;
+                        slot.sampler->prepare(block);
+                    }
+
+                    const Point2i pixel = block.getOffset() + Point2i(nextPixel % block.getSize().x(), nextPixel / block.getSize().x());
+                    ++nextPixel;
+
+                    /* seek directly to the current sample of this pixel */
+                    slot.sampler->startPixelSample(pixel, current->sampleIndex);
+
+                    /* fetch the pixel and aperture sample at once */
+                    Point2f cameraSamples[2];
+                    slot.sampler->fill2D(cameraSamples, 2);
+
+                    slot.pixelSample = Point2f((float) pixel.x(), (float) pixel.y()) + cameraSamples[0];
+
+                    /* Sample a ray from the camera */
+                    Ray3f ray;
+                    slot.cameraWeight = camera->sampleRay(ray, slot.pixelSample, cameraSamples[1]);
+
+                    /* Shrink the footprint to the area covered by one sample */
+                    ray.scaleDifferentials(diffScale);
+                    slot.state = PathState(ray);
+                    slot.aovs = AOVRecord();
+                    ++paths;
+                    return true;
+                };
+
+                /* Accumulate a terminated path, merge its block into the image once complete */
+                auto finish = [&](Slot &slot) {
+                    PendingBlock *pending = slot.pending;
+                    const Color3f value = slot.cameraWeight * slot.state.radiance;
+                    if (pending->block->hasAOVs())
+                        pending->block->put(slot.pixelSample, value, slot.aovs);
+                    else
+                        pending->block->put(slot.pixelSample, value);
+
+                    if (--pending->remaining == 0) {
+                        result.put(*pending->block);
+                        if (pending == current)
+                            current = nullptr;
+                        freeBlocks.push_back(pending);
+                    }
+                };
+
+                std::vector<Slot> slots(m_pathSlots);
+                std::vector<Slot *> active;
+                active.reserve(slots.size());
+                for (Slot &slot : slots) {
+                    /* Create a clone of the sampler for each slot */
+                    slot.sampler = scene->getSampler()->clone();
+                    if (regenerate(slot))
+                        active.push_back(&slot);
+                }
+
+                /* Advance all paths by one step per round, regenerating terminated ones */
+                while (!active.empty()) {
+                    for (size_t i = 0; i < active.size(); ) {
+                        Slot &slot = *active[i];
+                        ++steps;
+                        if (integrator->stepPath(scene, slot.sampler.get(), slot.state,
+                                                 slot.pending->block->hasAOVs() ? &slot.aovs : nullptr)) {
+                            ++i;
+                            continue;
+                        }
+
+                        finish(slot);
+                        if (regenerate(slot)) {
+                            ++i;
+                        } else {
+                            active[i] = active.back();
+                            active.pop_back();
+                        }
+                    }
+                }
+
+                totalPaths += paths;
+                totalSteps += steps;
+            });
+
+            cout << "done. (took " << timer.elapsedString() << ", "
+                 << tfm::format("%.2f", totalPaths ? (double) totalSteps / (double) totalPaths : 0.0)
+                 << " steps per path)" << endl;
+        });
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "RegenerationRenderManager[pathSlots=%i, aovs={%s}]",
+            m_pathSlots, aovListString(m_aovs)
+        );
+    }
+
+private:
+    int m_pathSlots;
+};
+
+NORI_REGISTER_CLASS(RegenerationRenderManager, "regeneration");
+NORI_NAMESPACE_END
@@ -0,0 +1,150 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Consistency test of the lazily mutated ReplaySampler
+*/
+
+#include <nori/mlt.h>
+#include <pcg32.h>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Compare the lazy mutations of \ref ReplaySampler with an eager reference
+ *
+ * The test runs a random sequence of large steps and perturbations, each one
+ * accepted or rejected at random. After every mutation, a random number of
+ * dimensions is read, so most samples are brought up to date only several
+ * mutations later. The reference applies every mutation to all dimensions
+ * immediately and keeps a full copy for rejections.
+ *
+ * Both must agree on every value that is read. For this, the perturbations
+ * are fixed translations and the fallback sampler returns a constant, so the
+ * result doesn't depend on the order in which random numbers are drawn.
+ *
+ * Usage: <tt>\<test type="replaytest"/\></tt>
+ */
+class ReplaySamplerTest : public NoriObject {
+public:
+    ReplaySamplerTest(const PropertyList &propList) {
+        /* Number of mutations */
+        m_iterations = propList.getInteger("iterations", 100000);
+
+        /* Maximum number of 2D samples read by a path */
+        m_maxDimension = propList.getInteger("maxDimension", 64);
+        if (m_maxDimension < 2 || m_maxDimension >= 100)
+            throw NoriException("ReplaySamplerTest: the maximum dimension must be in [2, 100)!");
+
+        /* Probability of a large step */
+        m_largeStep = propList.getFloat("largeStep", 0.1f);
+
+        /* Probability of accepting a mutation */
+        m_acceptance = propList.getFloat("acceptance", 0.5f);
+    }
+
+    void activate() override {
+        cout << "------------------------------------------------------" << endl;
+        cout << "Testing lazy mutations of the ReplaySampler (" << m_iterations << " mutations)" << endl;
+
+        ConstantSampler fallback;
+        ReplaySampler state(&fallback);
+        pcg32 random;
+
+        /* Eager reference state of all dimensions and its backup for rejections */
+        std::vector<Point2f> reference((size_t) m_maxDimension, Point2f(ConstantSampler::Value));
+        std::vector<Point2f> backup;
+
+        state.newChain();
+        state.accept();
+
+        size_t reads = 0;
+        for (int iteration = 0; iteration < m_iterations; ++iteration) {
+            backup = reference;
+            if (random.nextFloat() < m_largeStep) {
+                state.newChain();
+                std::fill(reference.begin(), reference.end(), Point2f(ConstantSampler::Value));
+            } else {
+                const int index = (int) random.nextUInt(PerturbationCount);
+                state.perturb(Perturbations[index]);
+                for (Point2f &value : reference)
+                    value = (value + Point2f(Offsets[index])).unaryExpr([](float v) { return v - std::floor(v); });
+            }
+
+            /* Read the first dimensions like a path of random length */
+            const int dimensions = 2 + (int) random.nextUInt((uint32_t) m_maxDimension - 1);
+            for (int dim = 0; dim < dimensions; ++dim) {
+                const Point2f value = dim == 0 ? state.getPixelSample()
+                                    : dim == 1 ? state.getApertureSample() : state.next2D();
+                ++reads;
+                if (!matches(value, reference[(size_t) dim]))
+                    throw NoriException("ReplaySamplerTest: dimension %i differs after mutation %i "
+                                        "(lazy: %s, eager: %s)!", dim, iteration,
+                                        value.toString(), reference[(size_t) dim].toString());
+            }
+
+            if (random.nextFloat() < m_acceptance) {
+                state.accept();
+            } else {
+                state.reject();
+                reference = backup;
+            }
+        }
+
+        cout << "Passed: " << reads << " lazily mutated samples match the eager reference." << endl;
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "ReplaySamplerTest[\n"
+            "  iterations = %i,\n"
+            "  maxDimension = %i,\n"
+            "  largeStep = %f,\n"
+            "  acceptance = %f\n"
+            "]",
+            m_iterations, m_maxDimension, m_largeStep, m_acceptance
+        );
+    }
+
+    EClassType getClassType() const override { return ETest; }
+
+private:
+    /// Fallback sampler of the test, every large step sets all samples to the same value
+    class ConstantSampler : public Sampler {
+    public:
+        static constexpr float Value = 0.25f;
+
+        std::unique_ptr<Sampler> clone() const override { return std::make_unique<ConstantSampler>(*this); }
+        void prepare(const ImageBlock &) override { }
+        void generate() override { }
+        void advance() override { }
+        float next1D() override { return Value; }
+        Point2f next2D() override { return Point2f(Value); }
+        std::string toString() const override { return "ConstantSampler[]"; }
+    };
+
+    /// Translations of different length and direction
+    static constexpr int PerturbationCount = 3;
+    static constexpr float Offsets[PerturbationCount] = { 0.137f, -0.291f, 0.0625f };
+    static constexpr ReplaySampler::PerturbationFunction Perturbations[PerturbationCount] = {
+        [](Sampler *, float &value) { value += Offsets[0]; },
+        [](Sampler *, float &value) { value += Offsets[1]; },
+        [](Sampler *, float &value) { value += Offsets[2]; }
+    };
+
+    /// Compare two samples on the torus, up to the rounding of the different wrapping
+    static bool matches(const Point2f &a, const Point2f &b) {
+        for (int i = 0; i < 2; ++i) {
+            const float d = std::abs(a[i] - b[i]);
+            if (std::min(d, 1.0f - d) > 1e-3f)
+                return false;
+        }
+        return true;
+    }
+
+    int m_iterations;
+    int m_maxDimension;
+    float m_largeStep;
+    float m_acceptance;
+};
+
+NORI_REGISTER_CLASS(ReplaySamplerTest, "replaytest");
+NORI_NAMESPACE_END
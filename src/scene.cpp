@@ -11,15 +11,43 @@
 #include <nori/camera.h>
 #include <nori/emitter.h>
 #include <nori/bsdf.h>
+#include <tbb/parallel_for.h>
+#include <atomic>
+#include <map>
 
 NORI_NAMESPACE_BEGIN
 
-Scene::Scene(const PropertyList &) {}
+Scene::Scene(const PropertyList &propList) {
+    /* relative increase of the SAH cost of a BVH subtree after which it is
+       rebuilt instead of refitted when rendering animations */
+    m_rebuildThreshold = propList.getFloat("rebuildThreshold", 1.5f);
+    if (m_rebuildThreshold < 1.0f)
+        throw NoriException("Scene: the rebuild threshold must be at least 1!");
+}
 Scene::~Scene() = default;
 
 void Scene::activate() {
     m_bvh->build();
 
+    /* Resolve the shape groups of all instances and build the top-level BVH */
+    std::map<std::string, const ShapeGroup *> groups;
+    for (const auto &group : m_shapeGroups) {
+        if (!groups.emplace(group->getName(), group.get()).second)
+            throw NoriException("There are multiple shape groups named \"%s\"!", group->getName());
+    }
+    for (const auto &instance : m_instances) {
+        auto it = groups.find(instance->getShapeGroupName());
+        if (it == groups.end())
+            throw NoriException("Instance references the unknown shape group \"%s\"!",
+                                instance->getShapeGroupName());
+        instance->setShapeGroup(it->second);
+        m_instanceBVH.addInstance(instance.get());
+    }
+    m_instanceBVH.build();
+
+    m_bbox = m_bvh->getBoundingBox();
+    m_bbox.expandBy(m_instanceBVH.getBoundingBox());
+
     if (!m_integrator)
         throw NoriException("No integrator was specified!");
     if (!m_camera)
@@ -46,12 +74,70 @@ void Scene::activate() {
             m_emitters.emplace_back(emitter);
         }
     }
+    uint32_t meshIndex = static_cast<uint32_t>(m_meshes.size());
+    for (const auto &group : m_shapeGroups) {
+        for (const auto &mesh : group->getMeshes()) {
+            m_bsdfs.emplace_back(mesh->getBSDF());
+            mesh->idx = meshIndex++;
+        }
+    }
 
     cout << endl;
     cout << "Configuration: " << toString() << endl;
     cout << endl;
 }
 
+void Scene::preprocess() {
+    if (m_preprocessed)
+        return;
+    m_integrator->preprocess(this);
+    m_preprocessed = true;
+}
+
+void Scene::swapObjects(std::unique_ptr<Camera> &camera, std::unique_ptr<Integrator> &integrator,
+                        std::unique_ptr<const Sampler> &sampler, std::unique_ptr<RenderManager> &rendermanager) {
+    if (integrator) {
+        std::swap(m_integrator, integrator);
+        m_preprocessed = false;
+    }
+    if (camera) {
+        std::swap(m_camera, camera);
+        if (m_integrator->preprocessUsesCamera())
+            m_preprocessed = false;
+    }
+    if (sampler)
+        std::swap(m_sampler, sampler);
+    if (rendermanager)
+        std::swap(m_rendermanager, rendermanager);
+}
+
+bool Scene::setFrame(int frame) {
+    /* Load the geometry of the new frame */
+    std::atomic<bool> meshesChanged(false);
+    tbb::parallel_for(size_t(0), m_meshes.size(), [&](size_t i) {
+        if (m_meshes[i]->setFrame(frame))
+            meshesChanged = true;
+    });
+    if (meshesChanged)
+        m_bvh->refit(m_rebuildThreshold);
+
+    bool groupsChanged = false;
+    for (const auto &group : m_shapeGroups)
+        groupsChanged |= group->setFrame(frame, m_rebuildThreshold);
+    if (groupsChanged) {
+        for (const auto &instance : m_instances)
+            instance->setShapeGroup(instance->getShapeGroup());
+        m_instanceBVH.build();
+    }
+
+    m_bbox = m_bvh->getBoundingBox();
+    m_bbox.expandBy(m_instanceBVH.getBoundingBox());
+
+    if (meshesChanged || groupsChanged)
+        m_preprocessed = false;
+    return meshesChanged || groupsChanged;
+}
+
 /// Sample a random emitter for direct illumination
 Color3f Scene::sampleEmitterDirect(EmitterQueryRecord &eRec, Point2f sample) const {
     eRec.eidx = static_cast<uint32_t>(sample.x()*static_cast<float>(m_emitters.size()));
@@ -83,6 +169,7 @@ void Scene::addChild(NoriObject *obj) {
         case EMesh: {
                 Mesh *mesh = static_cast<Mesh *>(obj);
                 m_bvh->addMesh(mesh);
+                mesh->idx = static_cast<uint32_t>(m_meshes.size());
                 m_meshes.emplace_back(mesh);
             }
             break;
@@ -96,6 +183,14 @@ void Scene::addChild(NoriObject *obj) {
 
             break;
 
+        case EShapeGroup:
+            m_shapeGroups.emplace_back(static_cast<ShapeGroup *>(obj));
+            break;
+
+        case EInstance:
+            m_instances.emplace_back(static_cast<Instance *>(obj));
+            break;
+
         case ESampler:
             if (m_sampler)
                 throw NoriException("There can only be one sampler per scene!");
@@ -143,6 +238,7 @@ std::string Scene::toString() const {
         "  camera = %s,\n"
         "  meshes = {\n"
         "  %s  },\n"
+        "  shapegroups = %i, instances = %i,\n"
         "  envmap = %s\n"
         "]",
         indent(m_rendermanager->toString()),
@@ -150,6 +246,7 @@ std::string Scene::toString() const {
         indent(m_sampler->toString()),
         indent(m_camera->toString()),
         indent(meshes, 2),
+        m_shapeGroups.size(), m_instances.size(),
         indent(m_envmap ? m_envmap->toString() : std::string("null"))
     );
 }
@@ -0,0 +1,249 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Spatial-directional tree for path guiding
+*/
+
+#include <nori/sdtree.h>
+#include <atomic>
+
+NORI_NAMESPACE_BEGIN
+
+DTree::DTree() : m_nodes(1) { }
+
+Point2f DTree::toCanonical(const Vector3f &d) {
+    const float cosTheta = std::clamp(d.z(), -1.0f, 1.0f);
+    float phi = std::atan2(d.y(), d.x());
+    if (phi < 0.0f)
+        phi += 2.0f * M_PI;
+    return Point2f(std::clamp((cosTheta + 1.0f) * 0.5f, 0.0f, OneMinusEpsilon),
+                   std::clamp(phi * INV_TWOPI, 0.0f, OneMinusEpsilon));
+}
+
+Vector3f DTree::fromCanonical(const Point2f &p) {
+    const float cosTheta = 2.0f * p.x() - 1.0f;
+    const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+    const float phi = 2.0f * M_PI * p.y();
+    return Vector3f(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+}
+
+void DTree::record(const Point2f &point, float value) {
+    if (!(value > 0.0f) || !std::isfinite(value))
+        return;
+
+    Point2f p = point;
+    uint32_t node = 0;
+    while (true) {
+        const int qx = p.x() < 0.5f ? 0 : 1, qy = p.y() < 0.5f ? 0 : 1;
+        const int q = qx + 2 * qy;
+        std::atomic_ref<float>(m_nodes[node].sum[q]).fetch_add(value, std::memory_order_relaxed);
+
+        node = m_nodes[node].child[q];
+        if (!node)
+            return;
+        p = Point2f(p.x() * 2.0f - (float) qx, p.y() * 2.0f - (float) qy);
+    }
+}
+
+Point2f DTree::sample(const Point2f &sample) const {
+    Point2f u = sample;
+    Point2f origin(0.0f);
+    float size = 1.0f;
+    uint32_t node = 0;
+
+    while (true) {
+        const float *s = m_nodes[node].sum;
+        const float total = s[0] + s[1] + s[2] + s[3];
+        if (!(total > 0.0f))
+            return origin + Vector2f(u * size);
+
+        /* Choose the column, then the quadrant within the column */
+        const float px = (s[0] + s[2]) / total;
+        int qx;
+        if (u.x() < px) {
+            qx = 0;
+            u.x() = std::min(u.x() / px, OneMinusEpsilon);
+        } else {
+            qx = 1;
+            u.x() = std::min((u.x() - px) / (1.0f - px), OneMinusEpsilon);
+        }
+
+        const float column = s[qx] + s[qx + 2];
+        const float py = column > 0.0f ? s[qx] / column : 0.5f;
+        int qy;
+        if (u.y() < py) {
+            qy = 0;
+            u.y() = std::min(u.y() / py, OneMinusEpsilon);
+        } else {
+            qy = 1;
+            u.y() = std::min((u.y() - py) / (1.0f - py), OneMinusEpsilon);
+        }
+
+        size *= 0.5f;
+        origin += Vector2f((float) qx, (float) qy) * size;
+
+        node = m_nodes[node].child[qx + 2 * qy];
+        if (!node)
+            return origin + Vector2f(u * size);
+    }
+}
+
+float DTree::pdf(const Point2f &point) const {
+    Point2f p = point;
+    float result = 1.0f;
+    uint32_t node = 0;
+
+    while (true) {
+        const float *s = m_nodes[node].sum;
+        const float total = s[0] + s[1] + s[2] + s[3];
+        if (!(total > 0.0f))
+            return result;
+
+        const int qx = p.x() < 0.5f ? 0 : 1, qy = p.y() < 0.5f ? 0 : 1;
+        const int q = qx + 2 * qy;
+        result *= 4.0f * s[q] / total;
+
+        node = m_nodes[node].child[q];
+        if (!node || result == 0.0f)
+            return result;
+        p = Point2f(p.x() * 2.0f - (float) qx, p.y() * 2.0f - (float) qy);
+    }
+}
+
+float DTree::getTotal() const {
+    const float *s = m_nodes[0].sum;
+    return s[0] + s[1] + s[2] + s[3];
+}
+
+void DTree::refine(const DTree &energy, int maxDepth, float threshold) {
+    m_nodes.assign(1, Node());
+
+    const float total = energy.getTotal();
+    if (!(total > 0.0f))
+        return;
+
+    /* Node of the new tree with the energies of its quadrants. The energy
+       of quadrants that were leaves is spread evenly over their children */
+    struct Entry {
+        uint32_t node;
+        int energyNode;
+        float sum[4];
+        int depth;
+    };
+
+    Entry root { 0, 0, { }, 1 };
+    std::copy(energy.m_nodes[0].sum, energy.m_nodes[0].sum + 4, root.sum);
+    std::vector<Entry> stack { root };
+
+    while (!stack.empty()) {
+        const Entry entry = stack.back();
+        stack.pop_back();
+
+        if (entry.depth >= maxDepth)
+            continue;
+
+        for (int q = 0; q < 4; ++q) {
+            if (!(entry.sum[q] > threshold * total))
+                continue;
+
+            Entry child { (uint32_t) m_nodes.size(), -1, { }, entry.depth + 1 };
+            const uint32_t energyChild = entry.energyNode >= 0 ? energy.m_nodes[entry.energyNode].child[q] : 0;
+            if (energyChild) {
+                child.energyNode = (int) energyChild;
+                std::copy(energy.m_nodes[energyChild].sum, energy.m_nodes[energyChild].sum + 4, child.sum);
+            } else {
+                std::fill(child.sum, child.sum + 4, entry.sum[q] * 0.25f);
+            }
+
+            m_nodes[entry.node].child[q] = child.node;
+            m_nodes.emplace_back();
+            stack.push_back(child);
+        }
+    }
+}
+
+void DTreeWrapper::record(const Vector3f &d, float value) {
+    building.record(DTree::toCanonical(d), value);
+    std::atomic_ref<uint32_t>(sampleCount).fetch_add(1, std::memory_order_relaxed);
+}
+
+Vector3f DTreeWrapper::sample(const Point2f &sample) const {
+    return DTree::fromCanonical(sampling.sample(sample));
+}
+
+float DTreeWrapper::pdf(const Vector3f &d) const {
+    /* the cylindrical mapping has a constant Jacobian of 4 pi */
+    return sampling.pdf(DTree::toCanonical(d)) * INV_FOURPI;
+}
+
+void DTreeWrapper::build(int maxDepth, float threshold) {
+    sampling = building;
+    building.refine(sampling, maxDepth, threshold);
+    sampleCount = 0;
+}
+
+void SDTree::init(const BoundingBox3f &bbox) {
+    /* Cube around the bounding box, so that splitting along alternating axes keeps cells cubic */
+    const Vector3f extents = bbox.getExtents();
+    const float size = std::max(extents.maxCoeff(), Epsilon);
+    const Point3f center = bbox.getCenter();
+    m_bbox = BoundingBox3f(center - Vector3f::Constant(0.5f * size),
+                           center + Vector3f::Constant(0.5f * size));
+    m_nodes.assign(1, Node());
+    m_leaves.assign(1, DTreeWrapper());
+}
+
+uint32_t SDTree::lookupLeaf(const Point3f &point) const {
+    Vector3f p = (point - m_bbox.min).cwiseQuotient(m_bbox.getExtents());
+    uint32_t node = 0;
+    while (m_nodes[node].child[0]) {
+        const int axis = m_nodes[node].axis;
+        if (p[axis] < 0.5f) {
+            p[axis] *= 2.0f;
+            node = m_nodes[node].child[0];
+        } else {
+            p[axis] = p[axis] * 2.0f - 1.0f;
+            node = m_nodes[node].child[1];
+        }
+    }
+    return m_nodes[node].leaf;
+}
+
+DTreeWrapper *SDTree::lookup(const Point3f &p) {
+    return &m_leaves[lookupLeaf(p)];
+}
+
+const DTreeWrapper *SDTree::lookup(const Point3f &p) const {
+    return &m_leaves[lookupLeaf(p)];
+}
+
+void SDTree::refine(uint32_t sampleThreshold, int maxDepth, float threshold) {
+    /* Split leaves with many samples, both children start with a copy of the parent */
+    for (size_t i = 0; i < m_nodes.size(); ++i) {
+        if (m_nodes[i].child[0])
+            continue;
+
+        const uint32_t leaf = m_nodes[i].leaf;
+        if (m_leaves[leaf].sampleCount <= sampleThreshold)
+            continue;
+
+        m_leaves[leaf].sampleCount /= 2;
+        const int axis = (m_nodes[i].axis + 1) % 3;
+        for (int c = 0; c < 2; ++c) {
+            Node child;
+            child.axis = axis;
+            if (c == 0) {
+                child.leaf = leaf;
+            } else {
+                child.leaf = (uint32_t) m_leaves.size();
+                m_leaves.push_back(m_leaves[leaf]);
+            }
+            m_nodes[i].child[c] = (uint32_t) m_nodes.size();
+            m_nodes.push_back(child);
+        }
+    }
+
+    for (DTreeWrapper &leaf : m_leaves)
+        leaf.build(maxDepth, threshold);
+}
+
+NORI_NAMESPACE_END
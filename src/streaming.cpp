@@ -0,0 +1,227 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Rendermanager streaming finished tiles to disk
+*/
+
+#include <nori/rendermanager.h>
+#include <nori/scene.h>
+#include <nori/camera.h>
+#include <nori/rfilter.h>
+#include <nori/block.h>
+#include <nori/timer.h>
+#include <nori/bitmap.h>
+#include <nori/sampler.h>
+#include <nori/integrator.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <atomic>
+#include <thread>
+
+NORI_NAMESPACE_BEGIN
+
+/**
+ * \brief Renders the image tile by tile and streams finished tiles to a
+ * tiled OpenEXR file
+ *
+ * No full-frame buffer is allocated. Due to the reconstruction filter, a
+ * rendered tile also contributes to the borders of its neighbors, so
+ * every tile is accumulated until all of its (up to 8) neighbors have
+ * been rendered. It is then normalized, written and released. Tiles are
+ * handed out in scanline order, which keeps about one row of tiles plus
+ * one tile per thread in memory.
+ *
+ * The image is not displayed and no PNG file is written.
+ */
+class StreamingRenderManager : public RenderManager {
+public:
+    StreamingRenderManager(const PropertyList &propList) {
+        /* edge length of the tiles of the output file in pixels */
+        m_tileSize = propList.getInteger("tileSize", 64);
+        if (m_tileSize <= 0)
+            throw NoriException("StreamingRenderManager: the tile size must be positive!");
+    }
+
+    bool writesOutput() const override { return true; }
+
+    void setOutputFileName(const std::string &filename) override { m_outputName = filename; }
+
+    void start_render(Scene *scene, ImageBlock & /* unused */) override {
+        render_thread = std::thread([this, scene] {
+            const Camera *camera = scene->getCamera();
+            const Vector2i outputSize = camera->getOutputSize();
+            scene->preprocess();
+
+            /* Blocks only contribute to their direct neighbors */
+            if (ImageBlock(Vector2i(0), camera->getReconstructionFilter()).getBorderSize() > m_tileSize) {
+                cerr << "StreamingRenderManager: the reconstruction filter is wider than a tile!" << endl;
+                return;
+            }
+
+            TiledEXRWriter writer(m_outputName, outputSize, m_tileSize);
+            const Vector2i tileCount = writer.getTileCount();
+            const int numTiles = tileCount.x() * tileCount.y();
+
+            /* Pending tiles: accumulated pixels (without border) and the
+               number of tiles that still have to contribute to them */
+            struct PendingTile {
+                Eigen::Array<Color4f, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> pixels;
+                int remaining = 0;
+            };
+            std::map<int, PendingTile> pending;
+            std::mutex pendingMutex;
+
+            auto tileRect = [&](int tile, Point2i &offset, Vector2i &size) {
+                offset = Point2i(tile % tileCount.x(), tile / tileCount.x()) * m_tileSize;
+                size = (outputSize - offset).cwiseMin(Vector2i::Constant(m_tileSize));
+            };
+
+            /* Visit the existing tiles in the 3x3 neighborhood (in index order) */
+            auto forNeighbors = [&](int tile, const auto &func) {
+                const int tx = tile % tileCount.x(), ty = tile / tileCount.x();
+                for (int y = std::max(ty - 1, 0); y <= std::min(ty + 1, tileCount.y() - 1); ++y)
+                    for (int x = std::max(tx - 1, 0); x <= std::min(tx + 1, tileCount.x() - 1); ++x)
+                        func(y * tileCount.x() + x);
+            };
+
+            cout << "Rendering .. ";
+            cout.flush();
+            Timer timer;
+
+            std::atomic<int> nextTile{ 0 };
+            size_t maxPending = 0;
+            const int numWorkers = tbb::this_task_arena::max_concurrency();
+
+            tbb::parallel_for(0, numWorkers, [&](int) {
+                ImageBlock block(Vector2i(m_tileSize), camera->getReconstructionFilter());
+
+                /* Create a clone of the sampler for the current thread */
+                std::unique_ptr<Sampler> sampler(scene->getSampler()->clone());
+
+                for (int tile = nextTile++; tile < numTiles; tile = nextTile++) {
+                    Point2i offset;
+                    Vector2i size;
+                    tileRect(tile, offset, size);
+                    block.setOffset(offset);
+                    block.setSize(size);
+
+                    sampler->prepare(block);
+                    renderBlock(scene, sampler.get(), block);
+
+                    /* Splat the block (with its border) into the pending tiles */
+                    std::vector<std::pair<int, PendingTile>> finished;
+                    {
+                        std::lock_guard<std::mutex> lock(pendingMutex);
+                        forNeighbors(tile, [&](int neighbor) {
+                            Point2i nOffset;
+                            Vector2i nSize;
+                            tileRect(neighbor, nOffset, nSize);
+
+                            auto it = pending.find(neighbor);
+                            if (it == pending.end()) {
+                                it = pending.emplace(neighbor, PendingTile()).first;
+                                it->second.pixels.setConstant(nSize.y(), nSize.x(), Color4f());
+                                forNeighbors(neighbor, [&](int) { ++it->second.remaining; });
+                            }
+                            PendingTile &target = it->second;
+
+                            /* Overlap of the rendered region and the neighbor tile */
+                            const Point2i bMin = offset - Vector2i::Constant(block.getBorderSize());
+                            const Point2i lo = bMin.cwiseMax(nOffset);
+                            const Point2i hi = (offset + size + Vector2i::Constant(block.getBorderSize()))
+                                .cwiseMin(nOffset + nSize);
+                            if ((lo.array() < hi.array()).all())
+                                target.pixels.block(lo.y() - nOffset.y(), lo.x() - nOffset.x(),
+                                                    hi.y() - lo.y(), hi.x() - lo.x())
+                                    += block.block(lo.y() - bMin.y(), lo.x() - bMin.x(),
+                                                   hi.y() - lo.y(), hi.x() - lo.x());
+
+                            if (--target.remaining == 0) {
+                                finished.emplace_back(neighbor, std::move(target));
+                                pending.erase(it);
+                            }
+                        });
+                        maxPending = std::max(maxPending, pending.size() + finished.size());
+                    }
+
+                    /* Normalize and write the finished tiles outside of the lock */
+                    for (auto &[index, finishedTile] : finished) {
+                        Bitmap bitmap(Vector2i((int) finishedTile.pixels.cols(), (int) finishedTile.pixels.rows()));
+                        for (int y = 0; y < bitmap.rows(); ++y)
+                            for (int x = 0; x < bitmap.cols(); ++x)
+                                bitmap.coeffRef(y, x) = finishedTile.pixels.coeff(y, x).divideByFilterWeight();
+                        writer.writeTile(index % tileCount.x(), index / tileCount.x(), bitmap);
+                    }
+                }
+            });
+
+            cout << "done. (took " << timer.elapsedString() << ", at most " << maxPending
+                 << " of " << numTiles << " tiles were held in memory)" << endl;
+        });
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "StreamingRenderManager[tileSize=%i]",
+            m_tileSize
+        );
+    }
+
+private:
+
+    static void renderBlock(const Scene *scene, Sampler *sampler, ImageBlock &block) {
+        const Camera *camera = scene->getCamera();
+        const Integrator *integrator = scene->getIntegrator();
+
+        Point2i offset = block.getOffset();
+        Vector2i size  = block.getSize();
+
+        /* Clear the block contents */
+        block.clear();
+
+        const float diffScale = 1.0f / std::sqrt((float) std::max<size_t>(sampler->getSampleCount(), 1));
+
+        /* For each pixel and pixel sample sample */
+        for (int y=0; y<size.y(); ++y) {
+            for (int x=0; x<size.x(); ++x) {
+
+                const Point2i pixel(x + offset.x(), y + offset.y());
+
+                /* call before pixel gets sampled */
+                sampler->startPixelSample(pixel, 0);
+
+                for (uint32_t i=0; i < sampler->getSampleCount(); ++i) {
+
+                    /* fetch the pixel and aperture sample at once */
+                    Point2f cameraSamples[2];
+                    sampler->fill2D(cameraSamples, 2);
+
+                    Point2f pixelSample = Point2f((float) pixel.x(), (float) pixel.y()) + cameraSamples[0];
+                    const Point2f &apertureSample = cameraSamples[1];
+
+                    /* Sample a ray from the camera */
+                    Ray3f ray;
+                    Color3f value = camera->sampleRay(ray, pixelSample, apertureSample);
+
+                    /* Shrink the footprint to the area covered by one sample */
+                    ray.scaleDifferentials(diffScale);
+
+                    /* Compute the incident radiance */
+                    value *= integrator->Li(scene, sampler, ray);
+
+                    /* Store in the image block */
+                    block.put(pixelSample, value);
+
+                    /* advance to next sample */
+                    sampler->advance();
+                }
+            }
+        }
+    }
+
+    int m_tileSize;
+    std::string m_outputName = "output";
+};
+
+
+NORI_REGISTER_CLASS(StreamingRenderManager, "streaming");
+NORI_NAMESPACE_END
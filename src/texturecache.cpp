@@ -0,0 +1,365 @@
+/*
+    This file is part of Nori, a simple educational ray tracer
+    Tiled texture cache with a memory budget
+*/
+
+#include <nori/texturecache.h>
+#include <ImfTiledInputFile.h>
+#include <ImfInputFile.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfTestFile.h>
+#include <algorithm>
+#include <limits>
+
+NORI_NAMESPACE_BEGIN
+
+/// Tile size used for scanline files and generated levels
+static constexpr int DefaultTileSize = 64;
+
+struct CachedTexture::Tile {
+    std::atomic<bool> referenced{ true };
+    std::atomic<Tile *> *slot = nullptr;
+    size_t bytes = 0;
+    std::unique_ptr<uint8_t[]> data;
+};
+
+struct CachedTexture::File {
+    std::mutex mutex;
+    std::unique_ptr<Imf::TiledInputFile> tiled;
+    std::unique_ptr<Imf::InputFile> scanline;
+    std::string channels[3];
+    Imath::Box2i dataWindow;
+
+    /// Read a region of a level as linear RGB floats (row-major, \c width texels per row)
+    template <typename ReadFunc>
+    void read(const Imath::Box2i &region, float *target, int width, const ReadFunc &readRegion) {
+        const size_t compStride = sizeof(float),
+                     pixelStride = 3 * compStride,
+                     rowStride = pixelStride * width;
+
+        /* Shift the base pointer so that the region starts at the target */
+        char *ptr = reinterpret_cast<char *>(target)
+            - (ptrdiff_t) region.min.x * pixelStride - (ptrdiff_t) region.min.y * rowStride;
+
+        Imf::FrameBuffer frameBuffer;
+        for (int i = 0; i < 3; ++i, ptr += compStride)
+            frameBuffer.insert(channels[i].c_str(), Imf::Slice(Imf::FLOAT, ptr, pixelStride, rowStride));
+        if (tiled)
+            tiled->setFrameBuffer(frameBuffer);
+        else
+            scanline->setFrameBuffer(frameBuffer);
+        readRegion();
+    }
+};
+
+/// Find the names of the red, green and blue channels (same rules as \ref Bitmap)
+static void findRGBChannels(const Imf::Header &header, std::string *names, const std::string &filename) {
+    const char *ch_r = nullptr, *ch_g = nullptr, *ch_b = nullptr;
+    const Imf::ChannelList &channels = header.channels();
+    for (Imf::ChannelList::ConstIterator it = channels.begin(); it != channels.end(); ++it) {
+        std::string name = toLower(it.name());
+
+        if (it.channel().xSampling != 1 || it.channel().ySampling != 1)
+            continue;
+
+        if (!ch_r && (name == "r" || name == "red" ||
+                endsWith(name, ".r") || endsWith(name, ".red"))) {
+            ch_r = it.name();
+        } else if (!ch_g && (name == "g" || name == "green" ||
+                endsWith(name, ".g") || endsWith(name, ".green"))) {
+            ch_g = it.name();
+        } else if (!ch_b && (name == "b" || name == "blue" ||
+                endsWith(name, ".b") || endsWith(name, ".blue"))) {
+            ch_b = it.name();
+        }
+    }
+
+    if (!ch_r || !ch_g || !ch_b)
+        throw NoriException("TextureCache: \"%s\" is not a standard RGB OpenEXR file!", filename);
+    names[0] = ch_r;
+    names[1] = ch_g;
+    names[2] = ch_b;
+}
+
+CachedTexture::CachedTexture(TextureCache &cache, const std::string &filename, ETexelFormat format)
+    : m_cache(cache), m_filename(filename), m_format(format), m_file(new File()) {
+    bool isTiled = false;
+    if (!Imf::isOpenExrFile(filename.c_str(), isTiled))
+        throw NoriException("TextureCache: \"%s\" is not an OpenEXR file!", filename);
+
+    auto addLevel = [&](const Vector2i &size, bool inFile) {
+        Level level;
+        level.size = size;
+        level.tiles = Vector2i((size.x() + m_tileSize.x() - 1) / m_tileSize.x(),
+                               (size.y() + m_tileSize.y() - 1) / m_tileSize.y());
+        level.inFile = inFile;
+        level.slots.reset(new std::atomic<Tile *>[level.tiles.prod()]);
+        for (int i = 0; i < level.tiles.prod(); ++i)
+            level.slots[i].store(nullptr, std::memory_order_relaxed);
+        m_levels.push_back(std::move(level));
+    };
+
+    if (isTiled) {
+        m_file->tiled.reset(new Imf::TiledInputFile(filename.c_str()));
+        const Imf::TiledInputFile &file = *m_file->tiled;
+        findRGBChannels(file.header(), m_file->channels, filename);
+        m_file->dataWindow = file.header().dataWindow();
+        m_tileSize = Vector2i((int) file.tileXSize(), (int) file.tileYSize());
+
+        /* Use the mip levels of the file (ripmaps only contribute their first level) */
+        const int levels = file.levelMode() == Imf::MIPMAP_LEVELS ? file.numLevels() : 1;
+        for (int l = 0; l < levels; ++l)
+            addLevel(Vector2i(file.levelWidth(l), file.levelHeight(l)), true);
+    } else {
+        m_file->scanline.reset(new Imf::InputFile(filename.c_str()));
+        findRGBChannels(m_file->scanline->header(), m_file->channels, filename);
+        m_file->dataWindow = m_file->scanline->header().dataWindow();
+        m_tileSize = Vector2i(DefaultTileSize, DefaultTileSize);
+
+        const Imath::Box2i &dw = m_file->dataWindow;
+        addLevel(Vector2i(dw.max.x - dw.min.x + 1, dw.max.y - dw.min.y + 1), true);
+    }
+
+    /* The remaining levels are generated on demand */
+    while (m_levels.back().size.x() > 1 || m_levels.back().size.y() > 1) {
+        const Vector2i size = m_levels.back().size;
+        addLevel(Vector2i(std::max(1, size.x() / 2), std::max(1, size.y() / 2)), false);
+    }
+
+    cout << "Registered a " << m_levels[0].size.x() << "x" << m_levels[0].size.y()
+         << (isTiled ? " tiled" : "") << " OpenEXR texture \"" << filename
+         << "\" with the texture cache" << endl;
+}
+
+CachedTexture::~CachedTexture() {
+    for (Level &level : m_levels)
+        for (int i = 0; i < level.tiles.prod(); ++i)
+            delete level.slots[i].load(std::memory_order_relaxed);
+}
+
+Color3f CachedTexture::texel(int level, int x, int y) const {
+    const int tx = x / m_tileSize.x(), ty = y / m_tileSize.y();
+    const Tile *tile = fetchTile(level, tx, ty);
+    const int lx = x - tx * m_tileSize.x(), ly = y - ty * m_tileSize.y();
+    return decodeTexel(m_format, tile->data.get(), (size_t) ly * m_tileSize.x() + lx);
+}
+
+const CachedTexture::Tile *CachedTexture::fetchTile(int level, int tx, int ty) const {
+    const Level &l = m_levels[level];
+    std::atomic<Tile *> &slot = l.slots[ty * l.tiles.x() + tx];
+
+    /* Fast path: resident tile, no locks involved. The reference bit is
+       only written when necessary to avoid contention on its cache line */
+    if (Tile *tile = slot.load(std::memory_order_acquire)) {
+        if (!tile->referenced.load(std::memory_order_relaxed))
+            tile->referenced.store(true, std::memory_order_relaxed);
+        return tile;
+    }
+
+    const size_t tileTexels = (size_t) m_tileSize.prod();
+    const size_t bytes = tileTexels * texelSize(m_format);
+    auto newTile = [&](std::atomic<Tile *> &target) {
+        Tile *tile = new Tile();
+        tile->slot = &target;
+        tile->bytes = bytes + sizeof(Tile);
+        tile->data.reset(new uint8_t[bytes]());
+        return tile;
+    };
+
+    /* Publish a loaded tile, unless another thread was faster */
+    auto publish = [&](std::atomic<Tile *> &target, Tile *tile) -> Tile * {
+        Tile *expected = nullptr;
+        if (target.compare_exchange_strong(expected, tile, std::memory_order_acq_rel)) {
+            m_cache.insert(tile);
+            return tile;
+        }
+        delete tile;
+        return expected;
+    };
+
+    const int x0 = tx * m_tileSize.x(), y0 = ty * m_tileSize.y();
+    const int width = std::min(m_tileSize.x(), l.size.x() - x0);
+    const int height = std::min(m_tileSize.y(), l.size.y() - y0);
+
+    if (!l.inFile) {
+        /* Box filter of the next finer level. The finer texels lie in at
+           most 2x2 tiles, which are fetched once: otherwise, evicting one
+           of them during the computation would reload it for every texel */
+        const Vector2i fine = m_levels[level - 1].size;
+        const int ftx0 = 2 * tx, fty0 = 2 * ty;
+        const Tile *fineTiles[2][2] = { { nullptr, nullptr }, { nullptr, nullptr } };
+        auto fineTexel = [&](int fx, int fy) {
+            fx = std::min(fx, fine.x() - 1);
+            fy = std::min(fy, fine.y() - 1);
+            const int ftx = fx / m_tileSize.x(), fty = fy / m_tileSize.y();
+            const Tile *&fineTile = fineTiles[fty - fty0][ftx - ftx0];
+            if (!fineTile)
+                fineTile = fetchTile(level - 1, ftx, fty);
+            return decodeTexel(m_format, fineTile->data.get(),
+                (size_t) (fy - fty * m_tileSize.y()) * m_tileSize.x() + (fx - ftx * m_tileSize.x()));
+        };
+
+        Tile *tile = newTile(slot);
+        for (int y = 0; y < height; ++y) {
+            const int fy = 2 * (y0 + y);
+            for (int x = 0; x < width; ++x) {
+                const int fx = 2 * (x0 + x);
+                const Color3f value = 0.25f * (fineTexel(fx, fy) + fineTexel(fx + 1, fy) +
+                                               fineTexel(fx, fy + 1) + fineTexel(fx + 1, fy + 1));
+                encodeTexel(m_format, tile->data.get(), (size_t) y * m_tileSize.x() + x, value);
+            }
+        }
+        return publish(slot, tile);
+    }
+
+    File &file = *m_file;
+    std::lock_guard<std::mutex> lock(file.mutex);
+
+    /* Check again, the tile may have been loaded while waiting */
+    if (Tile *tile = slot.load(std::memory_order_acquire))
+        return tile;
+
+    auto encodeRegion = [&](Tile *tile, const float *source, int stride, int sx) {
+        for (int y = 0; y < height; ++y)
+            for (int x = 0; x < std::min(m_tileSize.x(), l.size.x() - sx); ++x) {
+                const float *rgb = source + 3 * ((size_t) y * stride + x);
+                encodeTexel(m_format, tile->data.get(), (size_t) y * m_tileSize.x() + x,
+                            Color3f(rgb[0], rgb[1], rgb[2]));
+            }
+    };
+
+    if (file.tiled) {
+        const Imath::Box2i region = file.tiled->dataWindowForTile(tx, ty, level);
+        std::vector<float> buffer((size_t) width * height * 3);
+        file.read(region, buffer.data(), width, [&] { file.tiled->readTile(tx, ty, level); });
+
+        Tile *tile = newTile(slot);
+        encodeRegion(tile, buffer.data(), width, x0);
+        return publish(slot, tile);
+    }
+
+    /* Scanline files can only be read in full rows: load the whole row of tiles */
+    const Imath::Box2i &dw = file.dataWindow;
+    const Imath::Box2i region(Imath::V2i(dw.min.x, dw.min.y + y0),
+                              Imath::V2i(dw.max.x, dw.min.y + y0 + height - 1));
+    std::vector<float> buffer((size_t) l.size.x() * height * 3);
+    file.read(region, buffer.data(), l.size.x(),
+              [&] { file.scanline->readPixels(region.min.y, region.max.y); });
+
+    Tile *result = nullptr;
+    for (int i = 0; i < l.tiles.x(); ++i) {
+        std::atomic<Tile *> &target = l.slots[ty * l.tiles.x() + i];
+        if (i != tx && target.load(std::memory_order_acquire))
+            continue;
+        Tile *tile = newTile(target);
+        encodeRegion(tile, buffer.data() + 3 * (size_t) i * m_tileSize.x(), l.size.x(), i * m_tileSize.x());
+        tile = publish(target, tile);
+        if (i == tx)
+            result = tile;
+    }
+    return result;
+}
+
+std::string CachedTexture::toString() const {
+    return tfm::format("CachedTexture[filename=\"%s\", size=%s, levels=%i, tileSize=%s, format=%s]",
+        m_filename, m_levels[0].size.toString(), getLevelCount(), m_tileSize.toString(),
+        texelFormatName(m_format));
+}
+
+TextureCache &TextureCache::instance() {
+    static TextureCache cache;
+    return cache;
+}
+
+TextureCache::~TextureCache() {
+    for (const Retired &retired : m_retired)
+        delete retired.tile;
+}
+
+const CachedTexture *TextureCache::open(const std::string &filename, ETexelFormat format) {
+    std::unique_ptr<CachedTexture> texture(new CachedTexture(*this, filename, format));
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_textures.push_back(std::move(texture));
+    return m_textures.back().get();
+}
+
+TextureCache::ThreadSlot &TextureCache::threadSlot() {
+    thread_local ThreadSlot *slot = nullptr;
+    if (!slot) {
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        slot = &m_threads.emplace_back();
+    }
+    return *slot;
+}
+
+TextureCache::ReadScope::ReadScope(TextureCache &cache)
+    : m_cache(cache), m_slot(cache.threadSlot()) {
+    if (m_slot.depth++ == 0) {
+        m_slot.epoch.store(m_cache.m_epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+        /* Order the epoch announcement before any subsequent tile access */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+TextureCache::ReadScope::~ReadScope() {
+    if (--m_slot.depth == 0)
+        m_slot.epoch.store(0, std::memory_order_release);
+}
+
+void TextureCache::insert(CachedTexture::Tile *tile) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_resident.push_back(tile);
+
+    /* Evict down to 7/8 of the budget to amortize the sweeps */
+    const size_t budget = m_budget;
+    if ((m_usage += tile->bytes) > budget)
+        evict(budget - budget / 8);
+
+    if (!m_retired.empty())
+        reclaim();
+}
+
+void TextureCache::evict(size_t target) {
+    /* Two rounds suffice: the first one clears all reference bits */
+    for (size_t steps = 2 * m_resident.size(); m_usage > target && !m_resident.empty() && steps > 0; --steps) {
+        if (m_clockHand >= m_resident.size())
+            m_clockHand = 0;
+
+        CachedTexture::Tile *tile = m_resident[m_clockHand];
+        if (tile->referenced.exchange(false, std::memory_order_relaxed)) {
+            ++m_clockHand;
+            continue;
+        }
+
+        /* Unlink the tile, threads that still hold it keep it alive via their epoch */
+        tile->slot->store(nullptr, std::memory_order_seq_cst);
+        m_resident[m_clockHand] = m_resident.back();
+        m_resident.pop_back();
+        m_usage -= tile->bytes;
+        m_retired.push_back({ tile, m_epoch.fetch_add(1, std::memory_order_seq_cst) });
+    }
+}
+
+void TextureCache::reclaim() {
+    uint64_t minEpoch = std::numeric_limits<uint64_t>::max();
+    {
+        std::lock_guard<std::mutex> lock(m_threadMutex);
+        for (const ThreadSlot &slot : m_threads) {
+            const uint64_t epoch = slot.epoch.load(std::memory_order_seq_cst);
+            if (epoch != 0)
+                minEpoch = std::min(minEpoch, epoch);
+        }
+    }
+
+    /* A tile retired in epoch e may only be referenced by scopes entered in epoch <= e */
+    auto it = std::remove_if(m_retired.begin(), m_retired.end(), [&](const Retired &retired) {
+        if (retired.epoch >= minEpoch)
+            return false;
+        delete retired.tile;
+        return true;
+    });
+    m_retired.erase(it, m_retired.end());
+}
+
+NORI_NAMESPACE_END
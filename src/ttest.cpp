@@ -139,6 +139,11 @@ public:
             Sampler *sampler = static_cast<Sampler *>(
                 NoriObjectFactory::createInstance("independent", PropertyList()));
 
+            /* The sampler is used without prepare(), its dimensions must still be independent */
+            ++total;
+            if (testSamplerCorrelation())
+                ++passed;
+
             int ctr = 0;
             for (auto scene : m_scenes) {
                 const Integrator *integrator = scene->getIntegrator();
@@ -185,6 +190,40 @@ public:
             throw std::runtime_error("Some tests failed :(");
     }
 
+    /**
+     * Check that the two components of \ref Sampler::next2D() drawn from a
+     * freshly created independent sampler are uncorrelated. Under the null
+     * hypothesis, sqrt(n) times the sample correlation is approximately
+     * standard normal.
+     */
+    bool testSamplerCorrelation() const {
+        cout << "------------------------------------------------------" << endl;
+        cout << "Testing correlation of next2D() of an unprepared independent sampler" << endl;
+
+        std::unique_ptr<Sampler> sampler(static_cast<Sampler *>(
+            NoriObjectFactory::createInstance("independent", PropertyList())));
+
+        double meanX = 0, meanY = 0, varX = 0, varY = 0, covariance = 0;
+        for (int k=0; k<m_sampleCount; ++k) {
+            Point2f sample = sampler->next2D();
+            double dx = sample.x() - meanX, dy = sample.y() - meanY;
+            meanX += dx / (double) (k+1);
+            meanY += dy / (double) (k+1);
+            varX += dx * (sample.x() - meanX);
+            varY += dy * (sample.y() - meanY);
+            covariance += dx * (sample.y() - meanY);
+        }
+        double correlation = covariance / std::sqrt(varX * varY);
+        double z = std::abs(correlation) * std::sqrt((double) m_sampleCount);
+
+        /* two-sided rejection at the requested significance level */
+        double pValue = std::erfc(z / std::sqrt(2.0));
+        bool result = pValue > m_significanceLevel;
+        cout << (result ? "Accepted" : "Reject") << " the null hypothesis (correlation = "
+             << correlation << ", p-value = " << pValue << ")" << endl;
+        return result;
+    }
+
     std::string toString() const {
         return tfm::format(
             "StudentsTTest[\n"